@@ -0,0 +1,191 @@
+/*
+ Compares decoding of hot path stratum messages by StratumParser against
+ jsoncpp, which EthStratumClient falls back to for everything else.
+
+ Usage: stratumbench [file] [rounds]
+ Where file holds recorded pool lines, one per line (eg. as logged with
+ -v 1). Without it a set of typical notify and response lines is used.
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <json/json.h>
+
+#include <libdevcore/CommonData.h>
+#include <libdevcore/FixedHash.h>
+#include <libpoolprotocols/stratum/StratumParser.h>
+
+using namespace std;
+using namespace dev;
+using namespace dev::eth;
+
+namespace
+{
+// What the client takes out of a message
+struct Decoded
+{
+    string job;
+    h256 header;
+    h256 seed;
+    h256 boundary;
+    bool accepted = false;
+};
+
+const vector<string> c_sampleLines = {
+    // EthereumStratum/1.0.0 notify
+    R"({"id":null,"method":"mining.notify","params":["bf0488aa",)"
+    R"("abad8f99f3918bf903c6a909d9bbc0fdfa5a2f4b9cb1196175ec825c6610126c",)"
+    R"("c5e8b0d3c76e4e1d7c4fbd3d9d46cf32e5b7ed1d96ad3d0e0ce1f1bc1ac2b4ff",true]})",
+    // Stratum / Eth-Proxy notify
+    R"({"id":0,"jsonrpc":"2.0","result":[)"
+    R"("0x7e9f5e1d6a6bdbf2e5d46cf32e5b7ed1d96ad3d0e0ce1f1bc1ac2b4ffa1b2c3d",)"
+    R"("0x5fc898f16035bf5ac9c6d9077ae1e3d5fc1ecc3c9fd5bee8bb00e810fdacbaa0",)"
+    R"("0x0000000112e0be826d694b2e62d01511f12a6061fbaec8bc02357593e70e52ba","0xa0d43c"]})",
+    R"({"id":0,"jsonrpc":"2.0","method":"mining.notify","params":["0x3d8f2c1b",)"
+    R"("0x7e9f5e1d6a6bdbf2e5d46cf32e5b7ed1d96ad3d0e0ce1f1bc1ac2b4ffa1b2c3d",)"
+    R"("0x5fc898f16035bf5ac9c6d9077ae1e3d5fc1ecc3c9fd5bee8bb00e810fdacbaa0",)"
+    R"("0x0000000112e0be826d694b2e62d01511f12a6061fbaec8bc02357593e70e52ba",true]})",
+    // Replies to submitted solutions
+    R"({"id":40,"jsonrpc":"2.0","result":true})",
+    R"({"id":41,"jsonrpc":"2.0","result":false,"error":null})",
+};
+
+// Keeps the compiler from dropping decoded values
+volatile uint64_t g_sink;
+
+bool fastDecode(string const& _line, Decoded& _out)
+{
+    StratumMessage msg;
+    if (!StratumParser::parse(_line, msg))
+        return false;
+
+    if (msg.result.isBool())
+    {
+        _out.accepted = msg.result.asBool();
+        return true;
+    }
+
+    bool inResult = msg.result.isArray();
+    const StratumValue& prm = inResult ? msg.result : msg.params;
+    if (!prm.isArray())
+        return false;
+    if (!inResult && prm.count < 5)
+    {
+        // EthereumStratum/1.0.0 : job, seed, header
+        _out.job.assign(msg.at(prm, 0).text);
+        return StratumParser::toHash(msg.at(prm, 1).text, _out.seed, false) &&
+               StratumParser::toHash(msg.at(prm, 2).text, _out.header, false);
+    }
+    unsigned idx = inResult ? 0 : 1;
+    _out.job.assign(msg.at(prm, 0).text);
+    return StratumParser::toHash(msg.at(prm, idx).text, _out.header, false) &&
+           StratumParser::toHash(msg.at(prm, idx + 1).text, _out.seed, false) &&
+           StratumParser::toHash(msg.at(prm, idx + 2).text, _out.boundary, true);
+}
+
+bool jsonDecode(string const& _line, Decoded& _out)
+{
+    Json::Value jMsg;
+    Json::Reader jRdr;
+    if (!jRdr.parse(_line.data(), _line.data() + _line.size(), jMsg))
+        return false;
+
+    Json::Value jResult = jMsg.get("result", Json::Value::null);
+    if (jResult.isBool())
+    {
+        _out.accepted = jResult.asBool();
+        return true;
+    }
+
+    bool inResult = jResult.isArray();
+    Json::Value jPrm = inResult ? jResult : jMsg.get("params", Json::Value::null);
+    if (!jPrm.isArray())
+        return false;
+    if (!inResult && jPrm.size() < 5)
+    {
+        _out.job = jPrm.get(Json::Value::ArrayIndex(0), "").asString();
+        _out.seed = h256(jPrm.get(Json::Value::ArrayIndex(1), "").asString());
+        _out.header = h256(jPrm.get(Json::Value::ArrayIndex(2), "").asString());
+        return true;
+    }
+    Json::Value::ArrayIndex idx = inResult ? 0 : 1;
+    _out.job = jPrm.get(Json::Value::ArrayIndex(0), "").asString();
+    _out.header = h256(jPrm.get(idx, "").asString());
+    _out.seed = h256(jPrm.get(idx + 1, "").asString());
+    _out.boundary = h256(padLeft(jPrm.get(idx + 2, "").asString(), 64, '0'));
+    return true;
+}
+
+template <typename Decoder>
+void run(char const* _name, Decoder _decode, vector<string> const& _lines, unsigned _rounds)
+{
+    vector<uint64_t> samples;
+    samples.reserve(_lines.size() * _rounds);
+    unsigned failed = 0;
+
+    Decoded out;
+    auto start = chrono::steady_clock::now();
+    for (unsigned r = 0; r < _rounds; r++)
+        for (auto const& line : _lines)
+        {
+            auto t0 = chrono::steady_clock::now();
+            if (!_decode(line, out))
+                failed++;
+            auto t1 = chrono::steady_clock::now();
+            samples.push_back(
+                uint64_t(chrono::duration_cast<chrono::nanoseconds>(t1 - t0).count()));
+            g_sink = g_sink + out.header[0] + out.accepted;
+        }
+    double elapsed = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    sort(samples.begin(), samples.end());
+    auto pct = [&samples](double _p) { return samples[size_t(_p * (samples.size() - 1))]; };
+
+    cout << left << setw(14) << _name << right << fixed << setprecision(0) << setw(12)
+         << samples.size() / elapsed << " msgs/s" << setw(8) << pct(0.5) << " ns p50"
+         << setw(8) << pct(0.99) << " ns p99";
+    if (failed)
+        cout << "  (" << failed / _rounds << " lines not decoded)";
+    cout << endl;
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    vector<string> lines;
+    if (argc > 1)
+    {
+        ifstream in(argv[1]);
+        if (!in)
+        {
+            cerr << "Can't open " << argv[1] << endl;
+            return 1;
+        }
+        for (string line; getline(in, line);)
+            if (!line.empty())
+                lines.push_back(line);
+    }
+    else
+    {
+        lines = c_sampleLines;
+    }
+    if (lines.empty())
+    {
+        cerr << "No lines to decode" << endl;
+        return 1;
+    }
+    unsigned rounds = (argc > 2 ? unsigned(stoul(argv[2])) : 200000u / unsigned(lines.size()));
+    rounds = max(rounds, 1u);
+
+    cout << lines.size() << " lines x " << rounds << " rounds" << endl;
+    run("jsoncpp", jsonDecode, lines, rounds);
+    run("StratumParser", fastDecode, lines, rounds);
+    return 0;
+}
@@ -1,8 +1,13 @@
 
 #include "ApiServer.h"
+#include "StratumServer.h"
+
+#include <future>
+#include <set>
 
 #include <nsfminer/buildinfo.h>
 
+#include <libdevcore/ThreadPolicy.h>
 #include <libethcore/Farm.h>
 
 #ifndef HOST_NAME_MAX
@@ -19,6 +24,23 @@
 
 using namespace std;
 
+// Requests which have to run where Farm and PoolManager live
+static bool changesMinerState(string const& _method)
+{
+    static const set<string> methods = {"miner_restart", "miner_reboot", "miner_addconnection",
+        "miner_setactiveconnection", "miner_removeconnection", "miner_pausegpu",
+        "miner_setverbosity"};
+    return methods.count(_method) != 0;
+}
+
+// Requests answered out of a snapshot of the miner's state
+static bool readsMinerState(string const& _method)
+{
+    static const set<string> methods = {
+        "miner_getstat1", "miner_getstatdetail", "miner_getconnections", "miner_getproxystat"};
+    return methods.count(_method) != 0;
+}
+
 /* helper functions getting values from a JSON request */
 static bool getRequestValue(const char* membername, bool& refValue, Json::Value& jRequest,
     bool optional, Json::Value& jResponse)
@@ -182,11 +204,34 @@ static bool parseRequestId(Json::Value& jRequest, Json::Value& jResponse)
     return false;
 }
 
-ApiServer::ApiServer(string address, int portnum, string password)
-  : m_password(move(password)),
+bool listenOn(tcp::acceptor& _acceptor, string const& _address, uint16_t _port)
+{
+    // Try to bind to port number
+    // if exception occurs it may be due to the fact that
+    // requested port is already in use by another service
+    try
+    {
+        tcp::endpoint endpoint(boost::asio::ip::address::from_string(_address), _port);
+        _acceptor.open(endpoint.protocol());
+        _acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
+        _acceptor.bind(endpoint);
+        _acceptor.listen(64);
+    }
+    catch (const exception&)
+    {
+        boost::system::error_code ec;
+        _acceptor.close(ec);
+        return false;
+    }
+    return true;
+}
+
+ApiServer::ApiServer(string address, int portnum, string password, unsigned threads)
+  : m_threads(max(threads, 1u)),
+    m_password(move(password)),
     m_address(address),
-    m_acceptor(g_io_service),
-    m_io_strand(g_io_service)
+    m_acceptor(m_io_service),
+    m_io_strand(m_io_service)
 {
     if (portnum < 0)
     {
@@ -206,22 +251,9 @@ void ApiServer::start()
     if (m_portnumber == 0)
         return;
 
-    tcp::endpoint endpoint(boost::asio::ip::address::from_string(m_address), m_portnumber);
-
-    // Try to bind to port number
-    // if exception occurs it may be due to the fact that
-    // requested port is already in use by another service
-    try
-    {
-        m_acceptor.open(endpoint.protocol());
-        m_acceptor.set_option(boost::asio::ip::tcp::acceptor::reuse_address(true));
-        m_acceptor.bind(endpoint);
-        m_acceptor.listen(64);
-    }
-    catch (const exception&)
+    if (!listenOn(m_acceptor, m_address, m_portnumber))
     {
-        cwarn << "Could not start API server on port: " +
-                     to_string(m_acceptor.local_endpoint().port());
+        cwarn << "Could not start API server on port: " + to_string(m_portnumber);
         cwarn << "Ensure port is not in use by another service";
         return;
     }
@@ -229,7 +261,12 @@ void ApiServer::start()
     cnote << "Api server listening on port " + to_string(m_acceptor.local_endpoint().port())
           << (m_password.empty() ? "." : ". Authentication needed.");
     m_running.store(true, memory_order_relaxed);
-    m_workThread = thread{boost::bind(&ApiServer::begin_accept, this)};
+    begin_accept();
+    for (unsigned i = 0; i < m_threads; i++)
+        m_workThreads.emplace_back([this]() {
+            ThreadPolicy::apply(ThreadRole::Telemetry);
+            m_io_service.run();
+        });
 }
 
 void ApiServer::stop()
@@ -238,21 +275,71 @@ void ApiServer::stop()
     if (!m_running.load(memory_order_relaxed))
         return;
 
-    m_acceptor.cancel();
-    m_acceptor.close();
-    m_workThread.join();
     m_running.store(false, memory_order_relaxed);
+    m_io_service.stop();
+    for (auto& t : m_workThreads)
+        t.join();
+    m_workThreads.clear();
+
+    boost::system::error_code ec;
+    m_acceptor.close(ec);
+
+    // Let requests handed over to miner's io_service complete
+    // before connections go away
+    promise<void> done;
+    g_io_service.post([&done]() { done.set_value(); });
+    done.get_future().wait();
 
     // Dispose all sessions (if any)
+    lock_guard<mutex> l(m_sessionsMutex);
     m_sessions.clear();
 }
 
+void ApiSnapshots::get(Handler const& _handler)
+{
+    shared_ptr<const ApiSnapshot> snapshot;
+    {
+        lock_guard<mutex> l(m_mutex);
+        if (m_current && steady_clock::now() - m_current->taken < c_maxAge)
+        {
+            snapshot = m_current;
+        }
+        else
+        {
+            m_waiting.push_back(_handler);
+            if (m_refreshing)
+                return;
+            m_refreshing = true;
+        }
+    }
+    if (snapshot)
+    {
+        _handler(snapshot);
+        return;
+    }
+
+    g_io_service.post([this]() {
+        auto snapshot = ApiConnection::takeSnapshot();
+        vector<Handler> waiting;
+        {
+            lock_guard<mutex> l(m_mutex);
+            m_current = snapshot;
+            m_refreshing = false;
+            waiting.swap(m_waiting);
+        }
+        for (auto& handler : waiting)
+            handler(snapshot);
+    });
+}
+
 void ApiServer::begin_accept()
 {
     if (!isRunning())
         return;
 
-    auto session = make_shared<ApiConnection>(m_io_strand, ++lastSessionId, m_readonly, m_password);
+    auto session =
+        make_shared<ApiConnection>(
+        m_io_service, m_snapshots, ++lastSessionId, m_readonly, m_password);
     m_acceptor.async_accept(
         session->socket(), m_io_strand.wrap(boost::bind(&ApiServer::handle_accept, this, session,
                                boost::asio::placeholders::error)));
@@ -266,6 +353,7 @@ void ApiServer::handle_accept(shared_ptr<ApiConnection> session, boost::system::
     {
         session->onDisconnected([&](int id) {
             // Destroy pointer to session
+            lock_guard<mutex> l(m_sessionsMutex);
             auto it = find_if(m_sessions.begin(), m_sessions.end(),
                 [&id](const shared_ptr<ApiConnection> session) { return session->getId() == id; });
             if (it != m_sessions.end())
@@ -274,7 +362,10 @@ void ApiServer::handle_accept(shared_ptr<ApiConnection> session, boost::system::
                 m_sessions.erase(m_sessions.begin() + index);
             }
         });
-        m_sessions.push_back(session);
+        {
+            lock_guard<mutex> l(m_sessionsMutex);
+            m_sessions.push_back(session);
+        }
         cnote << "New API session from " << session->socket().remote_endpoint();
         session->start();
     }
@@ -307,11 +398,12 @@ void ApiConnection::disconnect()
     }
 }
 
-ApiConnection::ApiConnection(
-    boost::asio::io_service::strand& _strand, int id, bool readonly, string password)
+ApiConnection::ApiConnection(boost::asio::io_service& _io_service, ApiSnapshots& _snapshots,
+    int id, bool readonly, string password)
   : m_sessionId(id),
-    m_socket(g_io_service),
-    m_io_strand(_strand),
+    m_socket(_io_service),
+    m_io_strand(_io_service),
+    m_snapshots(_snapshots),
     m_readonly(readonly),
     m_password(move(password))
 {
@@ -326,7 +418,18 @@ void ApiConnection::start()
     recvSocketData();
 }
 
-void ApiConnection::processRequest(Json::Value& jRequest, Json::Value& jResponse)
+void ApiConnection::withSnapshot(ApiSnapshots::Handler const& _handler)
+{
+    // Snapshots may be delivered by miner's io_service thread: get back
+    // to this connection's strand to build the reply
+    auto self = shared_from_this();
+    m_snapshots.get([this, self, _handler](shared_ptr<const ApiSnapshot> const& _snapshot) {
+        m_io_strand.post([self, _handler, _snapshot]() { _handler(_snapshot); });
+    });
+}
+
+void ApiConnection::processRequest(
+    Json::Value& jRequest, Json::Value& jResponse, ApiSnapshot const* _snapshot)
 {
     jResponse["jsonrpc"] = "2.0";
 
@@ -404,14 +507,23 @@ void ApiConnection::processRequest(Json::Value& jRequest, Json::Value& jResponse
 
     assert(m_is_authenticated);
     cnote << "API : Method " << _method << " requested";
+
+    auto snapshot = [_snapshot]() -> ApiSnapshot const& {
+        if (!_snapshot)
+            throw runtime_error("Miner state not available");
+        if (!_snapshot->error.empty())
+            throw runtime_error(_snapshot->error);
+        return *_snapshot;
+    };
+
     if (_method == "miner_getstat1")
     {
-        jResponse["result"] = getMinerStat1();
+        jResponse["result"] = snapshot().stat1;
     }
 
     else if (_method == "miner_getstatdetail")
     {
-        jResponse["result"] = getMinerStatDetail();
+        jResponse["result"] = snapshot().statDetail;
     }
 
     else if (_method == "miner_ping")
@@ -442,7 +554,19 @@ void ApiConnection::processRequest(Json::Value& jRequest, Json::Value& jResponse
     else if (_method == "miner_getconnections")
     {
         // Returns a list of configured pools
-        jResponse["result"] = PoolManager::p().getConnectionsJson();
+        jResponse["result"] = snapshot().connections;
+    }
+
+    else if (_method == "miner_getproxystat")
+    {
+        // Returns the rigs served by the stratum proxy
+        if (snapshot().proxy.isNull())
+        {
+            jResponse["error"]["code"] = -422;
+            jResponse["error"]["message"] = "Proxy not enabled";
+            return;
+        }
+        jResponse["result"] = snapshot().proxy;
     }
 
     else if (_method == "miner_addconnection")
@@ -627,9 +751,11 @@ void ApiConnection::processRequest(Json::Value& jRequest, Json::Value& jResponse
 
 void ApiConnection::recvSocketData()
 {
-    boost::asio::async_read(m_socket, m_recvBuffer, boost::asio::transfer_at_least(1),
-        m_io_strand.wrap(boost::bind(&ApiConnection::onRecvSocketDataCompleted, this,
-            boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred)));
+    boost::asio::async_read(m_socket, m_framer.prepare(), boost::asio::transfer_at_least(1),
+        m_io_strand.wrap(makeAllocHandler(m_recvMemory,
+            boost::bind(&ApiConnection::onRecvSocketDataCompleted, shared_from_this(),
+                boost::asio::placeholders::error,
+                boost::asio::placeholders::bytes_transferred))));
 }
 
 void ApiConnection::onRecvSocketDataCompleted(
@@ -642,24 +768,23 @@ void ApiConnection::onRecvSocketDataCompleted(
     3rd group : HTTP version
     */
     static regex http_pattern("^([A-Z]{1,6}) (\\/[\\S]*) (HTTP\\/1\\.[0-9]{1})");
-    smatch http_matches;
+    cmatch http_matches;
 
     if (!ec && bytes_transferred > 0)
     {
-        // Extract received message and free the buffer
-        string rx_message(
-            boost::asio::buffer_cast<const char*>(m_recvBuffer.data()), bytes_transferred);
-        m_recvBuffer.consume(bytes_transferred);
-        m_message.append(rx_message);
-
-        string line;
-        string linedelimiter;
-        size_t linedelimiteroffset;
+        // Received data lands directly in the framer's storage
+        m_framer.commit(bytes_transferred);
+        string_view message = m_framer.pending();
 
-        if (m_message.size() < 4)
-            return;  // Wait for other data to come in
+        if (message.size() < 4)
+        {
+            // Wait for other data to come in
+            recvSocketData();
+            return;
+        }
 
-        if (regex_search(m_message, http_matches, http_pattern, regex_constants::match_default))
+        if (regex_search(message.data(), message.data() + message.size(), http_matches,
+                http_pattern, regex_constants::match_default))
         {
             // We got an HTTP request
             string http_method = http_matches[1].str();
@@ -678,7 +803,7 @@ void ApiConnection::onRecvSocketDataCompleted(
                    << "Content-Length: " << what.size() << "\r\n\r\n"
                    << what << "\r\n";
                 sendSocketData(ss.str(), true);
-                m_message.clear();
+                m_framer.clear();
                 return;
             }
 
@@ -694,7 +819,7 @@ void ApiConnection::onRecvSocketDataCompleted(
                    << "Content-Length: " << what.size() << "\r\n\r\n"
                    << what << "\r\n";
                 sendSocketData(ss.str(), true);
-                m_message.clear();
+                m_framer.clear();
                 return;
             }
 
@@ -705,13 +830,15 @@ void ApiConnection::onRecvSocketDataCompleted(
             // vector<string> lines;
             // boost::split(lines, m_message, [](char _c) { return _c == '\n'; });
 
-            stringstream ss;  // Builder of the response
+            // The page is built out of the shared snapshot of miner's state
+            withSnapshot([this, http_ver](shared_ptr<const ApiSnapshot> const& _snapshot) {
+                stringstream ss;  // Builder of the response
 
-            if (http_method == "GET" && (http_path == "/" || http_path == "/getstat1"))
-            {
                 try
                 {
-                    string body = getHttpMinerStatDetail();
+                    if (!_snapshot->error.empty())
+                        throw runtime_error(_snapshot->error);
+                    string body = getHttpMinerStatDetail(_snapshot->statDetail);
                     ss.clear();
                     ss << http_ver << " "
                        << "200 Ok Error\r\n"
@@ -733,72 +860,14 @@ void ApiConnection::onRecvSocketDataCompleted(
                        << "Content-Length: " << what.size() << "\r\n\r\n"
                        << what << "\r\n";
                 }
-            }
-
-            sendSocketData(ss.str(), true);
-            m_message.clear();
+                sendSocketData(ss.str(), true);
+            });
+            m_framer.clear();
         }
         else
         {
             // We got a Json request
-            // Process each line in the transmission
-            linedelimiter = "\n";
-
-            linedelimiteroffset = m_message.find(linedelimiter);
-            while (linedelimiteroffset != string::npos)
-            {
-                if (linedelimiteroffset > 0)
-                {
-                    line = m_message.substr(0, linedelimiteroffset);
-                    boost::trim(line);
-
-                    if (!line.empty())
-                    {
-                        // Test validity of chunk and process
-                        Json::Value jMsg;
-                        Json::Value jRes;
-                        Json::Reader jRdr;
-                        if (jRdr.parse(line, jMsg))
-                        {
-                            try
-                            {
-                                // Run in sync so no 2 different async reads may overlap
-                                processRequest(jMsg, jRes);
-                            }
-                            catch (const exception& _ex)
-                            {
-                                jRes = Json::Value();
-                                jRes["jsonrpc"] = "2.0";
-                                jRes["id"] = Json::Value::null;
-                                jRes["error"]["errorcode"] = "500";
-                                jRes["error"]["message"] = _ex.what();
-                            }
-                        }
-                        else
-                        {
-                            jRes = Json::Value();
-                            jRes["jsonrpc"] = "2.0";
-                            jRes["id"] = Json::Value::null;
-                            jRes["error"]["errorcode"] = "-32700";
-                            string what = jRdr.getFormattedErrorMessages();
-                            boost::replace_all(what, "\n", " ");
-                            cwarn << "API : Got invalid Json message " << what;
-                            jRes["error"]["message"] = "Json parse error : " + what;
-                        }
-
-                        // Send response to client
-                        sendSocketData(jRes);
-                    }
-                }
-
-                // Next line (if any)
-                m_message.erase(0, linedelimiteroffset + 1);
-                linedelimiteroffset = m_message.find(linedelimiter);
-            }
-
-            // Eventually keep reading from socket
-            if (m_socket.is_open())
-                recvSocketData();
+            processLines();
         }
     }
     else
@@ -807,6 +876,88 @@ void ApiConnection::onRecvSocketDataCompleted(
     }
 }
 
+void ApiConnection::processLines()
+{
+    // Process each line in the transmission
+    string_view line;
+    while (m_framer.next(line))
+    {
+        if (line.empty())
+            continue;
+
+        // Test validity of chunk
+        Json::Value jMsg;
+        Json::Reader jRdr;
+        if (!jRdr.parse(line.data(), line.data() + line.size(), jMsg))
+        {
+            Json::Value jRes;
+            jRes["jsonrpc"] = "2.0";
+            jRes["id"] = Json::Value::null;
+            jRes["error"]["errorcode"] = "-32700";
+            string what = jRdr.getFormattedErrorMessages();
+            boost::replace_all(what, "\n", " ");
+            cwarn << "API : Got invalid Json message " << what;
+            jRes["error"]["message"] = "Json parse error : " + what;
+            sendSocketData(jRes);
+            continue;
+        }
+
+        auto reply = [this](Json::Value& _request, ApiSnapshot const* _snapshot) {
+            Json::Value jRes;
+            try
+            {
+                processRequest(_request, jRes, _snapshot);
+            }
+            catch (const exception& _ex)
+            {
+                jRes = Json::Value();
+                jRes["jsonrpc"] = "2.0";
+                jRes["id"] = Json::Value::null;
+                jRes["error"]["errorcode"] = "500";
+                jRes["error"]["message"] = _ex.what();
+            }
+            return jRes;
+        };
+
+        // Requests are answered one at a time so replies go out in order.
+        // Remaining lines are picked up once the response is sent
+        string method;
+        if (jMsg.isObject() && jMsg["method"].isString())
+            method = jMsg["method"].asString();
+        auto self = shared_from_this();
+
+        if (m_is_authenticated && changesMinerState(method))
+        {
+            // These run in miner's io_service, which Farm and PoolManager live in
+            g_io_service.post([this, self, jMsg, reply]() mutable {
+                Json::Value jRes = reply(jMsg, nullptr);
+                m_io_strand.post([this, self, jRes]() {
+                    sendSocketData(jRes);
+                    processLines();
+                });
+            });
+            return;
+        }
+
+        if (m_is_authenticated && readsMinerState(method))
+        {
+            withSnapshot(
+                [this, jMsg, reply](shared_ptr<const ApiSnapshot> const& _snapshot) mutable {
+                    sendSocketData(reply(jMsg, _snapshot.get()));
+                    processLines();
+                });
+            return;
+        }
+
+        // Nothing to look at in miner's state
+        sendSocketData(reply(jMsg, nullptr));
+    }
+
+    // Eventually keep reading from socket
+    if (m_socket.is_open())
+        recvSocketData();
+}
+
 void ApiConnection::sendSocketData(Json::Value const& jReq, bool _disconnect)
 {
     if (!m_socket.is_open())
@@ -824,8 +975,9 @@ void ApiConnection::sendSocketData(string const& _s, bool _disconnect)
     os << _s;
 
     async_write(m_socket, m_sendBuffer,
-        m_io_strand.wrap(boost::bind(&ApiConnection::onSendSocketDataCompleted, this,
-            boost::asio::placeholders::error, _disconnect)));
+        m_io_strand.wrap(makeAllocHandler(m_sendMemory,
+            boost::bind(&ApiConnection::onSendSocketDataCompleted, shared_from_this(),
+                boost::asio::placeholders::error, _disconnect))));
 }
 
 void ApiConnection::onSendSocketDataCompleted(const boost::system::error_code& ec, bool _disconnect)
@@ -834,6 +986,25 @@ void ApiConnection::onSendSocketDataCompleted(const boost::system::error_code& e
         disconnect();
 }
 
+shared_ptr<const ApiSnapshot> ApiConnection::takeSnapshot()
+{
+    auto snapshot = make_shared<ApiSnapshot>();
+    snapshot->taken = steady_clock::now();
+    try
+    {
+        snapshot->stat1 = getMinerStat1();
+        snapshot->statDetail = getMinerStatDetail();
+        snapshot->connections = PoolManager::p().getConnectionsJson();
+        if (StratumServer::s() && StratumServer::s()->isRunning())
+            snapshot->proxy = StratumServer::s()->getStatsJson();
+    }
+    catch (const exception& _ex)
+    {
+        snapshot->error = _ex.what();
+    }
+    return snapshot;
+}
+
 Json::Value ApiConnection::getMinerStat1()
 {
     auto connection = PoolManager::p().getActiveConnection();
@@ -927,6 +1098,20 @@ Json::Value ApiConnection::getMinerStatDetailPerMiner(
 
     hwinfo["sensors"] = sensors;
 
+    /* Statistics of sensors over last collection period */
+    auto statsJson = [](const HwSensorStatsType& _s) {
+        Json::Value jStats = Json::Value(Json::arrayValue);
+        jStats.append(_s.min);
+        jStats.append(_s.max);
+        jStats.append(_s.mean);
+        jStats.append(_s.p95);
+        return jStats;
+    };
+    Json::Value sensorstats;
+    sensorstats["temp"] = statsJson(_t.miners.at(_index).sensors.tempStats);
+    sensorstats["power"] = statsJson(_t.miners.at(_index).sensors.powerStats);
+    hwinfo["sensors_stats"] = sensorstats;
+
     /* Mining Info */
     Json::Value mininginfo;
     Json::Value jshares = Json::Value(Json::arrayValue);
@@ -943,9 +1128,11 @@ Json::Value ApiConnection::getMinerStatDetailPerMiner(
     mininginfo["shares"] = jshares;
     mininginfo["paused"] = _miner->paused();
     mininginfo["pause_reason"] = _miner->paused() ? _miner->pausedString() : Json::Value::null;
+    mininginfo["duty"] = unsigned(_miner->dutyCycle() * 100.0f + 0.5f);
 
     /* Hash & Share infos */
     mininginfo["hashrate"] = toHex((uint32_t)_t.miners.at(_index).hashrate, HexPrefix::Add);
+    mininginfo["efficiency"] = getEfficiencyJson(_t.miners.at(_index).efficiency);
 
     jRes["hardware"] = hwinfo;
     jRes["mining"] = mininginfo;
@@ -953,9 +1140,23 @@ Json::Value ApiConnection::getMinerStatDetailPerMiner(
     return jRes;
 }
 
-string ApiConnection::getHttpMinerStatDetail()
+Json::Value ApiConnection::getEfficiencyJson(const EfficiencyAccountType& _e)
+{
+    // Nothing to report unless power drain is monitored (--HWMON 2)
+    if (!_e.primed)
+        return Json::Value::null;
+
+    Json::Value jRes;
+    Json::Value jewma = Json::Value(Json::arrayValue);
+    for (int i = 0; i < 3; i++)
+        jewma.append(_e.ewma(i));
+    jRes["total"] = _e.total();
+    jRes["ewma"] = jewma;
+    return jRes;
+}
+
+string ApiConnection::getHttpMinerStatDetail(Json::Value const& jStat)
 {
-    Json::Value jStat = getMinerStatDetail();
     uint64_t durationSeconds = jStat["host"]["runtime"].asUInt64();
     int hours = (int)(durationSeconds / 3600);
     durationSeconds -= (hours * 3600);
@@ -1104,6 +1305,7 @@ Json::Value ApiConnection::getMinerStatDetail()
     mininginfo["epoch"] = PoolManager::p().getCurrentEpoch();
     mininginfo["epoch_changes"] = PoolManager::p().getEpochChanges();
     mininginfo["difficulty"] = PoolManager::p().getCurrentDifficulty();
+    mininginfo["efficiency"] = getEfficiencyJson(t.farm.efficiency);
 
     sharesinfo.append(t.farm.solutions.accepted);
     sharesinfo.append(t.farm.solutions.rejected);
@@ -1,7 +1,9 @@
 
 #pragma once
 
+#include <mutex>
 #include <regex>
+#include <thread>
 
 #include <boost/asio.hpp>
 #include <boost/bind/bind.hpp>
@@ -9,6 +11,8 @@
 
 #include <json/json.h>
 
+#include <libdevcore/HandlerMemory.h>
+#include <libdevcore/LineFramer.h>
 #include <libethcore/Farm.h>
 #include <libethcore/Miner.h>
 #include <libpoolprotocols/PoolManager.h>
@@ -20,17 +24,59 @@ using namespace std::chrono;
 using boost::asio::ip::tcp;
 using namespace boost::placeholders;
 
-class ApiConnection
+// Opens and binds _acceptor then starts listening. False on failure
+// (eg. requested port is already in use by another service)
+bool listenOn(tcp::acceptor& _acceptor, string const& _address, uint16_t _port);
+
+// Read-only copy of the miner's state which queries are answered from
+struct ApiSnapshot
+{
+    std::chrono::steady_clock::time_point taken;
+    Json::Value stat1;
+    Json::Value statDetail;
+    Json::Value connections;
+    Json::Value proxy;  // Null unless the stratum proxy is running
+    std::string error;  // Why the state could not be captured (if so)
+};
+
+/**
+ * @brief Shares snapshots of the miner's state among API connections.
+ * Snapshots are taken by miner's io_service, where Farm and PoolManager live,
+ * at most once every c_maxAge no matter how many clients are polling. Callers
+ * asking while a refresh is in progress wait for that same refresh.
+ */
+class ApiSnapshots
+{
+public:
+    using Handler = std::function<void(std::shared_ptr<const ApiSnapshot> const&)>;
+
+    // Calls _handler with an up to date snapshot. Either right away or, if
+    // one has to be taken, from miner's io_service thread
+    void get(Handler const& _handler);
+
+private:
+    static constexpr std::chrono::milliseconds c_maxAge{1000};
+
+    std::mutex m_mutex;
+    std::shared_ptr<const ApiSnapshot> m_current;
+    std::vector<Handler> m_waiting;
+    bool m_refreshing = false;
+};
+
+class ApiConnection : public std::enable_shared_from_this<ApiConnection>
 {
 public:
 
-    ApiConnection(boost::asio::io_service::strand& _strand, int id, bool readonly, string password);
+    ApiConnection(boost::asio::io_service& _io_service, ApiSnapshots& _snapshots, int id,
+        bool readonly, string password);
 
     ~ApiConnection() = default;
 
     void start();
+    void disconnect();
 
-    Json::Value getMinerStat1();
+    static Json::Value getMinerStat1();
+    static std::shared_ptr<const ApiSnapshot> takeSnapshot();
 
     using Disconnected = std::function<void(int const&)>;
     void onDisconnected(Disconnected const& _handler) { m_onDisconnected = _handler; }
@@ -40,8 +86,10 @@ public:
     tcp::socket& socket() { return m_socket; }
 
 private:
-    void disconnect();
-    void processRequest(Json::Value& jRequest, Json::Value& jResponse);
+    void processLines();
+    void processRequest(
+        Json::Value& jRequest, Json::Value& jResponse, ApiSnapshot const* _snapshot);
+    void withSnapshot(ApiSnapshots::Handler const& _handler);
     void recvSocketData();
     void onRecvSocketDataCompleted(
         const boost::system::error_code& ec, std::size_t bytes_transferred);
@@ -49,22 +97,28 @@ private:
     void sendSocketData(std::string const& _s, bool _disconnect = false);
     void onSendSocketDataCompleted(const boost::system::error_code& ec, bool _disconnect = false);
 
-    Json::Value getMinerStatDetail();
-    Json::Value getMinerStatDetailPerMiner(const TelemetryType& _t, std::shared_ptr<Miner> _miner);
+    static Json::Value getMinerStatDetail();
+    static Json::Value getMinerStatDetailPerMiner(
+        const TelemetryType& _t, std::shared_ptr<Miner> _miner);
+    static Json::Value getEfficiencyJson(const EfficiencyAccountType& _e);
 
-    std::string getHttpMinerStatDetail();
+    static std::string getHttpMinerStatDetail(Json::Value const& jStat);
 
     Disconnected m_onDisconnected;
 
     int m_sessionId;
 
     tcp::socket m_socket;
-    boost::asio::io_service::strand& m_io_strand;
+    boost::asio::io_service::strand m_io_strand;
+    ApiSnapshots& m_snapshots;
     boost::asio::streambuf m_sendBuffer;
-    boost::asio::streambuf m_recvBuffer;
     Json::StreamWriterBuilder m_jSwBuilder;
 
-    std::string m_message;  // The internal message string buffer
+    LineFramer m_framer;  // Splits received data in lines
+
+    // Recycled storage of the pending read and write operations
+    HandlerMemory m_recvMemory;
+    HandlerMemory m_sendMemory;
 
     bool m_readonly = false;
     std::string m_password = "";
@@ -73,10 +127,18 @@ private:
 };
 
 
+/**
+ * @brief Serves API requests on threads of its own.
+ * Sockets, parsing and replies are handled by a pool of threads running a
+ * dedicated io_service, so slow or busy clients never hold up miner's
+ * io_service. Queries are answered from a shared snapshot of the miner's
+ * state; only the snapshot itself and the requests changing that state go
+ * through miner's io_service as that's where Farm and PoolManager live.
+ */
 class ApiServer
 {
 public:
-    ApiServer(string address, int portnum, string password);
+    ApiServer(string address, int portnum, string password, unsigned threads = 1);
     bool isRunning() { return m_running.load(std::memory_order_relaxed); };
     void start();
     void stop();
@@ -87,7 +149,9 @@ private:
 
     int lastSessionId = 0;
 
-    std::thread m_workThread;
+    boost::asio::io_service m_io_service;  // Serves api connections only
+    std::vector<std::thread> m_workThreads;
+    unsigned m_threads;
     std::atomic<bool> m_readonly = {false};
     std::string m_password = "";
     std::atomic<bool> m_running = {false};
@@ -95,5 +159,7 @@ private:
     uint16_t m_portnumber;
     tcp::acceptor m_acceptor;
     boost::asio::io_service::strand m_io_strand;
+    ApiSnapshots m_snapshots;
+    std::mutex m_sessionsMutex;
     std::vector<std::shared_ptr<ApiConnection>> m_sessions;
 };
@@ -0,0 +1,539 @@
+
+#include "StratumServer.h"
+
+#include <future>
+
+#include <nsfminer/buildinfo.h>
+
+using namespace std;
+
+// Hex digits of extranonce added to pool's to tell rigs apart
+static const unsigned c_slotDigits = 2;
+static const unsigned c_slots = 1 << (c_slotDigits * 4);
+
+// Slot searched by local farm. Rigs get the others
+static const unsigned c_farmSlot = 0;
+static const unsigned c_maxSessions = c_slots - 1;
+
+// Jobs a rig may still submit shares for
+static const size_t c_jobHistory = 4;
+
+StratumServer* StratumServer::m_this = nullptr;
+
+namespace
+{
+Json::Value stratumError(int _code, const char* _message)
+{
+    Json::Value jErr(Json::arrayValue);
+    jErr.append(_code);
+    jErr.append(_message);
+    jErr.append(Json::Value::null);
+    return jErr;
+}
+
+}  // namespace
+
+StratumServer::StratumServer(string address, int portnum)
+  : m_address(address),
+    m_portnumber(uint16_t(portnum)),
+    m_acceptor(g_io_service),
+    m_io_strand(g_io_service),
+    m_slots(c_slots, false)
+{
+    m_slots[c_farmSlot] = true;
+    m_jSwBuilder.settings_["indentation"] = "";
+    m_this = this;
+}
+
+StratumServer::~StratumServer()
+{
+    m_this = nullptr;
+}
+
+void StratumServer::start()
+{
+    if (m_portnumber == 0)
+        return;
+
+    if (!listenOn(m_acceptor, m_address, m_portnumber))
+    {
+        cwarn << "Could not start stratum proxy on port: " + to_string(m_portnumber);
+        cwarn << "Ensure port is not in use by another service";
+        return;
+    }
+
+    // Keep local farm off rigs' nonces
+    PoolManager::p().reserveNonceSlot(c_slotDigits, c_farmSlot);
+    PoolManager::p().onWorkReceived([&](WorkPackage const& wp) {
+        g_io_service.post(
+            m_io_strand.wrap(boost::bind(&StratumServer::setWork, this, wp)));
+    });
+    PoolManager::p().onExternalSolution([&](unsigned const& _minerIdx, bool _accepted) {
+        g_io_service.post(m_io_strand.wrap(
+            boost::bind(&StratumServer::externalSolution, this, _minerIdx, _accepted)));
+    });
+
+    cnote << "Stratum proxy listening on port " + to_string(m_acceptor.local_endpoint().port());
+    m_running.store(true, memory_order_relaxed);
+    g_io_service.post(m_io_strand.wrap(boost::bind(&StratumServer::begin_accept, this)));
+}
+
+void StratumServer::stop()
+{
+    // Exit if not started
+    if (!m_running.load(memory_order_relaxed))
+        return;
+
+    m_running.store(false, memory_order_relaxed);
+
+    // PoolManager's callbacks, the acceptor and the sessions are all used
+    // by miner's io_service so they're released from there. Completions of
+    // the aborted operations get queued meanwhile : wait for them as well
+    // as they refer to this server
+    promise<void> done;
+    g_io_service.post(m_io_strand.wrap([this, &done]() {
+        PoolManager::p().onWorkReceived(nullptr);
+        PoolManager::p().onExternalSolution(nullptr);
+
+        boost::system::error_code ec;
+        m_acceptor.cancel(ec);
+        m_acceptor.close(ec);
+
+        // Dispose all sessions (if any)
+        vector<shared_ptr<StratumConnection>> sessions;
+        {
+            lock_guard<mutex> l(m_sessionsMutex);
+            sessions.swap(m_sessions);
+        }
+        for (auto& session : sessions)
+            session->m_socket.close(ec);
+
+        g_io_service.post([&done]() { done.set_value(); });
+    }));
+    done.get_future().wait();
+}
+
+void StratumServer::begin_accept()
+{
+    if (!isRunning())
+        return;
+
+    // Each rig gets a free slot of nonces
+    unsigned slot = 0;
+    while (slot < c_slots && m_slots[slot])
+        slot++;
+    if (slot == c_slots)
+    {
+        cwarn << "Stratum proxy : all " << c_maxSessions << " slots in use";
+        return;
+    }
+
+    auto session = make_shared<StratumConnection>(*this, m_io_strand, ++lastSessionId, slot);
+    m_acceptor.async_accept(
+        session->socket(), m_io_strand.wrap(boost::bind(&StratumServer::handle_accept, this,
+                               session, boost::asio::placeholders::error)));
+}
+
+void StratumServer::handle_accept(
+    shared_ptr<StratumConnection> session, boost::system::error_code ec)
+{
+    if (ec == boost::asio::error::operation_aborted)
+        return;
+
+    if (!ec)
+    {
+        {
+            lock_guard<mutex> l(m_sessionsMutex);
+            m_sessions.push_back(session);
+        }
+        m_slots[session->slot()] = true;
+        cnote << "New proxy session from " << session->socket().remote_endpoint();
+        session->start();
+    }
+
+    // Resubmit new accept
+    begin_accept();
+}
+
+void StratumServer::sessionDisconnected(int id)
+{
+    bool full = false;
+    shared_ptr<StratumConnection> session;
+    {
+        lock_guard<mutex> l(m_sessionsMutex);
+        auto it = find_if(m_sessions.begin(), m_sessions.end(),
+            [&id](const shared_ptr<StratumConnection> s) { return s->getId() == id; });
+        if (it == m_sessions.end())
+            return;
+        session = *it;
+        m_sessions.erase(it);
+        full = (m_sessions.size() == c_maxSessions - 1);
+    }
+    cnote << "Proxy session " << session->m_worker << " " << session->m_address << " closed";
+    m_slots[session->slot()] = false;
+
+    // Accepting stopped when no slot was left
+    if (full)
+        begin_accept();
+}
+
+string StratumServer::extranonce(unsigned slot)
+{
+    // Rig's nonces start with pool's extranonce followed by its slot
+    string prefix;
+    if (!m_jobs.empty())
+    {
+        const WorkPackage& wp = m_jobs.front().wp;
+        prefix = toHex(wp.startNonce).substr(0, min<size_t>(wp.exSizeBytes, 16));
+    }
+    stringstream ss;
+    ss << prefix << hex << setw(c_slotDigits) << setfill('0') << slot;
+    return ss.str();
+}
+
+void StratumServer::setWork(WorkPackage const& wp)
+{
+    if (wp.exSizeBytes + c_slotDigits > 12)
+    {
+        cwarn << "Stratum proxy : pool's extranonce is too long to share nonces among rigs";
+        return;
+    }
+
+    Job job;
+    job.id = toHex(++m_jobSeq);
+    job.wp = wp;
+    m_jobs.push_front(move(job));
+    if (m_jobs.size() > c_jobHistory)
+        m_jobs.pop_back();
+
+    // Serialize once for all rigs
+    Json::Value jNotify;
+    jNotify["id"] = Json::Value::null;
+    jNotify["method"] = "mining.notify";
+    jNotify["params"] = Json::Value(Json::arrayValue);
+    jNotify["params"].append(m_jobs.front().id);
+    jNotify["params"].append(wp.seed.hex());
+    jNotify["params"].append(wp.header.hex());
+    jNotify["params"].append(true);
+    m_notify = Json::writeString(m_jSwBuilder, jNotify) + "\n";
+    m_difficulty = getHashesToTarget("0x" + wp.boundary.hex()) / 4294967296.0;
+
+    vector<shared_ptr<StratumConnection>> sessions;
+    {
+        lock_guard<mutex> l(m_sessionsMutex);
+        sessions = m_sessions;
+    }
+    for (auto& session : sessions)
+        if (session->ready())
+            sendJob(*session);
+    m_jobsRelayed.fetch_add(1, memory_order_relaxed);
+}
+
+void StratumServer::sendJob(StratumConnection& _session)
+{
+    if (m_jobs.empty())
+        return;
+
+    string enonce = extranonce(_session.slot());
+    if (enonce != _session.m_extranonce)
+    {
+        Json::Value jMsg;
+        jMsg["id"] = Json::Value::null;
+        jMsg["method"] = "mining.set_extranonce";
+        jMsg["params"] = Json::Value(Json::arrayValue);
+        jMsg["params"].append(enonce);
+        _session.send(jMsg);
+        lock_guard<mutex> l(m_sessionsMutex);
+        _session.m_extranonce = enonce;
+    }
+    if (m_difficulty != _session.m_difficulty)
+    {
+        Json::Value jMsg;
+        jMsg["id"] = Json::Value::null;
+        jMsg["method"] = "mining.set_difficulty";
+        jMsg["params"] = Json::Value(Json::arrayValue);
+        jMsg["params"].append(m_difficulty);
+        _session.send(jMsg);
+        _session.m_difficulty = m_difficulty;
+    }
+    _session.send(m_notify);
+}
+
+bool StratumServer::submit(
+    StratumConnection& _session, string const& _job, string const& _nonce, Json::Value& _error)
+{
+    auto job =
+        find_if(m_jobs.begin(), m_jobs.end(), [&_job](const Job& j) { return j.id == _job; });
+    if (job == m_jobs.end())
+    {
+        _error = stratumError(21, "Job not found");
+        return false;
+    }
+
+    // Rig only sends the part of nonce following its extranonce
+    string nonceHex = _session.m_extranonce + _nonce;
+    if (nonceHex.size() != 16 ||
+        nonceHex.find_first_not_of("0123456789abcdefABCDEF") != string::npos)
+    {
+        _error = stratumError(20, "Invalid nonce");
+        return false;
+    }
+    uint64_t nonce = stoull(nonceHex, nullptr, 16);
+    if (!job->nonces.insert(nonce).second)
+    {
+        _error = stratumError(22, "Duplicate share");
+        return false;
+    }
+
+    const WorkPackage& wp = job->wp;
+    Result r = EthashAux::eval(wp.epoch, wp.header, nonce);
+    if (r.value > wp.boundary)
+    {
+        _error = stratumError(23, "Low difficulty share");
+        return false;
+    }
+
+    Solution sol{nonce, r.mixHash, wp, steady_clock::now(),
+        PoolManager::ExternalMinerBase + _session.slot()};
+    if (!PoolManager::p().submitSolution(sol))
+    {
+        _error = stratumError(20, "Not connected to pool");
+        return false;
+    }
+    m_submitted.fetch_add(1, memory_order_relaxed);
+    _session.m_hashes.store(_session.m_hashes.load() + m_difficulty * 4294967296.0);
+    return true;
+}
+
+void StratumServer::externalSolution(unsigned midx, bool accepted)
+{
+    unsigned slot = midx - PoolManager::ExternalMinerBase;
+    lock_guard<mutex> l(m_sessionsMutex);
+    for (auto& session : m_sessions)
+    {
+        if (session->slot() != slot)
+            continue;
+        if (accepted)
+            session->m_accepted++;
+        else
+            session->m_rejected++;
+        break;
+    }
+}
+
+Json::Value StratumServer::getStatsJson()
+{
+    Json::Value jRes;
+    jRes["jobs"] = m_jobsRelayed.load(memory_order_relaxed);
+    jRes["submitted"] = m_submitted.load(memory_order_relaxed);
+    jRes["rigs"] = Json::Value(Json::arrayValue);
+
+    lock_guard<mutex> l(m_sessionsMutex);
+    for (auto& session : m_sessions)
+        jRes["rigs"].append(session->getStatJson());
+    return jRes;
+}
+
+StratumConnection::StratumConnection(
+    StratumServer& _server, boost::asio::io_service::strand& _strand, int id, unsigned slot)
+  : m_server(_server), m_sessionId(id), m_slot(slot), m_socket(g_io_service), m_io_strand(_strand)
+{
+    m_jSwBuilder.settings_["indentation"] = "";
+}
+
+void StratumConnection::start()
+{
+    boost::system::error_code ec;
+    m_socket.set_option(tcp::no_delay(true), ec);
+    m_address = toString(m_socket.remote_endpoint(ec));
+    recvSocketData();
+}
+
+void StratumConnection::disconnect()
+{
+    if (m_socket.is_open())
+    {
+        boost::system::error_code ec;
+        m_socket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+        m_socket.close(ec);
+        m_server.sessionDisconnected(m_sessionId);
+    }
+}
+
+void StratumConnection::recvSocketData()
+{
+    boost::asio::async_read(m_socket, m_framer.prepare(), boost::asio::transfer_at_least(1),
+        m_io_strand.wrap(boost::bind(&StratumConnection::onRecvSocketDataCompleted,
+            shared_from_this(),
+            boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred)));
+}
+
+void StratumConnection::onRecvSocketDataCompleted(
+    const boost::system::error_code& ec, size_t bytes_transferred)
+{
+    if (ec || !bytes_transferred)
+    {
+        if (ec != boost::asio::error::operation_aborted)
+            disconnect();
+        return;
+    }
+
+    m_framer.commit(bytes_transferred);
+    string_view line;
+    while (m_framer.next(line))
+    {
+        if (line.empty())
+            continue;
+
+        Json::Value jMsg;
+        Json::Reader jRdr;
+        if (!jRdr.parse(line.data(), line.data() + line.size(), jMsg) || !jMsg.isObject())
+        {
+            cwarn << "Stratum proxy : invalid message from " << m_address;
+            disconnect();
+            return;
+        }
+
+        Json::Value jRes;
+        jRes["id"] = jMsg.get("id", Json::Value::null);
+        jRes["result"] = Json::Value::null;
+        jRes["error"] = Json::Value::null;
+        processRequest(jMsg, jRes);
+        send(jRes);
+
+        // Rig gets current job as soon as it's ready
+        if (jMsg.get("method", "").asString() == "mining.authorize" && ready())
+            m_server.sendJob(*this);
+    }
+
+    if (m_socket.is_open())
+        recvSocketData();
+}
+
+void StratumConnection::processRequest(Json::Value& jRequest, Json::Value& jResponse)
+{
+    string _method = jRequest.get("method", "").asString();
+    Json::Value jPrm = jRequest.get("params", Json::Value(Json::arrayValue));
+
+    if (_method == "mining.subscribe")
+    {
+        // [["mining.notify", session, protocol], extranonce]
+        m_subscribed = true;
+        {
+            lock_guard<mutex> l(m_server.m_sessionsMutex);
+            m_extranonce = m_server.extranonce(m_slot);
+        }
+        Json::Value jNotify(Json::arrayValue);
+        jNotify.append("mining.notify");
+        jNotify.append(toHex(uint32_t(m_sessionId)));
+        jNotify.append("EthereumStratum/1.0.0");
+        jResponse["result"] = Json::Value(Json::arrayValue);
+        jResponse["result"].append(jNotify);
+        jResponse["result"].append(m_extranonce);
+    }
+    else if (_method == "mining.extranonce.subscribe")
+    {
+        // Extranonce changes are always notified
+        jResponse["result"] = true;
+    }
+    else if (_method == "mining.authorize")
+    {
+        // Rigs mine on the account of pool connection. Worker
+        // name only identifies them
+        {
+            lock_guard<mutex> l(m_server.m_sessionsMutex);
+            m_worker = jPrm.get(Json::Value::ArrayIndex(0), "").asString();
+        }
+        m_authorized = true;
+        jResponse["result"] = true;
+        cnote << "Proxy session " << m_worker << " " << m_address << " authorized";
+    }
+    else if (_method == "mining.submit")
+    {
+        if (!ready())
+        {
+            jResponse["result"] = false;
+            jResponse["error"] = stratumError(24, "Unauthorized worker");
+            return;
+        }
+
+        // [worker, job, nonce]
+        string job = jPrm.get(Json::Value::ArrayIndex(1), "").asString();
+        string nonce = jPrm.get(Json::Value::ArrayIndex(2), "").asString();
+        if (nonce.compare(0, 2, "0x") == 0)
+            nonce.erase(0, 2);
+        Json::Value jErr;
+        bool valid = m_server.submit(*this, job, nonce, jErr);
+        jResponse["result"] = valid;
+        if (valid)
+            m_shares++;
+        else
+        {
+            m_invalid++;
+            jResponse["error"] = jErr;
+        }
+    }
+    else if (_method == "mining.submitHashrate" || _method == "eth_submitHashrate")
+    {
+        jResponse["result"] = true;
+    }
+    else
+    {
+        jResponse["error"] = stratumError(20, "Method not found");
+    }
+}
+
+void StratumConnection::send(Json::Value const& _msg)
+{
+    send(Json::writeString(m_jSwBuilder, _msg) + "\n");
+}
+
+void StratumConnection::send(string const& _line)
+{
+    if (!m_socket.is_open())
+        return;
+    m_outbox.append(_line);
+    if (!m_writing)
+        flush();
+}
+
+void StratumConnection::flush()
+{
+    // Whatever got queued meanwhile goes in a single write
+    m_sending.clear();
+    m_sending.swap(m_outbox);
+    m_writing = true;
+    boost::asio::async_write(m_socket, boost::asio::buffer(m_sending),
+        m_io_strand.wrap(boost::bind(&StratumConnection::onSendSocketDataCompleted,
+            shared_from_this(), boost::asio::placeholders::error)));
+}
+
+void StratumConnection::onSendSocketDataCompleted(const boost::system::error_code& ec)
+{
+    m_writing = false;
+    if (ec)
+    {
+        if (ec != boost::asio::error::operation_aborted)
+            disconnect();
+        return;
+    }
+    if (!m_outbox.empty())
+        flush();
+}
+
+Json::Value StratumConnection::getStatJson()
+{
+    double elapsed = duration_cast<seconds>(steady_clock::now() - m_start).count();
+
+    Json::Value jRes;
+    jRes["id"] = m_sessionId;
+    jRes["address"] = m_address;
+    jRes["worker"] = m_worker;
+    jRes["extranonce"] = m_extranonce;
+    jRes["hashrate"] = (elapsed > 0 ? m_hashes.load() / elapsed : 0.0);
+    jRes["shares"]["valid"] = m_shares.load();
+    jRes["shares"]["invalid"] = m_invalid.load();
+    jRes["shares"]["accepted"] = m_accepted.load();
+    jRes["shares"]["rejected"] = m_rejected.load();
+    return jRes;
+}
@@ -0,0 +1,157 @@
+
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <unordered_set>
+
+#include <boost/asio.hpp>
+#include <boost/bind/bind.hpp>
+
+#include <json/json.h>
+
+#include <libdevcore/LineFramer.h>
+#include <libethcore/EthashAux.h>
+#include <libpoolprotocols/PoolManager.h>
+
+#include "ApiServer.h"
+
+using namespace dev;
+using namespace dev::eth;
+using namespace std::chrono;
+
+using boost::asio::ip::tcp;
+
+class StratumServer;
+
+/**
+ * @brief A rig connected to the proxy.
+ * Speaks EthereumStratum/1.0.0 and searches its own slice of nonces,
+ * the one starting with the extranonce it's been given.
+ */
+class StratumConnection : public std::enable_shared_from_this<StratumConnection>
+{
+public:
+    StratumConnection(
+        StratumServer& _server, boost::asio::io_service::strand& _strand, int id, unsigned slot);
+
+    ~StratumConnection() = default;
+
+    void start();
+    void disconnect();
+
+    // Queues a line (terminated by new line) for sending
+    void send(std::string const& _line);
+    void send(Json::Value const& _msg);
+
+    int getId() { return m_sessionId; }
+    unsigned slot() { return m_slot; }
+    bool ready() { return m_subscribed && m_authorized; }
+    tcp::socket& socket() { return m_socket; }
+
+    Json::Value getStatJson();
+
+private:
+    friend class StratumServer;
+
+    void processRequest(Json::Value& jRequest, Json::Value& jResponse);
+    void recvSocketData();
+    void onRecvSocketDataCompleted(
+        const boost::system::error_code& ec, std::size_t bytes_transferred);
+    void flush();
+    void onSendSocketDataCompleted(const boost::system::error_code& ec);
+
+    StratumServer& m_server;
+    int m_sessionId;
+    unsigned m_slot;  // Distinguishes rig's nonces from others'
+
+    tcp::socket m_socket;
+    std::string m_address;
+    boost::asio::io_service::strand& m_io_strand;
+    std::string m_outbox;   // Lines queued while a write is in progress
+    std::string m_sending;  // Lines being written
+    bool m_writing = false;
+    Json::StreamWriterBuilder m_jSwBuilder;
+
+    LineFramer m_framer;  // Splits received data in lines
+
+    bool m_subscribed = false;
+    bool m_authorized = false;
+    std::string m_worker;
+    std::string m_extranonce;  // As last sent to rig
+    double m_difficulty = 0;   // As last sent to rig
+
+    steady_clock::time_point m_start = steady_clock::now();
+    std::atomic<unsigned> m_shares = {0};    // Valid shares
+    std::atomic<unsigned> m_invalid = {0};   // Stale, duplicate or low difficulty
+    std::atomic<unsigned> m_accepted = {0};  // By pool
+    std::atomic<unsigned> m_rejected = {0};  // By pool
+    std::atomic<double> m_hashes = {0};      // Work done by shares found
+};
+
+/**
+ * @brief Serves the work of the pool connection to other rigs.
+ * Lets a farm share a single pool connection : jobs received from pool
+ * are relayed to every connected rig, each given a distinct extranonce,
+ * and shares are verified before being submitted on behalf of the rig.
+ * Accepts connections the same way ApiServer does.
+ */
+class StratumServer
+{
+public:
+    StratumServer(string address, int portnum);
+    ~StratumServer();
+
+    static StratumServer* s() { return m_this; }
+
+    bool isRunning() { return m_running.load(std::memory_order_relaxed); };
+    void start();
+    void stop();
+
+    Json::Value getStatsJson();
+
+private:
+    friend class StratumConnection;
+
+    // A job sent to rigs
+    struct Job
+    {
+        std::string id;
+        WorkPackage wp;
+        std::unordered_set<uint64_t> nonces;  // Submitted so far
+    };
+
+    void begin_accept();
+    void handle_accept(std::shared_ptr<StratumConnection> session, boost::system::error_code ec);
+    void sessionDisconnected(int id);
+
+    void setWork(WorkPackage const& wp);
+    void externalSolution(unsigned midx, bool accepted);
+    std::string extranonce(unsigned slot);
+    void sendJob(StratumConnection& _session);
+    bool submit(StratumConnection& _session, std::string const& _job, std::string const& _nonce,
+        Json::Value& _error);
+
+    int lastSessionId = 0;
+
+    std::atomic<bool> m_running = {false};
+    string m_address;
+    uint16_t m_portnumber;
+    tcp::acceptor m_acceptor;
+    boost::asio::io_service::strand m_io_strand;
+
+    std::mutex m_sessionsMutex;
+    std::vector<std::shared_ptr<StratumConnection>> m_sessions;
+    std::vector<bool> m_slots;  // In use
+
+    Json::StreamWriterBuilder m_jSwBuilder;
+    std::deque<Job> m_jobs;  // Latest first
+    unsigned m_jobSeq = 0;
+    std::string m_notify;     // Notification of latest job, serialized
+    double m_difficulty = 0;  // Of latest job
+
+    std::atomic<unsigned> m_jobsRelayed = {0};
+    std::atomic<unsigned> m_submitted = {0};  // Shares sent to pool
+
+    static StratumServer* m_this;
+};
@@ -0,0 +1,38 @@
+
+#include <cstdlib>
+#include <new>
+
+#include "Allocations.h"
+
+#ifdef ALLOC_STATS
+
+// Global operator new is replaced to keep count of allocations
+// per thread. Other forms of new end up here, as do the deletes
+// matching them
+
+static thread_local uint64_t t_allocations = 0;
+
+void* operator new(std::size_t _size)
+{
+    t_allocations++;
+    if (void* p = std::malloc(_size ? _size : 1))
+        return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* _p) noexcept
+{
+    std::free(_p);
+}
+
+void operator delete(void* _p, std::size_t) noexcept
+{
+    std::free(_p);
+}
+
+uint64_t dev::threadAllocations()
+{
+    return t_allocations;
+}
+
+#endif
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <cstdint>
+
+namespace dev
+{
+/// Number of heap allocations made so far by the calling thread.
+/// Sampled before and after a piece of code it tells how many
+/// allocations that code made. Counting takes global operator new
+/// to be replaced, so it's only done in builds with ALLOCSTATS on.
+#ifdef ALLOC_STATS
+uint64_t threadAllocations();
+#else
+inline uint64_t threadAllocations()
+{
+    return 0;
+}
+#endif
+
+}  // namespace dev
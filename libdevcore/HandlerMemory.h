@@ -0,0 +1,133 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include <boost/asio/handler_alloc_hook.hpp>
+
+namespace dev
+{
+/// Storage for the handler of one asynchronous operation at a time.
+/// Asio allocates an operation object for each async call and releases
+/// it just before invoking the handler, so an operation which is
+/// reissued from its own handler (eg. a read loop) keeps reusing the
+/// same block instead of going to the heap. Requests which don't fit,
+/// or come while the block is in use, fall back to the heap.
+/// Allocation and release may happen outside of the strand the
+/// operations run in (eg. io_service run by several threads), thus
+/// the block is claimed atomically.
+class HandlerMemory
+{
+public:
+    HandlerMemory() = default;
+    HandlerMemory(HandlerMemory const&) = delete;
+    HandlerMemory& operator=(HandlerMemory const&) = delete;
+
+    void* allocate(std::size_t _size)
+    {
+        bool ex = false;
+        if (_size <= sizeof(m_storage) &&
+            m_inUse.compare_exchange_strong(ex, true, std::memory_order_acquire))
+            return &m_storage;
+        m_fallbacks.fetch_add(1, std::memory_order_relaxed);
+        return ::operator new(_size);
+    }
+
+    void deallocate(void* _p)
+    {
+        if (_p == &m_storage)
+            m_inUse.store(false, std::memory_order_release);
+        else
+            ::operator delete(_p);
+    }
+
+    /// Number of allocations which had to go to the heap
+    unsigned fallbacks() const { return m_fallbacks.load(std::memory_order_relaxed); }
+
+private:
+    typename std::aligned_storage<1024>::type m_storage;
+    std::atomic<bool> m_inUse = {false};
+    std::atomic<unsigned> m_fallbacks = {0};
+};
+
+/// Allocator handing out HandlerMemory's block
+template <typename T>
+class HandlerAllocator
+{
+public:
+    using value_type = T;
+
+    explicit HandlerAllocator(HandlerMemory& _memory) : m_memory(_memory) {}
+
+    template <typename U>
+    HandlerAllocator(HandlerAllocator<U> const& _other) noexcept : m_memory(_other.m_memory)
+    {}
+
+    T* allocate(std::size_t _n) { return static_cast<T*>(m_memory.allocate(sizeof(T) * _n)); }
+    void deallocate(T* _p, std::size_t) { m_memory.deallocate(_p); }
+
+    bool operator==(HandlerAllocator const& _other) const noexcept
+    {
+        return &m_memory == &_other.m_memory;
+    }
+    bool operator!=(HandlerAllocator const& _other) const noexcept
+    {
+        return &m_memory != &_other.m_memory;
+    }
+
+private:
+    template <typename>
+    friend class HandlerAllocator;
+
+    HandlerMemory& m_memory;
+};
+
+/// Wraps a completion handler so the memory of its operation comes from
+/// given HandlerMemory. Goes inside the strand, if any, which forwards
+/// allocations to the handler it wraps :
+///     m_io_strand.wrap(makeAllocHandler(m_readMemory, boost::bind(...)))
+template <typename Handler>
+class AllocHandler
+{
+public:
+    using allocator_type = HandlerAllocator<Handler>;
+
+    AllocHandler(HandlerMemory& _memory, Handler _handler)
+      : m_memory(_memory), m_handler(std::move(_handler))
+    {}
+
+    allocator_type get_allocator() const noexcept { return allocator_type(m_memory); }
+
+    template <typename... Args>
+    void operator()(Args&&... _args)
+    {
+        m_handler(std::forward<Args>(_args)...);
+    }
+
+    friend void* asio_handler_allocate(std::size_t _size, AllocHandler* _this)
+    {
+        return _this->m_memory.allocate(_size);
+    }
+
+    friend void asio_handler_deallocate(void* _p, std::size_t, AllocHandler* _this)
+    {
+        _this->m_memory.deallocate(_p);
+    }
+
+private:
+    HandlerMemory& m_memory;
+    Handler m_handler;
+};
+
+template <typename Handler>
+inline AllocHandler<typename std::decay<Handler>::type> makeAllocHandler(
+    HandlerMemory& _memory, Handler&& _handler)
+{
+    return AllocHandler<typename std::decay<Handler>::type>(
+        _memory, std::forward<Handler>(_handler));
+}
+
+}  // namespace dev
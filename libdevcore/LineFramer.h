@@ -0,0 +1,126 @@
+
+#pragma once
+
+#include <cctype>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include <boost/asio/buffer.hpp>
+
+namespace dev
+{
+/// Splits a stream of bytes into newline delimited lines.
+/// Sockets read straight into the framer's storage (see prepare/commit)
+/// and complete lines are handed out as views on that same storage, so
+/// no line is ever copied. Views stay valid until next prepare() call.
+/// Read and write positions advance over a fixed region; only the
+/// incomplete tail (if any) is moved back to the front when the region
+/// runs out of room, which happens at most once per read.
+class LineFramer
+{
+public:
+    LineFramer(size_t _capacity = 16384, size_t _maxCapacity = 1048576)
+      : m_data(_capacity), m_maxCapacity(_maxCapacity)
+    {}
+
+    /// Returns the writable region for next socket read
+    boost::asio::mutable_buffers_1 prepare(size_t _minFree = 4096)
+    {
+        if (m_data.size() - m_end < _minFree)
+        {
+            // Move incomplete tail to the front
+            size_t pending = m_end - m_begin;
+            if (pending && m_begin)
+                std::memmove(m_data.data(), m_data.data() + m_begin, pending);
+            m_scan -= m_begin;
+            m_begin = 0;
+            m_end = pending;
+
+            // A single line longer than buffer : grow up to limit
+            // then drop it altogether
+            if (m_data.size() - m_end < _minFree)
+            {
+                if (m_data.size() * 2 <= m_maxCapacity)
+                    m_data.resize(m_data.size() * 2);
+                else
+                {
+                    // Remainder of the line will be skipped too.
+                    // Counted once however many reads it spans
+                    if (!m_discard)
+                        m_overflows++;
+                    clear();
+                    m_discard = true;
+                }
+            }
+        }
+        return boost::asio::buffer(m_data.data() + m_end, m_data.size() - m_end);
+    }
+
+    /// Makes _size bytes written in the prepared region available
+    void commit(size_t _size) { m_end += _size; }
+
+    /// Extracts next complete line (without delimiter and surrounding
+    /// whitespace) if any
+    bool next(std::string_view& _line)
+    {
+        const char* base = m_data.data();
+        const void* nl = std::memchr(base + m_scan, '\n', m_end - m_scan);
+        if (!nl)
+        {
+            // Bytes of an oversized line are dropped as they come
+            if (m_discard)
+                m_begin = m_scan = m_end = 0;
+            else
+                m_scan = m_end;
+            return false;
+        }
+
+        size_t lineEnd = static_cast<const char*>(nl) - base;
+        if (m_discard)
+        {
+            m_discard = false;
+            m_begin = m_scan = lineEnd + 1;
+            return next(_line);
+        }
+
+        size_t b = m_begin, e = lineEnd;
+        while (b < e && isspace(static_cast<unsigned char>(base[b])))
+            b++;
+        while (e > b && isspace(static_cast<unsigned char>(base[e - 1])))
+            e--;
+        _line = std::string_view(base + b, e - b);
+
+        m_begin = m_scan = lineEnd + 1;
+        if (m_begin == m_end)
+            m_begin = m_scan = m_end = 0;
+        return true;
+    }
+
+    /// Data received but not yet extracted as lines
+    std::string_view pending() const
+    {
+        return std::string_view(m_data.data() + m_begin, m_end - m_begin);
+    }
+
+    /// Discards any buffered data
+    void clear()
+    {
+        m_begin = m_scan = m_end = 0;
+        m_discard = false;
+    }
+
+    /// Number of lines dropped because exceeding max capacity
+    unsigned overflows() const { return m_overflows; }
+
+private:
+    std::vector<char> m_data;
+    size_t m_maxCapacity;
+    size_t m_begin = 0;  // Start of first unextracted line
+    size_t m_scan = 0;   // Where to resume search for delimiter
+    size_t m_end = 0;    // End of received data
+    unsigned m_overflows = 0;
+    bool m_discard = false;  // Skipping the rest of an oversized line
+};
+
+}  // namespace dev
@@ -0,0 +1,227 @@
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+#include "Log.h"
+#include "ThreadPolicy.h"
+
+using namespace std;
+using namespace dev;
+
+ThreadRoleSettings ThreadPolicy::s_roles[unsigned(ThreadRole::Count)];
+vector<unsigned> ThreadPolicy::s_reserved;
+
+static const char* c_roleNames[] = {"io", "gpu", "cpu", "telemetry"};
+
+// Highest core number a thread can be bound to
+static const unsigned c_maxCpu = 1023;
+
+// Formats a list of cores as ranges (eg. 0-3,6)
+static string cpuList(vector<unsigned> const& _cpus)
+{
+    stringstream ss;
+    for (size_t i = 0; i < _cpus.size(); i++)
+    {
+        size_t j = i;
+        while (j + 1 < _cpus.size() && _cpus[j + 1] == _cpus[j] + 1)
+            j++;
+        ss << (i ? "," : "") << _cpus[i];
+        if (j > i)
+            ss << "-" << _cpus[j];
+        i = j;
+    }
+    return ss.str();
+}
+
+static int parseInt(string const& _key, string const& _value, int _min, int _max)
+{
+    size_t pos = 0;
+    int value;
+    try
+    {
+        value = stoi(_value, &pos);
+    }
+    catch (const exception&)
+    {
+        pos = 0;
+    }
+    if (!pos || pos != _value.size() || value < _min || value > _max)
+        throw invalid_argument("Invalid " + _key + " value " + _value + ". Allowed range is [" +
+                               to_string(_min) + " .. " + to_string(_max) + "]");
+    return value;
+}
+
+vector<unsigned> ThreadPolicy::parseCpus(string const& _list)
+{
+    vector<unsigned> cpus;
+    stringstream ss(_list);
+    string item;
+    while (getline(ss, item, ','))
+    {
+        size_t dash = item.find('-');
+        int first = parseInt("cpu", item.substr(0, dash), 0, c_maxCpu);
+        int last = (dash == string::npos ? first :
+                                           parseInt("cpu", item.substr(dash + 1), first, c_maxCpu));
+        for (int cpu = first; cpu <= last; cpu++)
+            cpus.push_back(unsigned(cpu));
+    }
+    if (cpus.empty())
+        throw invalid_argument("Empty cpu list");
+
+    sort(cpus.begin(), cpus.end());
+    cpus.erase(unique(cpus.begin(), cpus.end()), cpus.end());
+    return cpus;
+}
+
+void ThreadPolicy::parse(string const& _spec)
+{
+    stringstream ss(_spec);
+    string role, item;
+    getline(ss, role, ':');
+    auto it = find(begin(c_roleNames), end(c_roleNames), role);
+    if (it == end(c_roleNames))
+        throw invalid_argument("Unknown thread role " + role);
+
+    ThreadRoleSettings settings;
+    while (getline(ss, item, ':'))
+    {
+        size_t eq = item.find('=');
+        string key = item.substr(0, eq);
+        string value = (eq == string::npos ? "" : item.substr(eq + 1));
+        if (key == "fifo")
+            settings.fifo = unsigned(parseInt(key, value, 1, 99));
+        else if (key == "nice")
+            settings.nice = parseInt(key, value, -20, 19);
+        else if (key == "cpus")
+            settings.cpus = parseCpus(value);
+        else
+            throw invalid_argument("Unknown thread setting " + key);
+    }
+    s_roles[it - begin(c_roleNames)] = settings;
+}
+
+void ThreadPolicy::apply(ThreadRole _role, int _cpu)
+{
+    ThreadRoleSettings const& settings = s_roles[unsigned(_role)];
+    bool configured = settings.fifo || settings.nice || !settings.cpus.empty() ||
+                      !s_reserved.empty();
+
+    // Cores the role may run on
+    vector<unsigned> allowed = settings.cpus;
+    if (allowed.empty() && !s_reserved.empty())
+        for (unsigned cpu = 0; cpu < thread::hardware_concurrency(); cpu++)
+            if (find(s_reserved.begin(), s_reserved.end(), cpu) == s_reserved.end())
+                allowed.push_back(cpu);
+
+    vector<unsigned> cpus = allowed;
+    if (_cpu >= 0)
+    {
+        auto it = find(allowed.begin(), allowed.end(), unsigned(_cpu));
+        if (allowed.empty() || it != allowed.end())
+            cpus = {unsigned(_cpu)};
+        else
+            cpus = {allowed[unsigned(_cpu) % allowed.size()]};
+    }
+
+    if (!configured && cpus.empty())
+        return;
+
+    string name = getThreadName() + " (" + c_roleNames[unsigned(_role)] + ")";
+    stringstream failed;   // What could not be set
+    stringstream granted;  // What OS eventually applied
+
+#if defined(__linux__)
+    pid_t tid = pid_t(syscall(SYS_gettid));
+    int err;
+
+    if (!cpus.empty())
+    {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        for (unsigned cpu : cpus)
+            CPU_SET(cpu, &cpuset);
+        err = pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+        if (err)
+            failed << " cpus " << cpuList(cpus) << " (" << strerror(err) << ")";
+    }
+
+    if (settings.fifo)
+    {
+        sched_param param = {};
+        param.sched_priority = int(settings.fifo);
+        err = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (err)
+            failed << " SCHED_FIFO " << settings.fifo << " (" << strerror(err) << ")";
+    }
+    else if (settings.nice && setpriority(PRIO_PROCESS, id_t(tid), settings.nice))
+    {
+        failed << " nice " << settings.nice << " (" << strerror(errno) << ")";
+    }
+
+    int policy;
+    sched_param param = {};
+    pthread_getschedparam(pthread_self(), &policy, &param);
+    if (policy == SCHED_FIFO)
+        granted << "SCHED_FIFO " << param.sched_priority;
+    else
+        granted << "nice " << getpriority(PRIO_PROCESS, id_t(tid));
+
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    vector<unsigned> bound;
+    if (!pthread_getaffinity_np(pthread_self(), sizeof(cpuset), &cpuset))
+        for (unsigned cpu = 0; cpu <= c_maxCpu; cpu++)
+            if (CPU_ISSET(cpu, &cpuset))
+                bound.push_back(cpu);
+    granted << ", cpus " << cpuList(bound);
+#elif defined(_WIN32)
+    if (!cpus.empty())
+    {
+        DWORD_PTR mask = 0;
+        for (unsigned cpu : cpus)
+            if (cpu < sizeof(DWORD_PTR) * 8)
+                mask |= DWORD_PTR(1) << cpu;
+        if (!mask || !SetThreadAffinityMask(GetCurrentThread(), mask))
+            failed << " cpus " << cpuList(cpus);
+    }
+
+    // Windows has no nice levels : map them to relative priorities
+    int priority = THREAD_PRIORITY_NORMAL;
+    if (settings.fifo)
+        priority = THREAD_PRIORITY_TIME_CRITICAL;
+    else if (settings.nice)
+        priority = settings.nice < -10 ? THREAD_PRIORITY_HIGHEST :
+                   settings.nice < 0   ? THREAD_PRIORITY_ABOVE_NORMAL :
+                   settings.nice > 10  ? THREAD_PRIORITY_LOWEST :
+                                         THREAD_PRIORITY_BELOW_NORMAL;
+    if (priority != THREAD_PRIORITY_NORMAL && !SetThreadPriority(GetCurrentThread(), priority))
+        failed << " priority " << priority;
+
+    granted << "priority " << GetThreadPriority(GetCurrentThread());
+    if (!cpus.empty() && failed.str().find("cpus") == string::npos)
+        granted << ", cpus " << cpuList(cpus);
+#else
+    if (configured)
+        cwarn << "Thread " << name << " : scheduling policies not supported on this platform";
+    return;
+#endif
+
+    if (!failed.str().empty())
+        cwarn << "Thread " << name << " could not get" << failed.str() << ". Running with "
+              << granted.str();
+    else if (configured)
+        cnote << "Thread " << name << " running with " << granted.str();
+}
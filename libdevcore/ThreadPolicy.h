@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+namespace dev
+{
+// What a thread is for. Each role gets a scheduling policy of its own
+enum class ThreadRole
+{
+    Io,         // Pool and farm io_service
+    GpuFeeder,  // Host thread of a GPU miner
+    CpuMiner,   // CPU miner
+    Telemetry,  // Hardware monitoring and API server
+    Count
+};
+
+struct ThreadRoleSettings
+{
+    unsigned fifo = 0;           // SCHED_FIFO priority (1-99). 0 keeps normal scheduling
+    int nice = 0;                // Nice level (-20..19) under normal scheduling
+    std::vector<unsigned> cpus;  // Cores allowed. Empty means any not reserved
+};
+
+/**
+ * @brief Scheduling priority and cpu affinity by thread role.
+ * Configured once at startup, then each thread applies the settings of its
+ * role to itself. Reserved cores are left to roles which name them, so eg.
+ * CPU miners can be kept off the cores of io and GPU feeder threads.
+ */
+class ThreadPolicy
+{
+public:
+    // Parses a role specification in the form role:key=value[:key=value...]
+    // Role is one of io, gpu, cpu, telemetry; keys are fifo, nice and cpus.
+    // Throws invalid_argument on errors
+    static void parse(std::string const& _spec);
+
+    // Parses a list of cores in the form 0,2,4-7
+    static std::vector<unsigned> parseCpus(std::string const& _list);
+
+    static void reserve(std::vector<unsigned> const& _cpus) { s_reserved = _cpus; }
+
+    // Applies role's settings to calling thread and logs what was granted.
+    // _cpu, when given, is the core the thread would like to run on
+    // (eg. one per CPU miner); it's honored if allowed for the role
+    static void apply(ThreadRole _role, int _cpu = -1);
+
+private:
+    static ThreadRoleSettings s_roles[unsigned(ThreadRole::Count)];
+    static std::vector<unsigned> s_reserved;
+};
+
+}  // namespace dev
@@ -1,6 +1,7 @@
 
 #include <boost/dll.hpp>
 
+#include <libdevcore/ThreadPolicy.h>
 #include <libethcore/Farm.h>
 #include <ethash/ethash.hpp>
 
@@ -279,6 +280,11 @@ void CLMiner::workLoop()
     WorkPackage current;
     current.header = h256();
 
+    // When the kernel was last enqueued (for duty cycle throttling)
+    chrono::steady_clock::time_point batchStart = chrono::steady_clock::now();
+
+    ThreadPolicy::apply(ThreadRole::GpuFeeder);
+
     if (!initDevice())
         return;
 
@@ -311,6 +317,10 @@ void CLMiner::workLoop()
             else
                 results.count = 0;
 
+            // Previous kernel has completed: let the device rest
+            // if thermal control lowered our duty cycle
+            throttle(batchStart);
+
             // Wait for work or 3 seconds (whichever the first)
             WorkPackage w = work();
             if (!w)
@@ -318,6 +328,7 @@ void CLMiner::workLoop()
                 m_hung_miner.store(false);
                 unique_lock<mutex> l(miner_work_mutex);
                 m_new_work_signal.wait_for(l, chrono::seconds(3));
+                batchStart = chrono::steady_clock::now();
                 continue;
             }
 
@@ -360,6 +371,8 @@ void CLMiner::workLoop()
 #endif
             }
 
+            // Hashrate is measured over wall time hence, when throttled,
+            // batches shrink along with the duty cycle
             float hr = RetrieveHashRate();
             if (hr > 1e7)
                 m_block_multiple =
@@ -368,6 +381,7 @@ void CLMiner::workLoop()
             // Run the kernel.
             m_searchKernel.setArg(5, startNonce);
             m_hung_miner.store(false);
+            batchStart = chrono::steady_clock::now();
             m_queue->enqueueNDRangeKernel(m_searchKernel, cl::NullRange,
                 m_deviceDescriptor.clGroupSize * m_block_multiple, m_deviceDescriptor.clGroupSize);
 
@@ -8,6 +8,7 @@
 #include <unistd.h>
 #endif
 
+#include <libdevcore/ThreadPolicy.h>
 #include <libethcore/Farm.h>
 #include <ethash/ethash.hpp>
 
@@ -100,6 +101,9 @@ unsigned CPUMiner::getNumDevices()
 CPUMiner::CPUMiner(unsigned _index, DeviceDescriptor& _device) : Miner("cpu-", _index)
 {
     m_deviceDescriptor = _device;
+    m_hwmoninfo.deviceType = HwMonitorInfoType::CPU;
+    m_hwmoninfo.devicePciId = m_deviceDescriptor.uniqueId;
+    m_hwmoninfo.deviceIndex = -1;  // Will be later on mapped to the cpu number by Farm
 }
 
 
@@ -118,32 +122,8 @@ bool CPUMiner::initDevice()
     cnote << "Using CPU: " << m_deviceDescriptor.cpCpuNumer << " " << m_deviceDescriptor.name
           << " Memory : " << dev::getFormattedMemory((double)m_deviceDescriptor.totalMemory);
 
-#if defined(__linux__)
-    cpu_set_t cpuset;
-    int err;
-
-    CPU_ZERO(&cpuset);
-    CPU_SET(m_deviceDescriptor.cpCpuNumer, &cpuset);
-
-    err = sched_setaffinity(0, sizeof(cpuset), &cpuset);
-    if (err != 0)
-    {
-        cwarn << "Error in func " << __FUNCTION__ << " at sched_setaffinity() \"" << strerror(errno)
-              << "\"\n";
-        cwarn << "cp-" << m_index << "could not bind thread to cpu" << m_deviceDescriptor.cpCpuNumer
-              << "\n";
-    }
-#else
-    DWORD_PTR dwThreadAffinityMask = 1i64 << m_deviceDescriptor.cpCpuNumer;
-    DWORD_PTR previous_mask;
-    previous_mask = SetThreadAffinityMask(GetCurrentThread(), dwThreadAffinityMask);
-    if (previous_mask == NULL)
-    {
-        cwarn << "cp-" << m_index << "could not bind thread to cpu" << m_deviceDescriptor.cpCpuNumer
-              << "\n";
-        // Handle Errorcode (GetLastError) ??
-    }
-#endif
+    // Bound to its own core unless thread policy says otherwise
+    ThreadPolicy::apply(ThreadRole::CpuMiner, int(m_deviceDescriptor.cpCpuNumer));
     return true;
 }
 
@@ -155,9 +135,10 @@ bool CPUMiner::initDevice()
  * to check again dag sizes. They're changed for sure
  * We've all related infos in m_epochContext (.dagSize, .dagNumItems, .lightSize, .lightNumItems)
  */
-void CPUMiner::initEpoch()
+bool CPUMiner::initEpoch()
 {
     m_initialized = true;
+    return true;
 }
 
 
@@ -195,11 +176,11 @@ void CPUMiner::search(const dev::eth::WorkPackage& w)
         if (shouldStop())
             break;
 
-
+        auto batchStart = chrono::steady_clock::now();
         auto r = ethash::search(context, header, boundary, nonce, blocksize);
         if (r.solution_found)
         {
-            h256 mix{reinterpret_cast<byte*>(r.mix_hash.bytes), h256::ConstructFromPointer};
+            h256 mix{reinterpret_cast<::byte*>(r.mix_hash.bytes), h256::ConstructFromPointer};
             auto sol = Solution{r.nonce, mix, w, chrono::steady_clock::now(), m_index};
 
             cnote << EthWhite << "Job: " << w.header.abridged()
@@ -210,6 +191,8 @@ void CPUMiner::search(const dev::eth::WorkPackage& w)
 
         // Update the hash rate
         updateHashRate(blocksize, 1);
+
+        throttle(batchStart);
     }
 }
 
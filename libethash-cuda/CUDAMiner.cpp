@@ -1,4 +1,5 @@
 
+#include <libdevcore/ThreadPolicy.h>
 #include <libethcore/Farm.h>
 #include <ethash/ethash.hpp>
 
@@ -136,6 +137,8 @@ void CUDAMiner::workLoop()
     WorkPackage current;
     current.header = h256();
 
+    ThreadPolicy::apply(ThreadRole::GpuFeeder);
+
     if (!initDevice())
         return;
 
@@ -171,7 +174,8 @@ void CUDAMiner::workLoop()
 
             uint64_t upper64OfBoundary = (uint64_t)(u64)((u256)current.boundary >> 192);
 
-            // adjust work multiplier
+            // adjust work multiplier. Hashrate is measured over wall time
+            // hence, when throttled, batches shrink along with the duty cycle
             float hr = RetrieveHashRate();
             if (hr >= 1e7)
                 m_block_multiple =
@@ -312,6 +316,8 @@ void CUDAMiner::search(
         if (!m_done)
             m_done = paused();
 
+        auto batchStart = chrono::steady_clock::now();
+
         uint32_t batchCount(0);
 
         // This inner loop will process each cuda stream individually
@@ -365,6 +371,14 @@ void CUDAMiner::search(
                 m_done = true;
         }
         updateHashRate(m_deviceDescriptor.cuBlockSize, batchCount);
+
+        // If thermal control lowered our duty cycle wait for all
+        // streams to drain and let the device rest
+        if (!m_done && dutyCycle() < 1.0f)
+        {
+            CUDA_CALL(cudaDeviceSynchronize());
+            throttle(batchStart);
+        }
     }
 
 #ifdef DEV_BUILD
@@ -32,98 +32,17 @@ Farm::Farm(map<string, DeviceDescriptor>& _DevicesCollection, FarmSettings _sett
     {
         m_telemetry.hwmon = true;
 
-#if defined(__linux)
-        bool need_sysfsh = false;
-#else
-        bool need_adlh = false;
-#endif
-        bool need_nvmlh = false;
-
-        // Scan devices collection to identify which hw monitors to initialize
-        for (auto it = m_DevicesCollection.begin(); it != m_DevicesCollection.end(); it++)
-        {
-            if (it->second.subscriptionType == DeviceSubscriptionTypeEnum::Cuda)
-            {
-                need_nvmlh = true;
-                continue;
-            }
-            if (it->second.subscriptionType == DeviceSubscriptionTypeEnum::OpenCL)
-            {
-                if (it->second.clPlatformType == ClPlatformTypeEnum::Nvidia)
-                {
-                    need_nvmlh = true;
-                    continue;
-                }
-                if (it->second.clPlatformType == ClPlatformTypeEnum::Amd)
-                {
-#if defined(__linux)
-                    need_sysfsh = true;
-#else
-                    need_adlh = true;
-#endif
-                    continue;
-                }
-            }
-        }
-
-#if defined(__linux)
-        if (need_sysfsh)
-            sysfsh = wrap_amdsysfs_create();
-        if (sysfsh)
-        {
-            // Build Pci identification mapping as done in miners.
-            for (int i = 0; i < sysfsh->sysfs_gpucount; i++)
-            {
-                ostringstream oss;
-                string uniqueId;
-                oss << setfill('0') << setw(2) << hex << (unsigned int)sysfsh->sysfs_pci_bus_id[i]
-                    << ":" << setw(2) << (unsigned int)(sysfsh->sysfs_pci_device_id[i]) << ".0";
-                uniqueId = oss.str();
-                map_amdsysfs_handle[uniqueId] = i;
-            }
-        }
-
-#else
-        if (need_adlh)
-            adlh = wrap_adl_create();
-        if (adlh)
-        {
-            // Build Pci identification as done in miners.
-            for (int i = 0; i < adlh->adl_gpucount; i++)
-            {
-                ostringstream oss;
-                string uniqueId;
-                oss << setfill('0') << setw(2) << hex
-                    << (unsigned int)adlh->devs[adlh->phys_logi_device_id[i]].iBusNumber << ":"
-                    << setw(2)
-                    << (unsigned int)(adlh->devs[adlh->phys_logi_device_id[i]].iDeviceNumber)
-                    << ".0";
-                uniqueId = oss.str();
-                map_adl_handle[uniqueId] = i;
-            }
-        }
-
-#endif
-        if (need_nvmlh)
-            nvmlh = wrap_nvml_create();
-        if (nvmlh)
-        {
-            // Build Pci identification as done in miners.
-            for (int i = 0; i < nvmlh->nvml_gpucount; i++)
-            {
-                ostringstream oss;
-                string uniqueId;
-                oss << setfill('0') << setw(2) << hex << (unsigned int)nvmlh->nvml_pci_bus_id[i]
-                    << ":" << setw(2) << (unsigned int)(nvmlh->nvml_pci_device_id[i] >> 3) << ".0";
-                uniqueId = oss.str();
-                map_nvml_handle[uniqueId] = i;
-            }
-        }
+        // Statistics cover one collection interval
+        unsigned window = max(1U, m_collectInterval / max(1U, m_Settings.hwMonInterval));
+        m_sampler.reset(new HwSampler(m_DevicesCollection, m_Settings.hwMon,
+            m_Settings.sysfsRoot, m_Settings.hwMonInterval, window));
+        m_sampler->startWorking();
     }
 
     // Start data collector timer
     // It should work for the whole lifetime of Farm
     // regardless it's mining state
+    m_lastCollect = chrono::steady_clock::now();
     m_collectTimer.expires_from_now(boost::posix_time::milliseconds(m_collectInterval));
     m_collectTimer.async_wait(
         m_io_strand.wrap(boost::bind(&Farm::collectData, this, boost::asio::placeholders::error)));
@@ -135,15 +54,7 @@ Farm::~Farm()
     m_collectTimer.cancel();
 
     // Deinit HWMON
-#if defined(__linux)
-    if (sysfsh)
-        wrap_amdsysfs_destroy(sysfsh);
-#else
-    if (adlh)
-        wrap_adl_destroy(adlh);
-#endif
-    if (nvmlh)
-        wrap_nvml_destroy(nvmlh);
+    m_sampler.reset();
 
     // Stop mining (if needed)
     if (m_isMining.load(memory_order_relaxed))
@@ -243,6 +154,14 @@ bool Farm::start()
             m_miners.back()->startWorking();
         }
 
+        ThermalController controller;
+        controller.setMinDuty(m_Settings.dutyMin / 100.0f);
+        m_tempControllers.assign(m_miners.size(), controller);
+        m_powerControllers.assign(m_miners.size(), controller);
+
+        if (m_sampler)
+            m_sampler->setMiners(m_miners);
+
         m_isMining.store(true, memory_order_relaxed);
     }
     else
@@ -272,6 +191,8 @@ void Farm::stop()
                 miner->kick_miner();
             }
             m_miners.clear();
+            if (m_sampler)
+                m_sampler->setMiners(m_miners);
             m_isMining.store(false, memory_order_relaxed);
         }
     }
@@ -469,8 +390,15 @@ void Farm::collectData(const boost::system::error_code& ec)
 
     checkForHungMiners();
 
-    // Reset hashrate (it will accumulate from miners)
+    // Actual time elapsed since previous collection
+    auto now = chrono::steady_clock::now();
+    double elapsed = chrono::duration<double>(now - m_lastCollect).count();
+    m_lastCollect = now;
+
+    // Reset hashrate and power (they will accumulate from miners)
     float farm_hr = 0.0f;
+    double farm_powerW = 0.0;
+    double farm_powered_hr = 0.0;  // Hashrate of miners which report power
 
     // Process miners
     for (auto const& miner : m_miners)
@@ -484,116 +412,65 @@ void Farm::collectData(const boost::system::error_code& ec)
 
         if (m_Settings.hwMon)
         {
-            HwMonitorInfo hwInfo = miner->hwmonInfo();
-
-            unsigned int tempC = 0, fanpcnt = 0, powerW = 0;
-
-            if (hwInfo.deviceType == HwMonitorInfoType::NVIDIA && nvmlh)
-            {
-                int devIdx = hwInfo.deviceIndex;
-                if (devIdx == -1 && !hwInfo.devicePciId.empty())
-                {
-                    if (map_nvml_handle.find(hwInfo.devicePciId) != map_nvml_handle.end())
-                    {
-                        devIdx = map_nvml_handle[hwInfo.devicePciId];
-                        miner->setHwmonDeviceIndex(devIdx);
-                    }
-                    else
-                    {
-                        // This will prevent further tries to map
-                        miner->setHwmonDeviceIndex(-2);
-                    }
-                }
-
-                if (devIdx >= 0)
-                {
-                    wrap_nvml_get_tempC(nvmlh, devIdx, &tempC);
-                    wrap_nvml_get_fanpcnt(nvmlh, devIdx, &fanpcnt);
-
-                    if (m_Settings.hwMon == 2)
-                        wrap_nvml_get_power_usage(nvmlh, devIdx, &powerW);
-                }
-            }
-            else if (hwInfo.deviceType == HwMonitorInfoType::AMD)
-            {
-#if defined(__linux)
-                if (sysfsh)
-                {
-                    int devIdx = hwInfo.deviceIndex;
-                    if (devIdx == -1 && !hwInfo.devicePciId.empty())
-                    {
-                        if (map_amdsysfs_handle.find(hwInfo.devicePciId) !=
-                            map_amdsysfs_handle.end())
-                        {
-                            devIdx = map_amdsysfs_handle[hwInfo.devicePciId];
-                            miner->setHwmonDeviceIndex(devIdx);
-                        }
-                        else
-                        {
-                            // This will prevent further tries to map
-                            miner->setHwmonDeviceIndex(-2);
-                        }
-                    }
-
-                    if (devIdx >= 0)
-                    {
-                        wrap_amdsysfs_get_tempC(sysfsh, devIdx, &tempC);
-                        wrap_amdsysfs_get_fanpcnt(sysfsh, devIdx, &fanpcnt);
-
-                        if (m_Settings.hwMon == 2)
-                            wrap_amdsysfs_get_power_usage(sysfsh, devIdx, &powerW);
-                    }
-                }
-#else
-                if (adlh)  // Windows only for AMD
-                {
-                    int devIdx = hwInfo.deviceIndex;
-                    if (devIdx == -1 && !hwInfo.devicePciId.empty())
-                    {
-                        if (map_adl_handle.find(hwInfo.devicePciId) != map_adl_handle.end())
-                        {
-                            devIdx = map_adl_handle[hwInfo.devicePciId];
-                            miner->setHwmonDeviceIndex(devIdx);
-                        }
-                        else
-                        {
-                            // This will prevent further tries to map
-                            miner->setHwmonDeviceIndex(-2);
-                        }
-                    }
-
-                    if (devIdx >= 0)
-                    {
-                        wrap_adl_get_tempC(adlh, devIdx, &tempC);
-                        wrap_adl_get_fanpcnt(adlh, devIdx, &fanpcnt);
-
-                        if (m_Settings.hwMon == 2)
-                            wrap_adl_get_power_usage(adlh, devIdx, &powerW);
-                    }
-                }
-#endif
-            }
-
+            // Readings come from the sampler thread. Decisions rely on
+            // statistics over the whole interval rather than on a single
+            // sample : peaks trigger the safety stop, averages drive the
+            // duty cycle controllers and efficiency
+            HwSensorsType sensors;
+            m_sampler->getSensors(minerIdx, sensors);
+            unsigned int tempPeak = unsigned(sensors.tempStats.max);
+            double tempMean = sensors.tempStats.mean;
+            double powerW = sensors.powerStats.mean;
 
             // If temperature control has been enabled call
             // check threshold
             if (m_Settings.tempStop)
             {
                 bool paused = miner->pauseTest(MinerPauseEnum::PauseDueToOverHeating);
-                if (!paused && (tempC >= m_Settings.tempStop))
+                if (!paused && (tempPeak >= m_Settings.tempStop))
                     miner->pause(MinerPauseEnum::PauseDueToOverHeating);
-                if (paused && (tempC <= m_Settings.tempStart))
+                if (paused && (tempPeak <= m_Settings.tempStart))
                     miner->resume(MinerPauseEnum::PauseDueToOverHeating);
             }
 
-            m_telemetry.miners.at(minerIdx).sensors.tempC = tempC;
-            m_telemetry.miners.at(minerIdx).sensors.fanP = fanpcnt;
-            m_telemetry.miners.at(minerIdx).sensors.powerW = powerW / ((double)1000.0);
+            // If duty cycle control has been enabled let the
+            // controllers decide how much each miner may work.
+            // The tstop/tstart pair above still acts as a safety net
+            if (m_Settings.tempTarget || m_Settings.powerTarget)
+            {
+                float dt = float(elapsed);
+                float duty = 1.0f;
+                if (m_Settings.tempTarget && tempMean > 0.0)
+                    duty = m_tempControllers.at(minerIdx).update(
+                        float(m_Settings.tempTarget), float(tempMean), dt);
+                // Power is controlled in percent of target so the same
+                // gains apply (1% of power is weighted as 1 degree)
+                if (m_Settings.powerTarget && powerW > 0.0)
+                    duty = min(duty, m_powerControllers.at(minerIdx).update(100.0f,
+                                         float(powerW * 100.0 / m_Settings.powerTarget), dt));
+                // Sensors unavailable : keep on with last known duty
+                if (tempMean > 0.0 || powerW > 0.0)
+                    miner->setDutyCycle(duty);
+                m_telemetry.miners.at(minerIdx).duty = miner->dutyCycle();
+            }
+
+            m_telemetry.miners.at(minerIdx).sensors = sensors;
+
+            // Integrate hashes and energy to get efficiency
+            if (powerW > 0.0)
+            {
+                farm_powerW += powerW;
+                farm_powered_hr += hr;
+                m_telemetry.miners.at(minerIdx).efficiency.update(hr, powerW, elapsed);
+            }
         }
         m_telemetry.farm.hashrate = farm_hr;
         miner->TriggerHashRateUpdate();
     }
 
+    if (farm_powerW > 0.0)
+        m_telemetry.farm.efficiency.update(farm_powered_hr, farm_powerW, elapsed);
+
     // Resubmit timer for another loop
     m_collectTimer.expires_from_now(boost::posix_time::milliseconds(m_collectInterval));
     m_collectTimer.async_wait(
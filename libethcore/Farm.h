@@ -16,14 +16,12 @@
 #include <libdevcore/Common.h>
 #include <libdevcore/Worker.h>
 
+#include <libethcore/HwSampler.h>
 #include <libethcore/Miner.h>
+#include <libethcore/ThermalController.h>
 
-#include <libhwmon/wrapnvml.h>
 #if defined(__linux)
-#include <libhwmon/wrapamdsysfs.h>
 #include <sys/stat.h>
-#else
-#include <libhwmon/wrapadl.h>
 #endif
 
 using namespace boost::placeholders;
@@ -40,6 +38,11 @@ struct FarmSettings
     unsigned hwMon = 0;        // 0 - No monitor; 1 - Temp and Fan; 2 - Temp Fan Power
     unsigned tempStart = 40;   // Temperature threshold to restart mining (if paused)
     unsigned tempStop = 0;     // Temperature threshold to pause mining (overheating)
+    unsigned tempTarget = 0;   // Temperature setpoint for duty cycle control (0 = disabled)
+    unsigned powerTarget = 0;  // Power drain setpoint (W) for duty cycle control (0 = disabled)
+    unsigned dutyMin = 20;     // Lowest duty cycle (percent) duty cycle control may apply
+    std::string sysfsRoot;     // Root of sysfs tree for hw monitors (empty means /sys)
+    unsigned hwMonInterval = 500;  // Milliseconds between hw monitor samples
     unsigned cuBlockSize = 0;
     unsigned cuStreams = 0;
     unsigned clGroupSize = 0;
@@ -229,6 +232,11 @@ private:
     boost::asio::io_service::strand m_io_strand;
     boost::asio::deadline_timer m_collectTimer;
     static const int m_collectInterval = 5000;
+    std::chrono::steady_clock::time_point m_lastCollect;
+
+    // Duty cycle controllers (one per miner) for temperature and power
+    std::vector<ThermalController> m_tempControllers;
+    std::vector<ThermalController> m_powerControllers;
 
     // StartNonce (non-NiceHash Mode) and
     // segment width assigned to each GPU as exponent of 2
@@ -236,17 +244,8 @@ private:
     // a single device GPU should need a speed of 286 Mh/s
     // before it consumes the whole 2^32 segment
 
-    // Wrappers for hardware monitoring libraries and their mappers
-    wrap_nvml_handle* nvmlh = nullptr;
-    std::map<string, int> map_nvml_handle = {};
-
-#if defined(__linux)
-    wrap_amdsysfs_handle* sysfsh = nullptr;
-    std::map<string, int> map_amdsysfs_handle = {};
-#else
-    wrap_adl_handle* adlh = nullptr;
-    std::map<string, int> map_adl_handle = {};
-#endif
+    // Polls hardware monitors on its own thread
+    std::unique_ptr<HwSampler> m_sampler;
 
     static Farm* m_this;
     std::map<std::string, DeviceDescriptor>& m_DevicesCollection;
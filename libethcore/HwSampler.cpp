@@ -0,0 +1,373 @@
+
+#include <algorithm>
+#include <cmath>
+
+#include <libdevcore/ThreadPolicy.h>
+
+#include "HwSampler.h"
+
+namespace dev
+{
+namespace eth
+{
+HwSensorStatsType HwSamplesRing::stats(unsigned HwSampleType::*_member, double _scale) const
+{
+    HwSensorStatsType ret;
+    if (!m_count)
+        return ret;
+
+    std::vector<double> values;
+    values.reserve(m_count);
+    for (size_t i = 0; i < m_count; i++)
+        values.push_back(m_samples[i].*_member * _scale);
+
+    double sum = 0.0;
+    for (double v : values)
+        sum += v;
+    ret.mean = sum / values.size();
+
+    // Nearest rank 95th percentile
+    size_t rank = (size_t)ceil(0.95 * values.size()) - 1;
+    std::nth_element(values.begin(), values.begin() + rank, values.end());
+    ret.p95 = values[rank];
+    ret.min = *std::min_element(values.begin(), values.end());
+    ret.max = *std::max_element(values.begin(), values.end());
+    return ret;
+}
+
+HwSampler::HwSampler(std::map<std::string, DeviceDescriptor>& _DevicesCollection, unsigned _hwMon,
+    const std::string& _sysfsRoot, unsigned _interval, unsigned _window)
+  : Worker("hwmon"), m_hwMon(_hwMon), m_interval(_interval), m_window(_window)
+{
+#if defined(__linux)
+    bool need_sysfsh = false;
+#else
+    bool need_adlh = false;
+#endif
+    bool need_nvmlh = false;
+    bool need_cpuh = false;
+
+    // Scan devices collection to identify which hw monitors to initialize
+    for (auto it = _DevicesCollection.begin(); it != _DevicesCollection.end(); it++)
+    {
+        if (it->second.subscriptionType == DeviceSubscriptionTypeEnum::Cuda)
+        {
+            need_nvmlh = true;
+            continue;
+        }
+        if (it->second.subscriptionType == DeviceSubscriptionTypeEnum::Cpu)
+        {
+            need_cpuh = true;
+            continue;
+        }
+        if (it->second.subscriptionType == DeviceSubscriptionTypeEnum::OpenCL)
+        {
+            if (it->second.clPlatformType == ClPlatformTypeEnum::Nvidia)
+            {
+                need_nvmlh = true;
+                continue;
+            }
+            if (it->second.clPlatformType == ClPlatformTypeEnum::Amd)
+            {
+#if defined(__linux)
+                need_sysfsh = true;
+#else
+                need_adlh = true;
+#endif
+                continue;
+            }
+        }
+    }
+
+#if defined(__linux)
+    if (need_sysfsh)
+        sysfsh = wrap_amdsysfs_create(_sysfsRoot.c_str());
+    if (sysfsh)
+    {
+        // Build Pci identification mapping as done in miners.
+        for (int i = 0; i < sysfsh->sysfs_gpucount; i++)
+        {
+            ostringstream oss;
+            string uniqueId;
+            oss << setfill('0') << setw(2) << hex << (unsigned int)sysfsh->sysfs_pci_bus_id[i]
+                << ":" << setw(2) << (unsigned int)(sysfsh->sysfs_pci_device_id[i]) << ".0";
+            uniqueId = oss.str();
+            map_amdsysfs_handle[uniqueId] = i;
+        }
+    }
+
+#else
+    if (need_adlh)
+        adlh = wrap_adl_create();
+    if (adlh)
+    {
+        // Build Pci identification as done in miners.
+        for (int i = 0; i < adlh->adl_gpucount; i++)
+        {
+            ostringstream oss;
+            string uniqueId;
+            oss << setfill('0') << setw(2) << hex
+                << (unsigned int)adlh->devs[adlh->phys_logi_device_id[i]].iBusNumber << ":"
+                << setw(2)
+                << (unsigned int)(adlh->devs[adlh->phys_logi_device_id[i]].iDeviceNumber)
+                << ".0";
+            uniqueId = oss.str();
+            map_adl_handle[uniqueId] = i;
+        }
+    }
+
+#endif
+    if (need_cpuh)
+        cpuh = wrap_cpu_create(_sysfsRoot.c_str());
+
+    if (need_nvmlh)
+        nvmlh = wrap_nvml_create();
+    if (nvmlh)
+    {
+        // Build Pci identification as done in miners.
+        for (int i = 0; i < nvmlh->nvml_gpucount; i++)
+        {
+            ostringstream oss;
+            string uniqueId;
+            oss << setfill('0') << setw(2) << hex << (unsigned int)nvmlh->nvml_pci_bus_id[i]
+                << ":" << setw(2) << (unsigned int)(nvmlh->nvml_pci_device_id[i] >> 3) << ".0";
+            uniqueId = oss.str();
+            map_nvml_handle[uniqueId] = i;
+        }
+    }
+}
+
+HwSampler::~HwSampler()
+{
+    stop();
+
+    // Deinit HWMON
+#if defined(__linux)
+    if (sysfsh)
+        wrap_amdsysfs_destroy(sysfsh);
+#else
+    if (adlh)
+        wrap_adl_destroy(adlh);
+#endif
+    if (nvmlh)
+        wrap_nvml_destroy(nvmlh);
+    if (cpuh)
+        wrap_cpu_destroy(cpuh);
+}
+
+void HwSampler::stop()
+{
+    triggerStopWorking();
+    {
+        std::lock_guard<std::mutex> l(x_stop);
+        m_stop_signal.notify_all();
+    }
+    stopWorking();
+}
+
+void HwSampler::setMiners(const std::vector<std::shared_ptr<Miner>>& _miners)
+{
+    std::lock_guard<std::mutex> l(x_samples);
+    m_miners = _miners;
+    m_rings.assign(m_miners.size(), HwSamplesRing(m_window));
+
+    // Miners will be attached again to cpu packages once mapped
+    m_remap = true;
+}
+
+bool HwSampler::getSensors(unsigned _minerIdx, HwSensorsType& _sensors)
+{
+    std::lock_guard<std::mutex> l(x_samples);
+    if (_minerIdx >= m_rings.size() || !m_rings.at(_minerIdx).size())
+        return false;
+
+    const HwSamplesRing& ring = m_rings.at(_minerIdx);
+    const HwSampleType& latest = ring.latest();
+    _sensors.tempC = latest.tempC;
+    _sensors.fanP = latest.fanP;
+    _sensors.powerW = latest.powerMW / 1000.0;
+    _sensors.tempStats = ring.stats(&HwSampleType::tempC, 1.0);
+    _sensors.powerStats = ring.stats(&HwSampleType::powerMW, 1.0 / 1000.0);
+    return true;
+}
+
+void HwSampler::workLoop()
+{
+    ThreadPolicy::apply(ThreadRole::Telemetry);
+
+    while (!shouldStop())
+    {
+        std::vector<std::shared_ptr<Miner>> miners;
+        bool remap;
+        {
+            std::lock_guard<std::mutex> l(x_samples);
+            miners = m_miners;
+            remap = m_remap;
+            m_remap = false;
+        }
+
+        // Hardware is read outside the lock so consumers
+        // never wait on slow monitoring libraries
+        if (remap && cpuh)
+            wrap_cpu_detach_all(cpuh);
+
+        // Sensors are read in one batched pass for all devices
+        if (cpuh)
+            wrap_cpu_sample(cpuh);
+#if defined(__linux)
+        if (sysfsh)
+            wrap_amdsysfs_sample(sysfsh, m_hwMon == 2);
+#endif
+
+        std::vector<std::pair<size_t, HwSampleType>> samples;
+        for (size_t i = 0; i < miners.size(); i++)
+        {
+            HwSampleType sample;
+            if (readSensors(*miners.at(i), sample))
+                samples.emplace_back(i, sample);
+        }
+
+        {
+            // Discard samples if the collection of miners changed meanwhile
+            std::lock_guard<std::mutex> l(x_samples);
+            for (auto const& sample : samples)
+                if (sample.first < m_miners.size() &&
+                    m_miners.at(sample.first) == miners.at(sample.first))
+                    m_rings.at(sample.first).push(sample.second);
+        }
+
+        std::unique_lock<std::mutex> l(x_stop);
+        m_stop_signal.wait_for(
+            l, std::chrono::milliseconds(m_interval), [this]() { return shouldStop(); });
+    }
+}
+
+bool HwSampler::readSensors(Miner& _miner, HwSampleType& _sample)
+{
+    HwMonitorInfo hwInfo = _miner.hwmonInfo();
+
+    unsigned int tempC = 0, fanpcnt = 0, powerW = 0;
+
+    if (hwInfo.deviceType == HwMonitorInfoType::NVIDIA && nvmlh)
+    {
+        int devIdx = hwInfo.deviceIndex;
+        if (devIdx == -1 && !hwInfo.devicePciId.empty())
+        {
+            if (map_nvml_handle.find(hwInfo.devicePciId) != map_nvml_handle.end())
+            {
+                devIdx = map_nvml_handle[hwInfo.devicePciId];
+                _miner.setHwmonDeviceIndex(devIdx);
+            }
+            else
+            {
+                // This will prevent further tries to map
+                _miner.setHwmonDeviceIndex(-2);
+            }
+        }
+
+        if (devIdx >= 0)
+        {
+            wrap_nvml_get_tempC(nvmlh, devIdx, &tempC);
+            wrap_nvml_get_fanpcnt(nvmlh, devIdx, &fanpcnt);
+
+            if (m_hwMon == 2)
+                wrap_nvml_get_power_usage(nvmlh, devIdx, &powerW);
+        }
+    }
+    else if (hwInfo.deviceType == HwMonitorInfoType::CPU && cpuh)
+    {
+        int devIdx = hwInfo.deviceIndex;
+        if (devIdx == -1)
+        {
+            // Logical cpu the miner is bound to
+            devIdx = _miner.getDescriptor().cpCpuNumer;
+            if (wrap_cpu_attach(cpuh, devIdx) == 0)
+                _miner.setHwmonDeviceIndex(devIdx);
+            else
+            {
+                // This will prevent further tries to map
+                devIdx = -2;
+                _miner.setHwmonDeviceIndex(-2);
+            }
+        }
+
+        if (devIdx >= 0)
+        {
+            wrap_cpu_get_tempC(cpuh, devIdx, &tempC);
+
+            if (m_hwMon == 2)
+                wrap_cpu_get_power_usage(cpuh, devIdx, &powerW);
+        }
+    }
+    else if (hwInfo.deviceType == HwMonitorInfoType::AMD)
+    {
+#if defined(__linux)
+        if (sysfsh)
+        {
+            int devIdx = hwInfo.deviceIndex;
+            if (devIdx == -1 && !hwInfo.devicePciId.empty())
+            {
+                if (map_amdsysfs_handle.find(hwInfo.devicePciId) !=
+                    map_amdsysfs_handle.end())
+                {
+                    devIdx = map_amdsysfs_handle[hwInfo.devicePciId];
+                    _miner.setHwmonDeviceIndex(devIdx);
+                }
+                else
+                {
+                    // This will prevent further tries to map
+                    _miner.setHwmonDeviceIndex(-2);
+                }
+            }
+
+            if (devIdx >= 0)
+            {
+                wrap_amdsysfs_get_tempC(sysfsh, devIdx, &tempC);
+                wrap_amdsysfs_get_fanpcnt(sysfsh, devIdx, &fanpcnt);
+
+                if (m_hwMon == 2)
+                    wrap_amdsysfs_get_power_usage(sysfsh, devIdx, &powerW);
+            }
+        }
+#else
+        if (adlh)  // Windows only for AMD
+        {
+            int devIdx = hwInfo.deviceIndex;
+            if (devIdx == -1 && !hwInfo.devicePciId.empty())
+            {
+                if (map_adl_handle.find(hwInfo.devicePciId) != map_adl_handle.end())
+                {
+                    devIdx = map_adl_handle[hwInfo.devicePciId];
+                    _miner.setHwmonDeviceIndex(devIdx);
+                }
+                else
+                {
+                    // This will prevent further tries to map
+                    _miner.setHwmonDeviceIndex(-2);
+                }
+            }
+
+            if (devIdx >= 0)
+            {
+                wrap_adl_get_tempC(adlh, devIdx, &tempC);
+                wrap_adl_get_fanpcnt(adlh, devIdx, &fanpcnt);
+
+                if (m_hwMon == 2)
+                    wrap_adl_get_power_usage(adlh, devIdx, &powerW);
+            }
+        }
+#endif
+    }
+
+    // Device could not be mapped to any monitor
+    if (_miner.hwmonInfo().deviceIndex < 0)
+        return false;
+
+    _sample.tempC = tempC;
+    _sample.fanP = fanpcnt;
+    _sample.powerMW = powerW;
+    return true;
+}
+
+}  // namespace eth
+}  // namespace dev
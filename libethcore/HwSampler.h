@@ -0,0 +1,122 @@
+
+#pragma once
+
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include <libdevcore/Worker.h>
+
+#include <libethcore/Miner.h>
+
+#include <libhwmon/wrapcpu.h>
+#include <libhwmon/wrapnvml.h>
+#if defined(__linux)
+#include <libhwmon/wrapamdsysfs.h>
+#else
+#include <libhwmon/wrapadl.h>
+#endif
+
+namespace dev
+{
+namespace eth
+{
+// A single reading of a device's sensors
+struct HwSampleType
+{
+    unsigned tempC = 0;
+    unsigned fanP = 0;
+    unsigned powerMW = 0;
+};
+
+// Fixed capacity circular buffer of the most recent samples
+class HwSamplesRing
+{
+public:
+    HwSamplesRing(size_t _capacity = 1) : m_samples(_capacity ? _capacity : 1) {}
+
+    void push(const HwSampleType& _sample)
+    {
+        m_samples[m_head] = _sample;
+        m_head = (m_head + 1) % m_samples.size();
+        m_count = std::min(m_count + 1, m_samples.size());
+    }
+
+    size_t size() const { return m_count; }
+    const HwSampleType& latest() const
+    {
+        return m_samples[(m_head + m_samples.size() - 1) % m_samples.size()];
+    }
+
+    // Computes statistics of the samples selected by _member
+    HwSensorStatsType stats(unsigned HwSampleType::*_member, double _scale) const;
+
+private:
+    std::vector<HwSampleType> m_samples;
+    size_t m_head = 0;
+    size_t m_count = 0;
+};
+
+/**
+ * @brief Polls hardware sensors of all miners on its own thread
+ * so the io strand never waits on NVML/ADL/sysfs calls.
+ * Samples are kept in per miner rings and summarized on request.
+ */
+class HwSampler : public Worker
+{
+public:
+    HwSampler(std::map<std::string, DeviceDescriptor>& _DevicesCollection, unsigned _hwMon,
+        const std::string& _sysfsRoot, unsigned _interval, unsigned _window);
+    ~HwSampler() override;
+
+    /**
+     * @brief Sets the collection of miners to be sampled
+     */
+    void setMiners(const std::vector<std::shared_ptr<Miner>>& _miners);
+
+    /**
+     * @brief Gets latest readings and statistics over the window for a miner
+     * @return false if no sample is available
+     */
+    bool getSensors(unsigned _minerIdx, HwSensorsType& _sensors);
+
+    /**
+     * @brief Stops the sampling thread
+     */
+    void stop();
+
+private:
+    void workLoop() override;
+    bool readSensors(Miner& _miner, HwSampleType& _sample);
+
+    unsigned m_hwMon;
+    unsigned m_interval;  // Milliseconds between samples
+    unsigned m_window;    // Number of samples kept for statistics
+
+    std::mutex x_samples;  // Guards miners and rings
+    std::vector<std::shared_ptr<Miner>> m_miners;
+    std::vector<HwSamplesRing> m_rings;
+    bool m_remap = false;
+
+    std::mutex x_stop;
+    std::condition_variable m_stop_signal;
+
+    // Wrappers for hardware monitoring libraries and their mappers
+    wrap_nvml_handle* nvmlh = nullptr;
+    std::map<string, int> map_nvml_handle = {};
+
+    wrap_cpu_handle* cpuh = nullptr;
+
+#if defined(__linux)
+    wrap_amdsysfs_handle* sysfsh = nullptr;
+    std::map<string, int> map_amdsysfs_handle = {};
+#else
+    wrap_adl_handle* adlh = nullptr;
+    std::map<string, int> map_adl_handle = {};
+#endif
+};
+
+}  // namespace eth
+}  // namespace dev
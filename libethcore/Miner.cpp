@@ -155,6 +155,32 @@ void Miner::updateHashRate(uint32_t _groupSize, uint32_t _increment) noexcept
     m_groupCount = 0;
 }
 
+void Miner::setDutyCycle(float _duty) noexcept
+{
+    m_dutyCycle.store(min(1.0f, max(0.05f, _duty)), memory_order_relaxed);
+}
+
+void Miner::throttle(chrono::steady_clock::time_point _batchStart)
+{
+    float duty = dutyCycle();
+    if (duty >= 1.0f)
+        return;
+
+    // Idle for as long as needed to let the device work only
+    // for the duty fraction of the time. Capped so the miner
+    // stays responsive to new work and hung detection
+    using namespace chrono;
+    auto busy = duration_cast<microseconds>(steady_clock::now() - _batchStart);
+    auto idle = microseconds(int64_t(busy.count() * (1.0f - duty) / duty));
+    if (idle > milliseconds(1000))
+        idle = milliseconds(1000);
+    if (idle.count() <= 0)
+        return;
+
+    unique_lock<mutex> l(miner_work_mutex);
+    m_new_work_signal.wait_for(l, idle);
+}
+
 
 }  // namespace eth
 }  // namespace dev
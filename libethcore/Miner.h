@@ -2,6 +2,7 @@
 #pragma once
 
 #include <bitset>
+#include <cmath>
 #include <condition_variable>
 #include <list>
 #include <mutex>
@@ -96,11 +97,21 @@ struct SolutionAccountType
     };
 };
 
+struct HwSensorStatsType
+{
+    double min = 0.0;
+    double max = 0.0;
+    double mean = 0.0;
+    double p95 = 0.0;
+};
+
 struct HwSensorsType
 {
     int tempC = 0;
     int fanP = 0;
     double powerW = 0.0;
+    HwSensorStatsType tempStats;   // Statistics over the sampling window
+    HwSensorStatsType powerStats;
     string str()
     {
         string _ret = to_string(tempC) + "C " + to_string(fanP) + "%";
@@ -110,12 +121,61 @@ struct HwSensorsType
     };
 };
 
+struct EfficiencyAccountType
+{
+    // Smoothing windows (seconds) of the exponentially weighted averages
+    static constexpr double windows[3] = {60.0, 300.0, 900.0};
+
+    double hashes = 0.0;  // Hashes computed since start (while power was known)
+    double joules = 0.0;  // Energy drained since start
+    double hashrate[3] = {0.0, 0.0, 0.0};
+    double powerW[3] = {0.0, 0.0, 0.0};
+    bool primed = false;
+
+    // Integrates a sample of hashrate and power drain held for _dt seconds
+    void update(double _hashrate, double _powerW, double _dt)
+    {
+        if (_dt <= 0.0 || _powerW <= 0.0)
+            return;
+        hashes += _hashrate * _dt;
+        joules += _powerW * _dt;
+        for (int i = 0; i < 3; i++)
+        {
+            double alpha = primed ? 1.0 - exp(-_dt / windows[i]) : 1.0;
+            hashrate[i] += alpha * (_hashrate - hashrate[i]);
+            powerW[i] += alpha * (_powerW - powerW[i]);
+        }
+        primed = true;
+    }
+
+    // Hashes per joule since start
+    double total() const { return joules > 0.0 ? hashes / joules : 0.0; }
+
+    // Hashes per joule over the i-th smoothing window
+    double ewma(int i) const { return powerW[i] > 0.0 ? hashrate[i] / powerW[i] : 0.0; }
+
+    string str() const
+    {
+        const static string suffixes[] = {"h", "Kh", "Mh", "Gh"};
+        double hj = ewma(0);
+        int magnitude = 0;
+        while (hj > 1000.0 && magnitude < 3)
+        {
+            hj /= 1000.0;
+            magnitude++;
+        }
+        return boost::str(boost::format("%0.2f") % hj) + " " + suffixes[magnitude] + "/J";
+    }
+};
+
 struct TelemetryAccountType
 {
     string prefix = "";
     float hashrate = 0.0f;
     bool paused = false;
+    float duty = 1.0f;  // Duty cycle applied by thermal control
     HwSensorsType sensors;
+    EfficiencyAccountType efficiency;
     SolutionAccountType solutions;
 };
 
@@ -230,7 +290,10 @@ struct TelemetryType
         }
 
         ss << EthTealBold << std::fixed << std::setprecision(2) << hr << " " << suffixes[magnitude]
-           << EthReset << " - ";
+           << EthReset;
+        if (farm.efficiency.primed)
+            ss << " " << EthTeal << farm.efficiency.str() << EthReset;
+        ss << " - ";
         telemetry.push_back(ss.str());
 
         int i = -1;                 // Current miner index
@@ -248,6 +311,12 @@ struct TelemetryType
             if (hwmon)
                 ss << " " << EthTeal << miner.sensors.str() << EthReset;
 
+            if (miner.efficiency.primed)
+                ss << " " << EthTeal << miner.efficiency.str() << EthReset;
+
+            if (miner.duty < 1.0f)
+                ss << " " << EthYellow << "D" << int(miner.duty * 100.0f) << "%" << EthReset;
+
             // Eventually push also solutions per single GPU
             if (g_logOptions & LOG_PER_GPU)
                 ss << " " << EthTeal << miner.solutions.str() << EthReset;
@@ -317,6 +386,8 @@ public:
     void resume(MinerPauseEnum fromwhat);
     float RetrieveHashRate() noexcept;
     void TriggerHashRateUpdate() noexcept;
+    void setDutyCycle(float _duty) noexcept;
+    float dutyCycle() const noexcept { return m_dutyCycle.load(memory_order_relaxed); }
     std::atomic<bool> m_hung_miner = {false};
     bool m_initialized = false;
 
@@ -330,6 +401,7 @@ protected:
     void ReportGPUMemoryUsage(uint64_t requiredTotalMemory, uint64_t totalMemory);
     void ReportGPUNoMemoryAndPause(uint64_t requiredTotalMemory, uint64_t totalMemory);
     void updateHashRate(uint32_t _groupSize, uint32_t _increment) noexcept;
+    void throttle(std::chrono::steady_clock::time_point _batchStart);
 
     const unsigned m_index = 0;           // Ordinal index of the Instance (not the device)
     DeviceDescriptor m_deviceDescriptor;  // Info about the device
@@ -356,6 +428,7 @@ private:
     std::atomic<float> m_hashRate = {0.0};
     atomic<bool> m_hashRateUpdate = {false};
     uint64_t m_groupCount = 0;
+    std::atomic<float> m_dutyCycle = {1.0f};
 };
 
 }  // namespace eth
@@ -0,0 +1,48 @@
+
+#include <algorithm>
+
+#include "ThermalController.h"
+
+namespace dev
+{
+namespace eth
+{
+ThermalController::ThermalController(float _kp, float _ki, float _kd, float _minDuty)
+  : m_kp(_kp), m_ki(_ki), m_kd(_kd), m_minDuty(_minDuty)
+{}
+
+float ThermalController::update(float _setpoint, float _measured, float _dt)
+{
+    if (_dt <= 0.0f)
+        return m_duty;
+
+    // Positive error means we're running above setpoint
+    // and the duty cycle has to be lowered
+    float error = _measured - _setpoint;
+    float derivative = m_primed ? (error - m_prevError) / _dt : 0.0f;
+    m_prevError = error;
+    m_primed = true;
+
+    float integral = m_integral + error * _dt;
+    float output = 1.0f - (m_kp * error + m_ki * integral + m_kd * derivative);
+
+    // Anti windup : do not accumulate error while the output is
+    // saturated and the error would push it further out of range
+    bool saturated = (output >= 1.0f && error < 0.0f) || (output <= m_minDuty && error > 0.0f);
+    if (!saturated)
+        m_integral = integral;
+
+    m_duty = std::min(1.0f, std::max(m_minDuty, output));
+    return m_duty;
+}
+
+void ThermalController::reset()
+{
+    m_integral = 0.0f;
+    m_prevError = 0.0f;
+    m_primed = false;
+    m_duty = 1.0f;
+}
+
+}  // namespace eth
+}  // namespace dev
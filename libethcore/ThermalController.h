@@ -0,0 +1,51 @@
+
+#pragma once
+
+namespace dev
+{
+namespace eth
+{
+/**
+ * @brief A PID controller which turns the distance of a sensor reading
+ * from its setpoint into a duty cycle in the range [minDuty, 1].
+ * It holds no reference to any hardware monitor: callers feed it the
+ * measured value and the elapsed time, hence any sensor source (real
+ * or simulated) can drive it.
+ */
+class ThermalController
+{
+public:
+    ThermalController(float _kp = 0.05f, float _ki = 0.01f, float _kd = 0.02f,
+        float _minDuty = 0.2f);
+
+    /**
+     * @brief Feeds a new sample into the loop
+     * @param _setpoint The value the controller tries to hold
+     * @param _measured The actual reading of the sensor
+     * @param _dt Seconds elapsed since previous sample
+     * @return The new duty cycle
+     */
+    float update(float _setpoint, float _measured, float _dt);
+
+    /**
+     * @brief Clears accumulated state and restores full duty
+     */
+    void reset();
+
+    float duty() const { return m_duty; }
+    void setMinDuty(float _minDuty) { m_minDuty = _minDuty; }
+
+private:
+    float m_kp;
+    float m_ki;
+    float m_kd;
+    float m_minDuty;
+
+    float m_integral = 0.0f;
+    float m_prevError = 0.0f;
+    bool m_primed = false;  // Whether m_prevError holds a valid sample
+    float m_duty = 1.0f;
+};
+
+}  // namespace eth
+}  // namespace dev
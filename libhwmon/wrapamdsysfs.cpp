@@ -5,6 +5,8 @@
 #include <sys/types.h>
 #if defined(__linux)
 #include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 
 #include <boost/algorithm/string.hpp>
@@ -40,7 +42,32 @@ static bool getFileContentValue(const char* filename, unsigned int& value)
     return (p != p2);
 }
 
-wrap_amdsysfs_handle* wrap_amdsysfs_create()
+#if defined(__linux)
+// Reads a file kept open reusing the same descriptor
+static int readFdContent(int fd, char* buf, size_t size)
+{
+    if (fd < 0)
+        return -1;
+    ssize_t n = pread(fd, buf, size - 1, 0);
+    if (n < 0)
+        return -1;
+    buf[n] = 0;
+    return (int)n;
+}
+
+static bool getFdContentValue(int fd, unsigned int& value)
+{
+    char buf[32];
+    if (readFdContent(fd, buf, sizeof(buf)) <= 0)
+        return false;
+    char* p2;
+    errno = 0;
+    value = strtoul(buf, &p2, 0);
+    return (errno == 0 && p2 != buf);
+}
+#endif
+
+wrap_amdsysfs_handle* wrap_amdsysfs_create(const char* sysfs_root)
 {
     wrap_amdsysfs_handle* sysfsh = nullptr;
 
@@ -48,9 +75,10 @@ wrap_amdsysfs_handle* wrap_amdsysfs_create()
     namespace fs = boost::filesystem;
     vector<pciInfo> devices;  // Used to collect devices
 
-    char dbuf[120];
+    string root(sysfs_root && *sysfs_root ? sysfs_root : "/sys");
+
     // Check directory exist
-    fs::path drm_dir("/sys/class/drm");
+    fs::path drm_dir(root + "/class/drm");
     if (!fs::exists(drm_dir) || !fs::is_directory(drm_dir))
         return nullptr;
 
@@ -72,14 +100,13 @@ wrap_amdsysfs_handle* wrap_amdsysfs_create()
         unsigned int hwmonIndex = UINT_MAX;
 
         // Get AMD cards only (vendor 4098)
-        fs::path vendor_file("/sys/class/drm/" + devName + "/device/vendor");
-        snprintf(dbuf, 120, "/sys/class/drm/%s/device/vendor", devName.c_str());
+        fs::path vendor_file(drm_dir / devName / "device/vendor");
         if (!fs::exists(vendor_file) || !fs::is_regular_file(vendor_file) ||
-            !getFileContentValue(dbuf, vendorId) || vendorId != 4098)
+            !getFileContentValue(vendor_file.string().c_str(), vendorId) || vendorId != 4098)
             continue;
 
         // Check it has dependant hwmon directory
-        fs::path hwmon_dir("/sys/class/drm/" + devName + "/device/hwmon");
+        fs::path hwmon_dir(drm_dir / devName / "device/hwmon");
         if (!fs::exists(hwmon_dir) || !fs::is_directory(hwmon_dir))
             continue;
 
@@ -99,12 +126,11 @@ wrap_amdsysfs_handle* wrap_amdsysfs_create()
             continue;
 
         // Detect Pci Id
-        fs::path uevent_file("/sys/class/drm/" + devName + "/device/uevent");
+        fs::path uevent_file(drm_dir / devName / "device/uevent");
         if (!fs::exists(uevent_file) || !fs::is_regular_file(uevent_file))
             continue;
 
-        snprintf(dbuf, 120, "/sys/class/drm/card%d/device/uevent", devIndex);
-        ifstream ifs(dbuf, ios::binary);
+        ifstream ifs(uevent_file.string(), ios::binary);
         string line;
         int PciDomain = -1, PciBus = -1, PciDevice = -1, PciFunction = -1;
         while (getline(ifs, line))
@@ -168,8 +194,18 @@ wrap_amdsysfs_handle* wrap_amdsysfs_create()
     sysfsh->sysfs_pci_domain_id = (unsigned int*)calloc(gpucount, sizeof(unsigned int));
     sysfsh->sysfs_pci_bus_id = (unsigned int*)calloc(gpucount, sizeof(unsigned int));
     sysfsh->sysfs_pci_device_id = (unsigned int*)calloc(gpucount, sizeof(unsigned int));
+    sysfsh->sysfs_temp_fd = (int*)calloc(gpucount, sizeof(int));
+    sysfsh->sysfs_pwm_fd = (int*)calloc(gpucount, sizeof(int));
+    sysfsh->sysfs_power_fd = (int*)calloc(gpucount, sizeof(int));
+    sysfsh->sysfs_pm_info_fd = (int*)calloc(gpucount, sizeof(int));
+    sysfsh->sysfs_pwm_min = (unsigned int*)calloc(gpucount, sizeof(unsigned int));
+    sysfsh->sysfs_pwm_max = (unsigned int*)calloc(gpucount, sizeof(unsigned int));
+    sysfsh->sysfs_tempC = (unsigned int*)calloc(gpucount, sizeof(unsigned int));
+    sysfsh->sysfs_fanpcnt = (unsigned int*)calloc(gpucount, sizeof(unsigned int));
+    sysfsh->sysfs_milliwatts = (unsigned int*)calloc(gpucount, sizeof(unsigned int));
 
     gpucount = 0;
+    char dbuf[256];
     for (auto const& device : devices)
     {
         sysfsh->sysfs_device_id[gpucount] = device.DeviceId;
@@ -177,6 +213,30 @@ wrap_amdsysfs_handle* wrap_amdsysfs_create()
         sysfsh->sysfs_pci_domain_id[gpucount] = device.PciDomain;
         sysfsh->sysfs_pci_bus_id[gpucount] = device.PciBus;
         sysfsh->sysfs_pci_device_id[gpucount] = device.PciDevice;
+
+        // Open sensor files once : they will be read on each sample
+        snprintf(dbuf, sizeof(dbuf), "%s/class/drm/card%d/device/hwmon/hwmon%d/", root.c_str(),
+            device.DeviceId, device.HwMonId);
+        string hwmon_path(dbuf);
+        sysfsh->sysfs_temp_fd[gpucount] = open((hwmon_path + "temp1_input").c_str(), O_RDONLY);
+        sysfsh->sysfs_pwm_fd[gpucount] = open((hwmon_path + "pwm1").c_str(), O_RDONLY);
+        sysfsh->sysfs_power_fd[gpucount] =
+            open((hwmon_path + "power1_average").c_str(), O_RDONLY);
+        sysfsh->sysfs_pm_info_fd[gpucount] = -1;
+        if (sysfsh->sysfs_power_fd[gpucount] < 0)
+        {
+            snprintf(dbuf, sizeof(dbuf), "%s/kernel/debug/dri/%d/amdgpu_pm_info", root.c_str(),
+                device.DeviceId);
+            sysfsh->sysfs_pm_info_fd[gpucount] = open(dbuf, O_RDONLY);
+        }
+
+        unsigned int pwmMin = 0, pwmMax = 255;
+        getFileContentValue((hwmon_path + "pwm1_min").c_str(), pwmMin);
+        if (!getFileContentValue((hwmon_path + "pwm1_max").c_str(), pwmMax) || pwmMax <= pwmMin)
+            pwmMax = 255;
+        sysfsh->sysfs_pwm_min[gpucount] = pwmMin;
+        sysfsh->sysfs_pwm_max[gpucount] = pwmMax;
+
         gpucount++;
     }
 
@@ -186,6 +246,29 @@ wrap_amdsysfs_handle* wrap_amdsysfs_create()
 
 int wrap_amdsysfs_destroy(wrap_amdsysfs_handle* sysfsh)
 {
+#if defined(__linux)
+    for (int i = 0; i < sysfsh->sysfs_gpucount; i++)
+    {
+        for (int fd : {sysfsh->sysfs_temp_fd[i], sysfsh->sysfs_pwm_fd[i],
+                 sysfsh->sysfs_power_fd[i], sysfsh->sysfs_pm_info_fd[i]})
+            if (fd >= 0)
+                close(fd);
+    }
+#endif
+    free(sysfsh->sysfs_device_id);
+    free(sysfsh->sysfs_hwmon_id);
+    free(sysfsh->sysfs_pci_domain_id);
+    free(sysfsh->sysfs_pci_bus_id);
+    free(sysfsh->sysfs_pci_device_id);
+    free(sysfsh->sysfs_temp_fd);
+    free(sysfsh->sysfs_pwm_fd);
+    free(sysfsh->sysfs_power_fd);
+    free(sysfsh->sysfs_pm_info_fd);
+    free(sysfsh->sysfs_pwm_min);
+    free(sysfsh->sysfs_pwm_max);
+    free(sysfsh->sysfs_tempC);
+    free(sysfsh->sysfs_fanpcnt);
+    free(sysfsh->sysfs_milliwatts);
     free(sysfsh);
     return 0;
 }
@@ -196,92 +279,95 @@ int wrap_amdsysfs_get_gpucount(wrap_amdsysfs_handle* sysfsh, int* gpucount)
     return 0;
 }
 
-int wrap_amdsysfs_get_tempC(wrap_amdsysfs_handle* sysfsh, int index, unsigned int* tempC)
+int wrap_amdsysfs_sample(wrap_amdsysfs_handle* sysfsh, int with_power)
 {
-    if (index < 0 || index >= sysfsh->sysfs_gpucount)
-        return -1;
-
-    int gpuindex = sysfsh->sysfs_device_id[index];
-
-    int hwmonindex = sysfsh->sysfs_hwmon_id[index];
-    if (hwmonindex < 0)
-        return -1;
+#if defined(__linux)
+    for (int i = 0; i < sysfsh->sysfs_gpucount; i++)
+    {
+        unsigned int value = 0;
 
-    char dbuf[120];
-    snprintf(
-        dbuf, 120, "/sys/class/drm/card%d/device/hwmon/hwmon%d/temp1_input", gpuindex, hwmonindex);
+        if (getFdContentValue(sysfsh->sysfs_temp_fd[i], value) && value > 0)
+            sysfsh->sysfs_tempC[i] = value / 1000;
 
-    unsigned int temp = 0;
-    getFileContentValue(dbuf, temp);
+        if (getFdContentValue(sysfsh->sysfs_pwm_fd[i], value))
+        {
+            unsigned int pwmMin = sysfsh->sysfs_pwm_min[i], pwmMax = sysfsh->sysfs_pwm_max[i];
+            value = max(pwmMin, min(pwmMax, value));
+            sysfsh->sysfs_fanpcnt[i] =
+                (unsigned int)(double(value - pwmMin) / double(pwmMax - pwmMin) * 100.0);
+        }
 
-    if (temp > 0)
-        *tempC = temp / 1000;
+        if (!with_power)
+            continue;
 
+        if (sysfsh->sysfs_power_fd[i] >= 0)
+        {
+            if (getFdContentValue(sysfsh->sysfs_power_fd[i], value))
+                sysfsh->sysfs_milliwatts[i] = value / 1000;
+        }
+        else if (sysfsh->sysfs_pm_info_fd[i] >= 0)
+        {
+            // Older kernels only expose power through debugfs
+            try
+            {
+                char buf[4096];
+                if (readFdContent(sysfsh->sysfs_pm_info_fd[i], buf, sizeof(buf)) > 0)
+                {
+                    static const regex pattern(R"(([\d|\.]+) W \(average GPU\))");
+                    cmatch sm;
+                    if (regex_search(buf, sm, pattern) && sm.size() == 2)
+                        sysfsh->sysfs_milliwatts[i] =
+                            (unsigned int)(atof(sm.str(1).c_str()) * 1000);
+                }
+            }
+            catch (const exception& ex)
+            {
+                cwarn << "Error in amdsysfs_get_power_usage: " << ex.what();
+            }
+        }
+    }
     return 0;
+#else
+    (void)sysfsh;
+    (void)with_power;
+    return -1;
+#endif
 }
 
-int wrap_amdsysfs_get_fanpcnt(wrap_amdsysfs_handle* sysfsh, int index, unsigned int* fanpcnt)
+int wrap_amdsysfs_get_tempC(wrap_amdsysfs_handle* sysfsh, int index, unsigned int* tempC)
 {
     if (index < 0 || index >= sysfsh->sysfs_gpucount)
         return -1;
 
-    int gpuindex = sysfsh->sysfs_device_id[index];
-    int hwmonindex = sysfsh->sysfs_hwmon_id[index];
-    if (hwmonindex < 0)
+    if (sysfsh->sysfs_temp_fd[index] < 0)
         return -1;
 
-    unsigned int pwm = 0, pwmMax = 255, pwmMin = 0;
+    if (sysfsh->sysfs_tempC[index] > 0)
+        *tempC = sysfsh->sysfs_tempC[index];
 
-    char dbuf[120];
-    snprintf(dbuf, 120, "/sys/class/drm/card%d/device/hwmon/hwmon%d/pwm1", gpuindex, hwmonindex);
-    getFileContentValue(dbuf, pwm);
+    return 0;
+}
 
-    snprintf(
-        dbuf, 120, "/sys/class/drm/card%d/device/hwmon/hwmon%d/pwm1_max", gpuindex, hwmonindex);
-    getFileContentValue(dbuf, pwmMax);
+int wrap_amdsysfs_get_fanpcnt(wrap_amdsysfs_handle* sysfsh, int index, unsigned int* fanpcnt)
+{
+    if (index < 0 || index >= sysfsh->sysfs_gpucount)
+        return -1;
 
-    snprintf(
-        dbuf, 120, "/sys/class/drm/card%d/device/hwmon/hwmon%d/pwm1_min", gpuindex, hwmonindex);
-    getFileContentValue(dbuf, pwmMin);
+    if (sysfsh->sysfs_pwm_fd[index] < 0)
+        return -1;
 
-    *fanpcnt = (unsigned int)(double(pwm - pwmMin) / double(pwmMax - pwmMin) * 100.0);
+    *fanpcnt = sysfsh->sysfs_fanpcnt[index];
     return 0;
 }
 
 int wrap_amdsysfs_get_power_usage(wrap_amdsysfs_handle* sysfsh, int index, unsigned int* milliwatts)
 {
-    try
-    {
-        if (index < 0 || index >= sysfsh->sysfs_gpucount)
-            return -1;
-
-        int gpuindex = sysfsh->sysfs_device_id[index];
-
-        char dbuf[120];
-        snprintf(dbuf, 120, "/sys/kernel/debug/dri/%d/amdgpu_pm_info", gpuindex);
-
-        ifstream ifs(dbuf, ios::binary);
-        string line;
+    if (index < 0 || index >= sysfsh->sysfs_gpucount)
+        return -1;
 
-        while (getline(ifs, line))
-        {
-            smatch sm;
-            regex regex(R"(([\d|\.]+) W \(average GPU\))");
-            if (regex_search(line, sm, regex))
-            {
-                if (sm.size() == 2)
-                {
-                    double watt = atof(sm.str(1).c_str());
-                    *milliwatts = (unsigned int)(watt * 1000);
-                    return 0;
-                }
-            }
-        }
-    }
-    catch (const exception& ex)
-    {
-        cwarn << "Error in amdsysfs_get_power_usage: " << ex.what();
-    }
+    if (sysfsh->sysfs_power_fd[index] < 0 && sysfsh->sysfs_pm_info_fd[index] < 0)
+        return -1;
 
-    return -1;
+    *milliwatts = sysfsh->sysfs_milliwatts[index];
+    return 0;
 }
@@ -9,6 +9,15 @@ typedef struct
     unsigned int* sysfs_pci_domain_id;
     unsigned int* sysfs_pci_bus_id;
     unsigned int* sysfs_pci_device_id;
+    int* sysfs_temp_fd;             // hwmon temp1_input
+    int* sysfs_pwm_fd;              // hwmon pwm1
+    int* sysfs_power_fd;            // hwmon power1_average (microwatts)
+    int* sysfs_pm_info_fd;          // debugfs amdgpu_pm_info (if no power1_average)
+    unsigned int* sysfs_pwm_min;    // hwmon pwm1_min (constant)
+    unsigned int* sysfs_pwm_max;    // hwmon pwm1_max (constant)
+    unsigned int* sysfs_tempC;      // Values read by last wrap_amdsysfs_sample()
+    unsigned int* sysfs_fanpcnt;
+    unsigned int* sysfs_milliwatts;
 } wrap_amdsysfs_handle;
 
 typedef struct
@@ -21,11 +30,15 @@ typedef struct
 
 } pciInfo;
 
-wrap_amdsysfs_handle* wrap_amdsysfs_create();
+wrap_amdsysfs_handle* wrap_amdsysfs_create(const char* sysfs_root);
 int wrap_amdsysfs_destroy(wrap_amdsysfs_handle* sysfsh);
 
 int wrap_amdsysfs_get_gpucount(wrap_amdsysfs_handle* sysfsh, int* gpucount);
 
+// Reads sensors of all devices in one pass through cached file descriptors.
+// Getters below return values from the last pass
+int wrap_amdsysfs_sample(wrap_amdsysfs_handle* sysfsh, int with_power);
+
 int wrap_amdsysfs_get_tempC(wrap_amdsysfs_handle* sysfsh, int index, unsigned int* tempC);
 
 int wrap_amdsysfs_get_fanpcnt(wrap_amdsysfs_handle* sysfsh, int index, unsigned int* fanpcnt);
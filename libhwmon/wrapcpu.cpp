@@ -0,0 +1,368 @@
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(__linux)
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#include <boost/algorithm/string.hpp>
+#include <boost/filesystem.hpp>
+
+#include <fstream>
+#include <map>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "wrapcpu.h"
+#include "wraphelper.h"
+
+using namespace std;
+
+#if defined(__linux)
+
+static string getFileContentString(const string& filename)
+{
+    ifstream ifs(filename, ios::binary);
+    string line;
+    getline(ifs, line);
+    boost::trim(line);
+    return line;
+}
+
+static bool getFdContentValue(int fd, unsigned long long& value)
+{
+    char buf[32];
+    ssize_t n = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (n <= 0)
+        return false;
+    buf[n] = 0;
+    char* p2;
+    errno = 0;
+    value = strtoull(buf, &p2, 10);
+    return (errno == 0 && p2 != buf);
+}
+
+static double monotonicSeconds()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Choose the hwmon input which best represents package temperature.
+// Coretemp labels it with the physical package id, returned in _physId
+// (-1 when unknown, as with k10temp)
+static string selectTempInput(const boost::filesystem::path& hwmon_dir, int& _physId)
+{
+    _physId = -1;
+    namespace fs = boost::filesystem;
+    static const char* labels[] = {"Package id", "Tdie", "Tctl"};
+    for (auto label : labels)
+    {
+        for (fs::directory_iterator ent(hwmon_dir); ent != fs::directory_iterator(); ++ent)
+        {
+            string fname = ent->path().filename().string();
+            if (fname.size() < 11 || fname.compare(0, 4, "temp") ||
+                fname.compare(fname.size() - 6, 6, "_label"))
+                continue;
+            string text = getFileContentString(ent->path().string());
+            if (text.compare(0, strlen(label), label))
+                continue;
+            if (text.size() > strlen(label))
+                _physId = atoi(text.c_str() + strlen(label));
+            return (hwmon_dir / (fname.substr(0, fname.size() - 6) + "_input")).string();
+        }
+    }
+    return (hwmon_dir / "temp1_input").string();
+}
+
+#endif
+
+wrap_cpu_handle* wrap_cpu_create(const char* sysfs_root)
+{
+    wrap_cpu_handle* cpuh = nullptr;
+
+#if defined(__linux)
+    namespace fs = boost::filesystem;
+    fs::path root(sysfs_root && *sysfs_root ? sysfs_root : "/sys");
+
+    // Map logical cpus to their physical package
+    fs::path cpu_dir = root / "devices/system/cpu";
+    if (!fs::exists(cpu_dir) || !fs::is_directory(cpu_dir))
+        return nullptr;
+
+    regex cpuPattern("^cpu[0-9]{1,}$");
+    map<int, int> cpus;      // logical cpu -> physical package id
+    map<int, int> packages;  // physical package id -> package index
+    for (fs::directory_iterator dirEnt(cpu_dir); dirEnt != fs::directory_iterator(); ++dirEnt)
+    {
+        string cpuName = dirEnt->path().filename().string();
+        if (!regex_match(cpuName, cpuPattern))
+            continue;
+        int physId = 0;
+        string s = getFileContentString((dirEnt->path() / "topology/physical_package_id").string());
+        if (!s.empty())
+            physId = stoi(s);
+        cpus[stoi(cpuName.substr(3))] = physId;
+        packages[physId] = 0;
+    }
+    if (!cpus.size())
+        return nullptr;
+
+    int pkgCount = 0;
+    for (auto& p : packages)
+        p.second = pkgCount++;
+
+    cpuh = (wrap_cpu_handle*)calloc(1, sizeof(wrap_cpu_handle));
+    if (cpuh == nullptr)
+    {
+        cwarn << "Failed allocate memory";
+        cwarn << "CPU hardware monitoring disabled";
+        return cpuh;
+    }
+    cpuh->cpu_count = cpus.rbegin()->first + 1;
+    cpuh->cpu_package = (int*)calloc(cpuh->cpu_count, sizeof(int));
+    cpuh->package_count = pkgCount;
+    cpuh->pkg_energy_fd = (int*)calloc(pkgCount, sizeof(int));
+    cpuh->pkg_energy_range = (unsigned long long*)calloc(pkgCount, sizeof(unsigned long long));
+    cpuh->pkg_energy_last = (unsigned long long*)calloc(pkgCount, sizeof(unsigned long long));
+    cpuh->pkg_energy_tstamp = (double*)calloc(pkgCount, sizeof(double));
+    cpuh->pkg_milliwatts = (unsigned int*)calloc(pkgCount, sizeof(unsigned int));
+    cpuh->pkg_temp_fd = (int*)calloc(pkgCount, sizeof(int));
+    cpuh->pkg_tempC = (unsigned int*)calloc(pkgCount, sizeof(unsigned int));
+    cpuh->pkg_miners = (unsigned int*)calloc(pkgCount, sizeof(unsigned int));
+    if (!cpuh->cpu_package || !cpuh->pkg_energy_fd || !cpuh->pkg_energy_range ||
+        !cpuh->pkg_energy_last || !cpuh->pkg_energy_tstamp || !cpuh->pkg_milliwatts ||
+        !cpuh->pkg_temp_fd || !cpuh->pkg_tempC || !cpuh->pkg_miners)
+    {
+        cwarn << "Failed allocate memory";
+        cwarn << "CPU hardware monitoring disabled";
+        cpuh->package_count = 0;  // No descriptors to close
+        wrap_cpu_destroy(cpuh);
+        return nullptr;
+    }
+
+    for (int i = 0; i < cpuh->cpu_count; i++)
+        cpuh->cpu_package[i] = cpus.count(i) ? packages[cpus[i]] : -1;
+    for (int i = 0; i < pkgCount; i++)
+        cpuh->pkg_energy_fd[i] = cpuh->pkg_temp_fd[i] = -1;
+
+    bool haveSensors = false;
+
+    // Package energy counters (intel-rapl is also used by AMD Zen)
+    fs::path rapl_dir = root / "class/powercap";
+    if (fs::exists(rapl_dir) && fs::is_directory(rapl_dir))
+    {
+        regex raplPattern("^intel-rapl:[0-9]{1,}$");
+        bool denied = false;
+        for (fs::directory_iterator dirEnt(rapl_dir); dirEnt != fs::directory_iterator();
+             ++dirEnt)
+        {
+            if (!regex_match(dirEnt->path().filename().string(), raplPattern))
+                continue;
+
+            // Top level zones are named package-<physical id>
+            string name = getFileContentString((dirEnt->path() / "name").string());
+            if (name.compare(0, 8, "package-"))
+                continue;
+            auto pkg = packages.find(atoi(name.substr(8).c_str()));
+            if (pkg == packages.end())
+                continue;
+
+            int fd = open((dirEnt->path() / "energy_uj").string().c_str(), O_RDONLY);
+            if (fd < 0)
+            {
+                denied = denied || (errno == EACCES);
+                continue;
+            }
+            int idx = pkg->second;
+            cpuh->pkg_energy_fd[idx] = fd;
+            cpuh->pkg_energy_range[idx] = strtoull(
+                getFileContentString((dirEnt->path() / "max_energy_range_uj").string()).c_str(),
+                nullptr, 10);
+            haveSensors = true;
+        }
+        if (denied)
+            cwarn << "No permission to read RAPL energy counters. CPU power monitoring disabled";
+    }
+
+    // Package temperatures. Coretemp tells which package it monitors, otherwise
+    // n-th instance (ordered by hwmonN) is taken for n-th package left
+    fs::path hwmon_dir = root / "class/hwmon";
+    if (fs::exists(hwmon_dir) && fs::is_directory(hwmon_dir))
+    {
+        regex hwmonPattern("^hwmon[0-9]{1,}$");
+        map<int, fs::path> sensors;
+        for (fs::directory_iterator dirEnt(hwmon_dir); dirEnt != fs::directory_iterator();
+             ++dirEnt)
+        {
+            string hwmonName = dirEnt->path().filename().string();
+            if (!regex_match(hwmonName, hwmonPattern))
+                continue;
+            string name = getFileContentString((dirEnt->path() / "name").string());
+            if (name == "coretemp" || name == "k10temp")
+                sensors[stoi(hwmonName.substr(5))] = dirEnt->path();
+        }
+
+        vector<string> unknown;  // Inputs of instances with no package id
+        for (auto const& sensor : sensors)
+        {
+            int physId;
+            string input = selectTempInput(sensor.second, physId);
+            if (physId < 0)
+            {
+                unknown.push_back(input);
+                continue;
+            }
+            auto pkg = packages.find(physId);
+            if (pkg == packages.end() || cpuh->pkg_temp_fd[pkg->second] >= 0)
+                continue;
+            int fd = open(input.c_str(), O_RDONLY);
+            if (fd < 0)
+                continue;
+            cpuh->pkg_temp_fd[pkg->second] = fd;
+            haveSensors = true;
+        }
+
+        int idx = 0;
+        for (auto const& input : unknown)
+        {
+            while (idx < pkgCount && cpuh->pkg_temp_fd[idx] >= 0)
+                idx++;
+            if (idx >= pkgCount)
+                break;
+            int fd = open(input.c_str(), O_RDONLY);
+            if (fd < 0)
+                continue;
+            cpuh->pkg_temp_fd[idx++] = fd;
+            haveSensors = true;
+        }
+    }
+
+    if (!haveSensors)
+    {
+        cwarn << "Failed to obtain any CPU sensor";
+        cwarn << "CPU hardware monitoring disabled";
+        wrap_cpu_destroy(cpuh);
+        return nullptr;
+    }
+
+    // Prime energy counters
+    wrap_cpu_sample(cpuh);
+
+#else
+    (void)sysfs_root;
+#endif
+    return cpuh;
+}
+
+int wrap_cpu_destroy(wrap_cpu_handle* cpuh)
+{
+#if defined(__linux)
+    for (int i = 0; i < cpuh->package_count; i++)
+    {
+        if (cpuh->pkg_energy_fd[i] >= 0)
+            close(cpuh->pkg_energy_fd[i]);
+        if (cpuh->pkg_temp_fd[i] >= 0)
+            close(cpuh->pkg_temp_fd[i]);
+    }
+#endif
+    free(cpuh->cpu_package);
+    free(cpuh->pkg_energy_fd);
+    free(cpuh->pkg_energy_range);
+    free(cpuh->pkg_energy_last);
+    free(cpuh->pkg_energy_tstamp);
+    free(cpuh->pkg_milliwatts);
+    free(cpuh->pkg_temp_fd);
+    free(cpuh->pkg_tempC);
+    free(cpuh->pkg_miners);
+    free(cpuh);
+    return 0;
+}
+
+int wrap_cpu_get_cpucount(wrap_cpu_handle* cpuh, int* cpucount)
+{
+    *cpucount = cpuh->cpu_count;
+    return 0;
+}
+
+int wrap_cpu_attach(wrap_cpu_handle* cpuh, int cpu)
+{
+    if (cpu < 0 || cpu >= cpuh->cpu_count || cpuh->cpu_package[cpu] < 0)
+        return -1;
+    cpuh->pkg_miners[cpuh->cpu_package[cpu]]++;
+    return 0;
+}
+
+int wrap_cpu_detach_all(wrap_cpu_handle* cpuh)
+{
+    for (int i = 0; i < cpuh->package_count; i++)
+        cpuh->pkg_miners[i] = 0;
+    return 0;
+}
+
+int wrap_cpu_sample(wrap_cpu_handle* cpuh)
+{
+#if defined(__linux)
+    for (int i = 0; i < cpuh->package_count; i++)
+    {
+        unsigned long long value;
+        if (cpuh->pkg_temp_fd[i] >= 0 && getFdContentValue(cpuh->pkg_temp_fd[i], value))
+            cpuh->pkg_tempC[i] = (unsigned int)(value / 1000);
+
+        if (cpuh->pkg_energy_fd[i] >= 0 && getFdContentValue(cpuh->pkg_energy_fd[i], value))
+        {
+            double now = monotonicSeconds();
+            if (cpuh->pkg_energy_tstamp[i] > 0.0)
+            {
+                // Energy counter wraps at max_energy_range_uj
+                unsigned long long delta =
+                    (value >= cpuh->pkg_energy_last[i]) ?
+                        value - cpuh->pkg_energy_last[i] :
+                        cpuh->pkg_energy_range[i] - cpuh->pkg_energy_last[i] + value;
+                double elapsed = now - cpuh->pkg_energy_tstamp[i];
+                if (elapsed > 0.0)
+                    cpuh->pkg_milliwatts[i] = (unsigned int)(delta / elapsed / 1000.0);
+            }
+            cpuh->pkg_energy_last[i] = value;
+            cpuh->pkg_energy_tstamp[i] = now;
+        }
+    }
+    return 0;
+#else
+    (void)cpuh;
+    return -1;
+#endif
+}
+
+int wrap_cpu_get_tempC(wrap_cpu_handle* cpuh, int cpu, unsigned int* tempC)
+{
+    if (cpu < 0 || cpu >= cpuh->cpu_count || cpuh->cpu_package[cpu] < 0)
+        return -1;
+
+    int pkg = cpuh->cpu_package[cpu];
+    if (cpuh->pkg_temp_fd[pkg] < 0)
+        return -1;
+
+    *tempC = cpuh->pkg_tempC[pkg];
+    return 0;
+}
+
+int wrap_cpu_get_power_usage(wrap_cpu_handle* cpuh, int cpu, unsigned int* milliwatts)
+{
+    if (cpu < 0 || cpu >= cpuh->cpu_count || cpuh->cpu_package[cpu] < 0)
+        return -1;
+
+    int pkg = cpuh->cpu_package[cpu];
+    if (cpuh->pkg_energy_fd[pkg] < 0)
+        return -1;
+
+    // Package drain is evenly split among miners working on it
+    unsigned int miners = cpuh->pkg_miners[pkg] ? cpuh->pkg_miners[pkg] : 1;
+    *milliwatts = cpuh->pkg_milliwatts[pkg] / miners;
+    return 0;
+}
@@ -0,0 +1,42 @@
+
+#pragma once
+
+/*
+ * CPU monitoring through Linux sysfs.
+ * Energy comes from powercap/RAPL package counters, temperature from
+ * coretemp (Intel) or k10temp (AMD) hwmon drivers. Both are per package
+ * so readings are shared among all logical cpus of the same package.
+ * All sensors are read in one pass by wrap_cpu_sample(); getters return
+ * values from the last pass.
+ */
+typedef struct
+{
+    int cpu_count;                         // Number of logical cpus
+    int* cpu_package;                      // Package of each logical cpu
+    int package_count;                     // Number of packages
+    int* pkg_energy_fd;                    // RAPL energy_uj (-1 if not available)
+    unsigned long long* pkg_energy_range;  // RAPL max_energy_range_uj (wrap point)
+    unsigned long long* pkg_energy_last;   // Energy counter at last sample
+    double* pkg_energy_tstamp;             // Monotonic time (seconds) of last sample
+    unsigned int* pkg_milliwatts;          // Average power drain between last two samples
+    int* pkg_temp_fd;                      // hwmon temp input (-1 if not available)
+    unsigned int* pkg_tempC;               // Temperature at last sample
+    unsigned int* pkg_miners;              // Number of miners attached on each package
+} wrap_cpu_handle;
+
+wrap_cpu_handle* wrap_cpu_create(const char* sysfs_root);
+int wrap_cpu_destroy(wrap_cpu_handle* cpuh);
+
+int wrap_cpu_get_cpucount(wrap_cpu_handle* cpuh, int* cpucount);
+
+// Accounts a miner working on given logical cpu so the power drain
+// of its package can be split among all miners sharing it
+int wrap_cpu_attach(wrap_cpu_handle* cpuh, int cpu);
+int wrap_cpu_detach_all(wrap_cpu_handle* cpuh);
+
+// Reads all sensors of all packages
+int wrap_cpu_sample(wrap_cpu_handle* cpuh);
+
+int wrap_cpu_get_tempC(wrap_cpu_handle* cpuh, int cpu, unsigned int* tempC);
+
+int wrap_cpu_get_power_usage(wrap_cpu_handle* cpuh, int cpu, unsigned int* milliwatts);
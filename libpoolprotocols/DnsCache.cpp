@@ -0,0 +1,144 @@
+
+#include <boost/bind/bind.hpp>
+
+#include <libdevcore/Log.h>
+
+#include "DnsCache.h"
+
+using namespace std;
+using namespace boost::placeholders;
+using boost::asio::ip::tcp;
+
+namespace dev
+{
+namespace eth
+{
+// Interval (seconds) among checks for entries to refresh
+static const unsigned c_refreshCheck = 5;
+
+// Delay (seconds) before retrying a failed resolution
+static const unsigned c_retryDelay = 15;
+
+DnsCache* DnsCache::m_this = nullptr;
+
+DnsCache::DnsCache(unsigned _ttl)
+  : m_ttl(_ttl), m_io_strand(g_io_service), m_refreshtimer(g_io_service)
+{
+    m_this = this;
+}
+
+void DnsCache::watch(const string& _host, unsigned short _port)
+{
+    g_io_service.post(m_io_strand.wrap(boost::bind(&DnsCache::doWatch, this, _host, _port)));
+}
+
+void DnsCache::resolve(const string& _host, unsigned short _port, Handler _handler)
+{
+    g_io_service.post(
+        m_io_strand.wrap(boost::bind(&DnsCache::doResolve, this, _host, _port, _handler)));
+}
+
+DnsCache::Entry& DnsCache::entry(const string& _host, unsigned short _port)
+{
+    Entry& e = m_entries[_host + ":" + to_string(_port)];
+    e.host = _host;
+    e.port = _port;
+    return e;
+}
+
+void DnsCache::doWatch(string _host, unsigned short _port)
+{
+    Entry& e = entry(_host, _port);
+    if (e.endpoints.empty() && !e.resolver)
+        startResolve(e);
+
+    // Timer is armed as soon as there's something to watch
+    if (!m_refreshing)
+    {
+        m_refreshing = true;
+        refreshtimer_elapsed(boost::system::error_code());
+    }
+}
+
+void DnsCache::doResolve(string _host, unsigned short _port, Handler _handler)
+{
+    Entry& e = entry(_host, _port);
+    if (e.endpoints.empty())
+    {
+        // Never resolved : wait for it
+        e.waiting.push_back(_handler);
+        if (!e.resolver)
+            startResolve(e);
+        return;
+    }
+
+    // Current or stale these are the best addresses we have
+    if (!e.resolver && chrono::steady_clock::now() >= e.refresh)
+        startResolve(e);
+    _handler(boost::system::error_code(), e.endpoints);
+}
+
+void DnsCache::startResolve(Entry& _entry)
+{
+    _entry.resolver = make_shared<tcp::resolver>(g_io_service);
+    tcp::resolver::query q(_entry.host, to_string(_entry.port));
+    _entry.resolver->async_resolve(
+        q, m_io_strand.wrap(boost::bind(&DnsCache::resolve_handler, this, _1, _2,
+               _entry.host + ":" + to_string(_entry.port))));
+}
+
+void DnsCache::resolve_handler(
+    const boost::system::error_code& ec, tcp::resolver::iterator i, string _key)
+{
+    Entry& e = m_entries[_key];
+    e.resolver = nullptr;
+    auto now = chrono::steady_clock::now();
+
+    if (!ec && i != tcp::resolver::iterator())
+    {
+        e.endpoints.clear();
+        for (; i != tcp::resolver::iterator(); i++)
+            e.endpoints.push_back(i->endpoint());
+        e.resolved = now;
+        e.refresh = now + chrono::seconds(m_ttl);
+    }
+    else
+    {
+        e.refresh = now + chrono::seconds(c_retryDelay);
+        if (e.endpoints.empty())
+            cwarn << "Could not resolve host " << e.host << ", " << ec.message();
+        else
+            cwarn << "Could not resolve host " << e.host << ", " << ec.message()
+                  << ". Using addresses resolved "
+                  << chrono::duration_cast<chrono::seconds>(now - e.resolved).count()
+                  << " seconds ago";
+    }
+
+    vector<Handler> waiting;
+    waiting.swap(e.waiting);
+    for (auto& handler : waiting)
+    {
+        if (e.endpoints.empty())
+            handler(ec ? ec : boost::asio::error::host_not_found, e.endpoints);
+        else
+            handler(boost::system::error_code(), e.endpoints);
+    }
+}
+
+void DnsCache::refreshtimer_elapsed(const boost::system::error_code& ec)
+{
+    if (ec)
+        return;
+
+    auto now = chrono::steady_clock::now();
+    for (auto& e : m_entries)
+        if (!e.second.resolver && now >= e.second.refresh)
+            startResolve(e.second);
+
+    m_refreshtimer.expires_from_now(boost::posix_time::seconds(c_refreshCheck));
+    m_refreshtimer.async_wait(m_io_strand.wrap(
+        boost::bind(&DnsCache::refreshtimer_elapsed, this, boost::asio::placeholders::error)));
+}
+
+}  // namespace eth
+}  // namespace dev
@@ -0,0 +1,70 @@
+
+#pragma once
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+extern boost::asio::io_service g_io_service;
+
+namespace dev
+{
+namespace eth
+{
+/**
+ * @brief Keeps the addresses of pool hosts resolved in background.
+ * Connections get the addresses known for their host right away while
+ * entries past their time to live are refreshed. Should the resolver
+ * fail, last known addresses keep being served.
+ */
+class DnsCache
+{
+public:
+    typedef std::function<void(
+        const boost::system::error_code&, const std::vector<boost::asio::ip::tcp::endpoint>&)>
+        Handler;
+
+    DnsCache(unsigned _ttl);
+    static DnsCache& d() { return *m_this; }
+
+    // Resolves host and keeps it resolved
+    void watch(const std::string& _host, unsigned short _port);
+
+    // Invokes handler with the addresses of host. Only waits for the
+    // resolver when host has never been resolved before.
+    void resolve(const std::string& _host, unsigned short _port, Handler _handler);
+
+private:
+    struct Entry
+    {
+        std::string host;
+        unsigned short port = 0;
+        std::vector<boost::asio::ip::tcp::endpoint> endpoints;
+        std::chrono::steady_clock::time_point resolved;  // When endpoints were obtained
+        std::chrono::steady_clock::time_point refresh;   // When to resolve again
+        std::shared_ptr<boost::asio::ip::tcp::resolver> resolver;  // Set while resolving
+        std::vector<Handler> waiting;  // Handlers waiting for first resolution
+    };
+
+    Entry& entry(const std::string& _host, unsigned short _port);
+    void doWatch(std::string _host, unsigned short _port);
+    void doResolve(std::string _host, unsigned short _port, Handler _handler);
+    void startResolve(Entry& _entry);
+    void resolve_handler(const boost::system::error_code& ec,
+        boost::asio::ip::tcp::resolver::iterator i, std::string _key);
+    void refreshtimer_elapsed(const boost::system::error_code& ec);
+
+    unsigned m_ttl;  // Seconds resolved addresses are considered current
+    std::map<std::string, Entry> m_entries;  // Keyed by host:port
+    boost::asio::io_service::strand m_io_strand;
+    boost::asio::deadline_timer m_refreshtimer;
+    bool m_refreshing = false;  // Whether refresh timer is armed
+    static DnsCache* m_this;
+};
+
+}  // namespace eth
+}  // namespace dev
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+namespace dev
+{
+// Distribution of response times over exponentially sized buckets
+// (5ms, 10ms, 20ms ... 10.24s and above)
+class LatencyHistogram
+{
+public:
+    static constexpr unsigned Buckets = 12;
+
+    // Upper bound (milliseconds) of bucket _i
+    static unsigned bound(unsigned _i) { return 5u << _i; }
+
+    void record(std::chrono::milliseconds const& _delay)
+    {
+        unsigned ms = unsigned(std::max<int64_t>(_delay.count(), 0));
+        unsigned i = 0;
+        while (i < Buckets && ms > bound(i))
+            i++;
+        m_counts[i]++;
+        m_count++;
+        m_sum += ms;
+        m_max = std::max(m_max, ms);
+    }
+
+    void recordTimeout() { m_timeouts++; }
+
+    unsigned count() const { return m_count; }
+    unsigned timeouts() const { return m_timeouts; }
+    unsigned max() const { return m_max; }
+    unsigned mean() const { return m_count ? unsigned(m_sum / m_count) : 0; }
+
+    // Estimate of _p (0..1) percentile, interpolated within the
+    // bucket it falls in and never above the slowest response seen
+    unsigned percentile(double _p) const
+    {
+        if (!m_count)
+            return 0;
+        double rank = std::max(_p * m_count, 1.0);
+        unsigned seen = 0;
+        for (unsigned i = 0; i <= Buckets; i++)
+        {
+            if (seen + m_counts[i] >= rank)
+            {
+                double lower = i ? bound(i - 1) : 0;
+                double upper = std::min(i < Buckets ? bound(i) : m_max, m_max);
+                return unsigned(lower + (upper - lower) * (rank - seen) / m_counts[i]);
+            }
+            seen += m_counts[i];
+        }
+        return m_max;
+    }
+
+    // Halves the weight of what has been recorded so far
+    // so that recent samples prevail
+    void decay()
+    {
+        unsigned count = m_count;
+        m_count = 0;
+        for (unsigned& c : m_counts)
+        {
+            c /= 2;
+            m_count += c;
+        }
+        m_sum = count ? m_sum * m_count / count : 0;
+        m_timeouts /= 2;
+        if (!m_count)
+            m_max = 0;
+    }
+
+    void reset() { *this = LatencyHistogram(); }
+
+private:
+    unsigned m_counts[Buckets + 1] = {};
+    unsigned m_count = 0;
+    unsigned m_timeouts = 0;
+    unsigned m_max = 0;
+    uint64_t m_sum = 0;
+};
+
+}  // namespace dev
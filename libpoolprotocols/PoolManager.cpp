@@ -9,12 +9,59 @@ using namespace eth;
 
 PoolManager* PoolManager::m_this = nullptr;
 
+// Delay (seconds) between first connection probes and first ranking
+static const unsigned c_firstRankDelay = 30;
+
+// A connection must score this much better than primary to replace it
+static const double c_rankMargin = 1.25;
+
+// Max number of solutions held while waiting for connection
+static const size_t c_maxPendingSolutions = 16;
+
+namespace
+{
+Json::Value latencyJson(LatencyHistogram const& _latency)
+{
+    Json::Value jRes;
+    jRes["count"] = _latency.count();
+    jRes["timeouts"] = _latency.timeouts();
+    jRes["mean"] = _latency.mean();
+    jRes["p50"] = _latency.percentile(0.50);
+    jRes["p90"] = _latency.percentile(0.90);
+    jRes["p99"] = _latency.percentile(0.99);
+    jRes["max"] = _latency.max();
+    return jRes;
+}
+
+// Extranonce the pool assigned to a session, as found in the nonce
+// range of any work derived from its jobs. 0 if none
+uint64_t extraNonce(WorkPackage const& _wp)
+{
+    if (!_wp.exSizeBytes)
+        return 0;
+    return _wp.startNonce >> (64 - min<unsigned>(_wp.exSizeBytes, 16) * 4);
+}
+
+// State shared among the connects to all addresses of a probed host
+struct Probe
+{
+    shared_ptr<URI> conn;
+    chrono::steady_clock::time_point started;
+    unsigned pending = 0;
+    bool connected = false;
+};
+
+}  // namespace
+
 PoolManager::PoolManager(PoolSettings _settings)
   : m_Settings(move(_settings)),
     m_io_strand(g_io_service),
     m_failovertimer(g_io_service),
     m_submithrtimer(g_io_service),
     m_reconnecttimer(g_io_service),
+    m_standbytimer(g_io_service),
+    m_ranktimer(g_io_service),
+    m_dnsCache(m_Settings.dnsTtl),
     m_lastBlock(-1)
 {
     m_this = this;
@@ -36,18 +83,14 @@ PoolManager::PoolManager(PoolSettings _settings)
 
     Farm::f().onSolutionFound([&](const Solution& sol) {
         // Solution should passthrough only if client is
-        // properly connected. Otherwise we'll have the bad behavior
-        // to log nonce submission but receive no response
+        // properly connected and got a job in this session.
+        // Otherwise we'll have the bad behavior to log nonce
+        // submission but receive no response
 
-        if (p_client && p_client->isConnected())
-        {
+        if (p_client && p_client->isConnected() && m_currentWp)
             p_client->submitSolution(sol);
-        }
         else
-        {
-            cnote << string(EthOrange "Solution 0x") + toHex(sol.nonce)
-                  << " wasted. Waiting for connection...";
-        }
+            queueSolution(sol);
 
         return false;
     });
@@ -55,153 +98,564 @@ PoolManager::PoolManager(PoolSettings _settings)
 
 void PoolManager::setClientHandlers()
 {
-    p_client->onConnected([&]() {
-        {
-            cnote << "Established connection to " << m_selectedHost;
-            m_connectionAttempt = 0;
+    p_client->onConnected([&]() { clientConnected(); });
+    p_client->onDisconnected([&]() { clientDisconnected(); });
+    p_client->onWorkReceived([&](WorkPackage const& wp) { clientWorkReceived(wp); });
 
-            // Reset current WorkPackage
-            m_currentWp.job.clear();
-            m_currentWp.header = h256();
+    p_client->onSolutionAccepted(
+        [&](chrono::milliseconds const& _responseDelay, unsigned const& _minerIdx, bool _asStale) {
+            stringstream ss;
+            ss << setw(4) << setfill(' ') << _responseDelay.count() << " ms. " << m_selectedHost;
+            cnote << EthLime "**Accepted" << (_asStale ? " stale": "") << EthReset << ss.str();
+            p_client->getConnection()->addSolution(true, _asStale);
+            if (_minerIdx >= ExternalMinerBase)
+            {
+                if (m_onExternalSolution)
+                    m_onExternalSolution(_minerIdx, true);
+            }
+            else
+                Farm::f().accountSolution(_minerIdx, SolutionAccountingEnum::Accepted);
+        });
 
-            // Rough implementation to return to primary pool
-            // after specified amount of time
-            if (m_activeConnectionIdx != 0 && m_Settings.poolFailoverTimeout)
+    p_client->onSolutionRejected(
+        [&](chrono::milliseconds const& _responseDelay, unsigned const& _minerIdx) {
+            stringstream ss;
+            ss << setw(4) << setfill(' ') << _responseDelay.count() << " ms. " << m_selectedHost;
+            cwarn << EthRed "**Rejected" EthReset << ss.str();
+            p_client->getConnection()->addSolution(false, false);
+            if (_minerIdx >= ExternalMinerBase)
             {
-                m_failovertimer.expires_from_now(
-                    boost::posix_time::minutes(m_Settings.poolFailoverTimeout));
-                m_failovertimer.async_wait(m_io_strand.wrap(boost::bind(
-                    &PoolManager::failovertimer_elapsed, this, boost::asio::placeholders::error)));
+                if (m_onExternalSolution)
+                    m_onExternalSolution(_minerIdx, false);
             }
             else
-                m_failovertimer.cancel();
-        }
+                Farm::f().accountSolution(_minerIdx, SolutionAccountingEnum::Rejected);
+        });
+}
+
+void PoolManager::clientConnected()
+{
+    {
+        cnote << "Established connection to " << m_selectedHost;
+        m_connectionAttempt = 0;
 
-        if (!Farm::f().isMining())
+        // Solutions for jobs of other pools can't be replayed here
+        discardSolutions(p_client->getConnection());
+
+        // Reset current WorkPackage
+        m_currentWp.job.clear();
+        m_currentWp.header = h256();
+        m_lastJobStamp = chrono::steady_clock::time_point();
+
+        // Rough implementation to return to primary pool
+        // after specified amount of time
+        if (m_activeConnectionIdx != 0 && m_Settings.poolFailoverTimeout)
         {
-            cnote << "Spinning up miners...";
-            Farm::f().start();
+            m_failovertimer.expires_from_now(
+                boost::posix_time::minutes(m_Settings.poolFailoverTimeout));
+            m_failovertimer.async_wait(m_io_strand.wrap(boost::bind(
+                &PoolManager::failovertimer_elapsed, this, boost::asio::placeholders::error)));
         }
-        else if (Farm::f().paused())
+        else
+            m_failovertimer.cancel();
+    }
+
+    if (!Farm::f().isMining())
+    {
+        cnote << "Spinning up miners...";
+        Farm::f().start();
+    }
+    else if (Farm::f().paused())
+    {
+        cnote << "Resume mining ...";
+        Farm::f().resume();
+    }
+
+    // Activate timing for HR submission
+    if (m_Settings.reportHashrate)
+    {
+        m_submithrtimer.expires_from_now(boost::posix_time::seconds(m_Settings.hashRateInterval));
+        m_submithrtimer.async_wait(m_io_strand.wrap(boost::bind(
+            &PoolManager::submithrtimer_elapsed, this, boost::asio::placeholders::error)));
+    }
+
+    // Signal async operations have completed
+    m_async_pending.store(false, memory_order_relaxed);
+
+    // Active connection determines which pool should be held in standby
+    if (m_Settings.hotStandby)
+        g_io_service.post(m_io_strand.wrap(boost::bind(&PoolManager::standbyCheck, this)));
+}
+
+void PoolManager::clientDisconnected()
+{
+    cnote << "Disconnected from " << m_selectedHost;
+
+    // Clear current connection
+    shared_ptr<URI> lost = p_client->getConnection();
+    p_client->unsetConnection();
+    m_currentWp.header = h256();
+
+    // Stop timing actors
+    m_failovertimer.cancel();
+    m_submithrtimer.cancel();
+
+    if (m_stopping.load(memory_order_relaxed))
+    {
+        discardSolutions(nullptr);
+        if (Farm::f().isMining())
         {
-            cnote << "Resume mining ...";
-            Farm::f().resume();
+            cnote << "Shutting down miners...";
+            Farm::f().stop();
         }
+        m_running.store(false, memory_order_relaxed);
+    }
+    else
+    {
+        // Signal we will reconnect async
+        m_async_pending.store(true, memory_order_relaxed);
 
-        // Activate timing for HR submission
-        if (m_Settings.reportHashrate)
+        // Standby takes over if the connection dropped or if it's
+        // the one we've been asked to switch to
+        bool switching = (m_activeConnectionIdx < m_Settings.connections.size() &&
+                          m_Settings.connections[m_activeConnectionIdx] != lost);
+        if (standbyReady() &&
+            (!switching || m_Settings.connections[m_activeConnectionIdx] == m_standbyConn))
         {
-            m_submithrtimer.expires_from_now(boost::posix_time::seconds(m_Settings.hashRateInterval));
-            m_submithrtimer.async_wait(m_io_strand.wrap(boost::bind(
-                &PoolManager::submithrtimer_elapsed, this, boost::asio::placeholders::error)));
+            g_io_service.post(m_io_strand.wrap(boost::bind(&PoolManager::failover, this)));
+            return;
         }
 
-        // Signal async operations have completed
-        m_async_pending.store(false, memory_order_relaxed);
+        // Suspend mining and submit new connection request
+        cnote << "No connection. Suspend mining ...";
+        Farm::f().pause();
+        g_io_service.post(m_io_strand.wrap(boost::bind(&PoolManager::rotateConnect, this)));
+    }
+}
 
-    });
+void PoolManager::clientWorkReceived(WorkPackage const& wp)
+{
+    // Should not happen !
+    if (!wp)
+        return;
 
-    p_client->onDisconnected([&]() {
-        cnote << "Disconnected from " << m_selectedHost;
+    int _currentEpoch = m_currentWp.epoch;
+    bool newEpoch = (_currentEpoch == -1);
 
-        // Clear current connection
-        p_client->unsetConnection();
-        m_currentWp.header = h256();
+    // In EthereumStratum/2.0.0 epoch number is set in session
+    if (!newEpoch)
+    {
+        if (p_client->getConnection()->StratumMode() == 3)
+            newEpoch = (wp.epoch != m_currentWp.epoch);
+        else
+            newEpoch = (wp.seed != m_currentWp.seed);
+    }
+
+    bool newDiff = (wp.boundary != m_currentWp.boundary);
 
-        // Stop timing actors
-        m_failovertimer.cancel();
-        m_submithrtimer.cancel();
+    auto now = chrono::steady_clock::now();
+    if (m_lastJobStamp != chrono::steady_clock::time_point())
+        p_client->getConnection()->JobInterval().record(
+            chrono::duration_cast<chrono::milliseconds>(now - m_lastJobStamp));
+    m_lastJobStamp = now;
 
-        if (m_stopping.load(memory_order_relaxed))
+    m_currentWp = wp;
+    m_workConn = p_client->getConnection();
+
+    if (newEpoch)
+    {
+        m_epochChanges.fetch_add(1, memory_order_relaxed);
+
+        // If epoch is valued in workpackage take it
+        if (wp.epoch == -1)
         {
-            if (Farm::f().isMining())
-            {
-                cnote << "Shutting down miners...";
-                Farm::f().stop();
-            }
-            m_running.store(false, memory_order_relaxed);
+            if (m_currentWp.block >= 0)
+                m_currentWp.epoch = m_currentWp.block / 30000;
+            else
+                m_currentWp.epoch = ethash::find_epoch_number(
+                    ethash::hash256_from_bytes(m_currentWp.seed.data()));
         }
+    }
+    else
+    {
+        m_currentWp.epoch = _currentEpoch;
+    }
+
+    if (newDiff || newEpoch)
+        showMiningAt();
+
+    cnote << "Job: " EthWhite << m_currentWp.header.abridged() << EthGray
+          << (m_currentWp.block != -1 ? " blk: " : "")
+          << (m_lastBlock == m_currentWp.block ? EthGray : EthWhite)
+          << (m_currentWp.block != -1 ? to_string(m_currentWp.block) : "") << EthReset << " "
+          << m_selectedHost;
+    m_lastBlock = m_currentWp.block;
+
+    Farm::f().setWork(farmWork(m_currentWp));
+    if (m_onWorkReceived)
+        m_onWorkReceived(m_currentWp);
+
+    replaySolutions();
+}
+
+WorkPackage PoolManager::farmWork(WorkPackage const& _wp)
+{
+    // Farm's slot goes right after pool's extranonce. Leave it out
+    // should it take the search below 48 bits
+    WorkPackage wp = _wp;
+    if (!m_slotDigits || wp.exSizeBytes + m_slotDigits > 12)
+        return wp;
+
+    uint64_t prefix = (extraNonce(wp) << (m_slotDigits * 4)) | m_slot;
+    wp.exSizeBytes += m_slotDigits;
+    wp.startNonce = prefix << (64 - wp.exSizeBytes * 4);
+    return wp;
+}
+
+void PoolManager::queueSolution(Solution const& _solution)
+{
+    if (!m_workConn || m_stopping.load(memory_order_relaxed))
+    {
+        wasteSolution(_solution, "No connection");
+        return;
+    }
+
+    // Make room dropping the oldest
+    if (m_pendingSolutions.size() >= c_maxPendingSolutions)
+    {
+        wasteSolution(m_pendingSolutions.front().solution, "Queue full");
+        m_pendingSolutions.pop_front();
+    }
+
+    m_pendingSolutions.push_back({_solution, m_workConn});
+    cnote << string(EthOrange "Solution 0x") + toHex(_solution.nonce)
+          << " queued. Waiting for connection...";
+}
+
+void PoolManager::replaySolutions()
+{
+    // Replay only what's still valid on the same pool : same epoch,
+    // same session extranonce (the rest of the start nonce is the one
+    // farm gave the miner) and either same block or, when pool does not
+    // tell block number, same job
+    WorkPackage current = farmWork(m_currentWp);
+    while (!m_pendingSolutions.empty())
+    {
+        PendingSolution pending = m_pendingSolutions.front();
+        m_pendingSolutions.pop_front();
+
+        WorkPackage const& w = pending.solution.work;
+        if (pending.conn != m_workConn)
+            wasteSolution(pending.solution, "Pool changed");
+        else if (w.epoch != current.epoch || w.exSizeBytes != current.exSizeBytes ||
+                 extraNonce(w) != extraNonce(current))
+            wasteSolution(pending.solution, "Session changed");
+        else if ((w.block >= 0 && m_currentWp.block >= 0) ? w.block != m_currentWp.block :
+                                                            w.header != m_currentWp.header)
+            wasteSolution(pending.solution, "Job expired");
         else
         {
-            // Signal we will reconnect async
-            m_async_pending.store(true, memory_order_relaxed);
+            cnote << string(EthOrange "Solution 0x") + toHex(pending.solution.nonce)
+                  << " replayed to " << m_selectedHost;
+            p_client->submitSolution(pending.solution);
+        }
+    }
+}
 
-            // Suspend mining and submit new connection request
-            cnote << "No connection. Suspend mining ...";
-            Farm::f().pause();
-            g_io_service.post(m_io_strand.wrap(boost::bind(&PoolManager::rotateConnect, this)));
+void PoolManager::discardSolutions(shared_ptr<URI> _keep)
+{
+    // Drops pending solutions which can't be replayed on given connection
+    auto it = m_pendingSolutions.begin();
+    while (it != m_pendingSolutions.end())
+    {
+        if (_keep && it->conn == _keep)
+        {
+            it++;
+            continue;
         }
-    });
+        wasteSolution(it->solution, _keep ? "Pool changed" : "No connection");
+        it = m_pendingSolutions.erase(it);
+    }
+}
 
-    p_client->onWorkReceived([&](WorkPackage const& wp) {
+void PoolManager::wasteSolution(Solution const& _solution, string const& _reason)
+{
+    cnote << string(EthOrange "Solution 0x") + toHex(_solution.nonce) << " wasted. " << _reason;
+    Farm::f().accountSolution(_solution.midx, SolutionAccountingEnum::Wasted);
+}
 
-        // Should not happen !
-        if (!wp)
-            return;
+bool PoolManager::submitSolution(Solution const& _solution)
+{
+    if (!p_client || !p_client->isConnected())
+        return false;
+    p_client->submitSolution(_solution);
+    return true;
+}
+
+void PoolManager::failover()
+{
+    if (promoteStandby())
+        return;
+
+    // Standby went away in the meantime
+    cnote << "No connection. Suspend mining ...";
+    Farm::f().pause();
+    rotateConnect();
+}
+
+shared_ptr<URI> PoolManager::standbyCandidate()
+{
+    size_t count = m_Settings.connections.size();
+    if (!m_Settings.hotStandby || count < 2 || m_activeConnectionIdx >= count)
+        return nullptr;
+
+    // While on a failover pool with a failover timeout the primary is the
+    // one we'll want next, otherwise the next one in rotation
+    size_t idx = (m_activeConnectionIdx != 0 && m_Settings.poolFailoverTimeout) ?
+                     0 :
+                     (m_activeConnectionIdx + 1) % count;
+
+    shared_ptr<URI> conn = m_Settings.connections[idx];
+    if (conn == m_Settings.connections[m_activeConnectionIdx] ||
+        conn->Family() != ProtocolFamily::STRATUM || conn->IsUnrecoverable() ||
+        conn->Host() == "exit")
+        return nullptr;
+    return conn;
+}
 
-        int _currentEpoch = m_currentWp.epoch;
-        bool newEpoch = (_currentEpoch == -1);
+bool PoolManager::standbyReady()
+{
+    return (p_standby && p_standby->isConnected() && p_standby->isAuthorized() &&
+            static_cast<bool>(m_standbyWp));
+}
 
-        // In EthereumStratum/2.0.0 epoch number is set in session
-        if (!newEpoch)
+void PoolManager::standbyCheck()
+{
+    if (!m_running.load(memory_order_relaxed) || m_stopping.load(memory_order_relaxed))
+        return;
+
+    shared_ptr<URI> wanted = standbyCandidate();
+    if (p_standby)
+    {
+        // Release a standby which is no longer the one we'd fail over to
+        if (m_standbyConn != wanted && p_standby->isConnected())
         {
-            if (p_client->getConnection()->StratumMode() == 3)
-                newEpoch = (wp.epoch != m_currentWp.epoch);
-            else
-                newEpoch = (wp.seed != m_currentWp.seed);
+            cnote << "Releasing standby connection to " << m_standbyConn->Host();
+            p_standby->disconnect();
         }
+        return;
+    }
 
-        bool newDiff = (wp.boundary != m_currentWp.boundary);
+    if (wanted)
+        standbyConnect(wanted);
+}
 
-        m_currentWp = wp;
+void PoolManager::standbyConnect(shared_ptr<URI> _conn)
+{
+    p_standby = createClient(_conn);
+    if (!p_standby)
+        return;
 
-        if (newEpoch)
-        {
-            m_epochChanges.fetch_add(1, memory_order_relaxed);
+    m_standbyConn = _conn;
+    m_standbyWp = WorkPackage();
+    m_standbyJobStamp = chrono::steady_clock::time_point();
+    m_standbyUp.store(true, memory_order_relaxed);
 
-            // If epoch is valued in workpackage take it
-            if (wp.epoch == -1)
-            {
-                if (m_currentWp.block >= 0)
-                    m_currentWp.epoch = m_currentWp.block / 30000;
-                else
-                    m_currentWp.epoch = ethash::find_epoch_number(
-                        ethash::hash256_from_bytes(m_currentWp.seed.data()));
-            }
-        }
-        else
+    // Standby only keeps its session alive and its job up to date
+    PoolClient* client = p_standby.get();
+    p_standby->onConnected([&]() {
+        cnote << "Standby connection to " << m_standbyConn->Host() << ":"
+              << m_standbyConn->Port() << " established";
+    });
+    p_standby->onDisconnected([&, client]() {
+        g_io_service.post(m_io_strand.wrap(
+            boost::bind(&PoolManager::standbyDisconnected, this, client)));
+    });
+    p_standby->onWorkReceived([&](WorkPackage const& wp) {
+        auto now = chrono::steady_clock::now();
+        if (m_standbyJobStamp != chrono::steady_clock::time_point())
+            m_standbyConn->JobInterval().record(
+                chrono::duration_cast<chrono::milliseconds>(now - m_standbyJobStamp));
+        m_standbyJobStamp = now;
+        m_standbyWp = wp;
+    });
+
+    p_standby->setConnection(_conn);
+    p_standby->connect();
+}
+
+void PoolManager::standbyDisconnected(PoolClient* _client)
+{
+    // Client may have been promoted or released already
+    if (p_standby.get() != _client)
+        return;
+
+    shared_ptr<URI> conn = m_standbyConn;
+    p_standby->unsetConnection();
+    p_standby = nullptr;
+    m_standbyConn = nullptr;
+    m_standbyWp = WorkPackage();
+    m_standbyUp.store(false, memory_order_relaxed);
+
+    if (m_stopping.load(memory_order_relaxed) || !m_running.load(memory_order_relaxed))
+        return;
+
+    // Quickly replace a released standby, give a lost one some time
+    unsigned delay = 1;
+    if (conn == standbyCandidate())
+    {
+        cnote << "Standby connection to " << conn->Host() << " lost";
+        delay = max(m_Settings.delayBeforeRetry, 30u);
+    }
+    m_standbytimer.expires_from_now(boost::posix_time::seconds(delay));
+    m_standbytimer.async_wait(m_io_strand.wrap(boost::bind(
+        &PoolManager::standbytimer_elapsed, this, boost::asio::placeholders::error)));
+}
+
+bool PoolManager::promoteStandby()
+{
+    if (!standbyReady())
+        return false;
+
+    auto it = find(m_Settings.connections.begin(), m_Settings.connections.end(), m_standbyConn);
+    if (it == m_Settings.connections.end())
+        return false;
+
+    // Swap the clients : former active one is already disconnected
+    p_client = move(p_standby);
+    m_standbyConn = nullptr;
+    m_standbyUp.store(false, memory_order_relaxed);
+    WorkPackage wp = m_standbyWp;
+    m_standbyWp = WorkPackage();
+
+    m_activeConnectionIdx = unsigned(it - m_Settings.connections.begin());
+    m_connectionSwitches.fetch_add(1, memory_order_relaxed);
+    m_selectedHost = p_client->getConnection()->Host() + ":" +
+                     to_string(p_client->getConnection()->Port());
+    cnote << "Switched to standby pool " << m_selectedHost;
+
+    setClientHandlers();
+    clientConnected();
+    clientWorkReceived(wp);
+    return true;
+}
+
+void PoolManager::rankConnections()
+{
+    // Don't reorder connections while switching among them
+    if (m_async_pending.load(memory_order_relaxed) || m_Settings.connections.size() < 2 ||
+        m_activeConnectionIdx >= m_Settings.connections.size())
+        return;
+
+    size_t best = 0;
+    double bestScore = -1;
+    for (size_t i = 0; i < m_Settings.connections.size(); i++)
+    {
+        shared_ptr<URI> conn = m_Settings.connections[i];
+        if (conn->Host() == "exit" || conn->IsUnrecoverable())
+            continue;
+        double score = conn->Score();
+        if (score >= 0 && (bestScore < 0 || score < bestScore))
         {
-            m_currentWp.epoch = _currentEpoch;
+            best = i;
+            bestScore = score;
         }
+    }
+    if (bestScore < 0 || best == 0)
+        return;
 
-        if (newDiff || newEpoch)
-            showMiningAt();
+    // Some margin prevents flapping among pools with similar figures
+    double primaryScore = m_Settings.connections[0]->Score();
+    if (primaryScore >= 0 && bestScore * c_rankMargin >= primaryScore)
+        return;
 
-        cnote << "Job: " EthWhite << m_currentWp.header.abridged() << EthGray
-              << (m_currentWp.block != -1 ? " blk: " : "")
-              << (m_lastBlock == m_currentWp.block ? EthGray : EthWhite)
-              << (m_currentWp.block != -1 ? to_string(m_currentWp.block) : "") << EthReset << " "
-              << m_selectedHost;
-        m_lastBlock = m_currentWp.block;
+    // Move best connection in primary position
+    shared_ptr<URI> active = m_Settings.connections[m_activeConnectionIdx];
+    shared_ptr<URI> conn = m_Settings.connections[best];
+    m_Settings.connections.erase(m_Settings.connections.begin() + best);
+    m_Settings.connections.insert(m_Settings.connections.begin(), conn);
+    m_activeConnectionIdx = unsigned(
+        find(m_Settings.connections.begin(), m_Settings.connections.end(), active) -
+        m_Settings.connections.begin());
+    cnote << "Pool " << conn->Host() << ":" << conn->Port() << " ranked first ("
+          << unsigned(bestScore) << " ms)";
+
+    if (m_activeConnectionIdx != 0 && p_client && p_client->isConnected())
+    {
+        m_async_pending.store(true, memory_order_relaxed);
+        m_activeConnectionIdx = 0;
+        m_connectionAttempt = 0;
+        m_connectionSwitches.fetch_add(1, memory_order_relaxed);
+        p_client->disconnect();
+    }
+    else if (m_Settings.hotStandby)
+    {
+        g_io_service.post(m_io_strand.wrap(boost::bind(&PoolManager::standbyCheck, this)));
+    }
+}
 
-        Farm::f().setWork(m_currentWp);
-    });
+void PoolManager::probeConnection(shared_ptr<URI> _conn)
+{
+    using boost::asio::ip::tcp;
 
-    p_client->onSolutionAccepted(
-        [&](chrono::milliseconds const& _responseDelay, unsigned const& _minerIdx, bool _asStale) {
-            stringstream ss;
-            ss << setw(4) << setfill(' ') << _responseDelay.count() << " ms. " << m_selectedHost;
-            cnote << EthLime "**Accepted" << (_asStale ? " stale": "") << EthReset << ss.str();
-            Farm::f().accountSolution(_minerIdx, SolutionAccountingEnum::Accepted);
-        });
+    if (_conn->Family() == ProtocolFamily::SIMULATION || _conn->Host() == "exit" ||
+        _conn->HostNameType() == UriHostNameType::Local)
+        return;
 
-    p_client->onSolutionRejected(
-        [&](chrono::milliseconds const& _responseDelay, unsigned const& _minerIdx) {
-            stringstream ss;
-            ss << setw(4) << setfill(' ') << _responseDelay.count() << " ms. " << m_selectedHost;
-            cwarn << EthRed "**Rejected" EthReset << ss.str();
-            Farm::f().accountSolution(_minerIdx, SolutionAccountingEnum::Rejected);
-        });
+    // Time plain tcp connects to every address of the host. Fastest
+    // one counts for the connection as a whole. Addresses come from the
+    // cache : a resolver failure says nothing about the pool itself
+    // thus isn't held against it
+    m_dnsCache.resolve(_conn->Host(), _conn->Port(),
+        m_io_strand.wrap([this, _conn](const boost::system::error_code& ec,
+                             const vector<tcp::endpoint>& endpoints) {
+            if (ec || endpoints.empty())
+                return;
+
+            auto probe = make_shared<Probe>();
+            probe->conn = _conn;
+            probe->started = chrono::steady_clock::now();
+            for (const tcp::endpoint& ep : endpoints)
+            {
+                auto socket = make_shared<tcp::socket>(g_io_service);
+                auto timer = make_shared<boost::asio::deadline_timer>(g_io_service);
+                string endpoint = toString(ep);
+                probe->pending++;
+
+                socket->async_connect(ep,
+                    m_io_strand.wrap([probe, socket, timer, endpoint](
+                                         const boost::system::error_code& ec) {
+                        timer->cancel();
+                        probe->pending--;
+                        if (ec)
+                        {
+                            probe->conn->recordEndpointTimeout(endpoint);
+                        }
+                        else
+                        {
+                            auto delay = chrono::duration_cast<chrono::milliseconds>(
+                                chrono::steady_clock::now() - probe->started);
+                            probe->conn->recordEndpoint(endpoint, delay);
+                            if (!probe->connected)
+                                probe->conn->ConnectLatency().record(delay);
+                            probe->connected = true;
+                            boost::system::error_code cec;
+                            socket->close(cec);
+                        }
+                        if (!probe->pending && !probe->connected)
+                            probe->conn->ConnectLatency().recordTimeout();
+                    }));
+
+                timer->expires_from_now(boost::posix_time::seconds(m_Settings.noResponseTimeout));
+                timer->async_wait(m_io_strand.wrap([socket](const boost::system::error_code& ec) {
+                    if (!ec)
+                    {
+                        boost::system::error_code cec;
+                        socket->close(cec);
+                    }
+                }));
+            }
+        }));
 }
 
 void PoolManager::stop()
@@ -211,6 +665,21 @@ void PoolManager::stop()
         m_async_pending.store(true, memory_order_relaxed);
         m_stopping.store(true, memory_order_relaxed);
 
+        m_standbytimer.cancel();
+        m_ranktimer.cancel();
+        if (m_standbyUp.load(memory_order_relaxed))
+        {
+            // Connected or still connecting, standby reports once all its
+            // async operations are over and gets released by
+            // standbyDisconnected(). Only then it's safe to go on
+            g_io_service.post(m_io_strand.wrap([this]() {
+                if (p_standby)
+                    p_standby->disconnect();
+            }));
+            while (m_standbyUp.load(memory_order_relaxed))
+                this_thread::sleep_for(chrono::milliseconds(100));
+        }
+
         if (p_client && p_client->isConnected())
         {
             p_client->disconnect();
@@ -238,12 +707,15 @@ void PoolManager::stop()
 
 void PoolManager::addConnection(string _connstring)
 {
-    m_Settings.connections.push_back(shared_ptr<URI>(new URI(_connstring)));
+    addConnection(shared_ptr<URI>(new URI(_connstring)));
 }
 
 void PoolManager::addConnection(shared_ptr<URI> _uri)
 {
     m_Settings.connections.push_back(_uri);
+    watchConnection(_uri);
+    if (m_Settings.hotStandby)
+        g_io_service.post(m_io_strand.wrap(boost::bind(&PoolManager::standbyCheck, this)));
 }
 
 /*
@@ -271,6 +743,10 @@ void PoolManager::removeConnection(unsigned int idx)
     if (m_activeConnectionIdx > idx)
         m_activeConnectionIdx--;
 
+    // Standby might have been held on removed connection
+    if (m_Settings.hotStandby)
+        g_io_service.post(m_io_strand.wrap(boost::bind(&PoolManager::standbyCheck, this)));
+
 }
 
 void PoolManager::setActiveConnectionCommon(unsigned int idx)
@@ -341,7 +817,49 @@ Json::Value PoolManager::getConnectionsJson()
         Json::Value JConn;
         JConn["index"] = (unsigned)i;
         JConn["active"] = (i == m_activeConnectionIdx ? true : false);
+        JConn["standby"] = (m_Settings.connections[i] == m_standbyConn && standbyReady());
         JConn["uri"] = m_Settings.connections[i]->str();
+
+        // Round trip times (milliseconds) of solutions submitted on this connection
+        shared_ptr<URI> conn = m_Settings.connections[i];
+        JConn["latency"] = latencyJson(conn->SubmitLatency());
+        JConn["connect"] = latencyJson(conn->ConnectLatency());
+        JConn["jobinterval"] = latencyJson(conn->JobInterval());
+        if (conn->SecLevel() != SecureLevel::NONE)
+        {
+            Json::Value jHandshake = latencyJson(conn->HandshakeLatency());
+            jHandshake["resumed"] = conn->ResumedHandshakes();
+            JConn["handshake"] = jHandshake;
+        }
+
+        Json::Value jSolutions;
+        jSolutions["accepted"] = conn->Accepted();
+        jSolutions["stale"] = conn->Stale();
+        jSolutions["rejected"] = conn->Rejected();
+        JConn["solutions"] = jSolutions;
+
+        Json::Value jMessages;
+        jMessages["count"] = conn->Messages();
+#ifdef ALLOC_STATS
+        jMessages["allocations"] = Json::UInt64(conn->MessageAllocations());
+#endif
+        JConn["messages"] = jMessages;
+
+        double score = conn->Score();
+        JConn["score"] = (score < 0 ? Json::Value(Json::nullValue) : Json::Value(unsigned(score)));
+
+        Json::Value jEndpoints(Json::arrayValue);
+        for (auto const& e : conn->EndpointLatencies())
+        {
+            Json::Value jEndpoint;
+            jEndpoint["endpoint"] = e.first;
+            jEndpoint["count"] = e.second.count();
+            jEndpoint["timeouts"] = e.second.timeouts();
+            jEndpoint["mean"] = e.second.mean();
+            jEndpoints.append(jEndpoint);
+        }
+        JConn["endpoints"] = jEndpoints;
+
         jRes.append(JConn);
     }
     return jRes;
@@ -352,7 +870,57 @@ void PoolManager::start()
     m_running.store(true, memory_order_relaxed);
     m_async_pending.store(true, memory_order_relaxed);
     m_connectionSwitches.fetch_add(1, memory_order_relaxed);
+
+    // Resolve all pools now so failing over does not wait on DNS
+    for (auto& conn : m_Settings.connections)
+        watchConnection(conn);
     g_io_service.post(m_io_strand.wrap(boost::bind(&PoolManager::rotateConnect, this)));
+
+    // Measure all connections early so primary can be chosen
+    // once first figures are in
+    if (m_Settings.rankInterval)
+    {
+        for (auto& conn : m_Settings.connections)
+            g_io_service.post(
+                m_io_strand.wrap(boost::bind(&PoolManager::probeConnection, this, conn)));
+        m_ranktimer.expires_from_now(boost::posix_time::seconds(c_firstRankDelay));
+        m_ranktimer.async_wait(m_io_strand.wrap(boost::bind(
+            &PoolManager::ranktimer_elapsed, this, boost::asio::placeholders::error)));
+    }
+}
+
+void PoolManager::watchConnection(shared_ptr<URI> _conn)
+{
+    if (_conn->Family() != ProtocolFamily::SIMULATION && _conn->Host() != "exit" &&
+        (_conn->HostNameType() == UriHostNameType::Dns ||
+            _conn->HostNameType() == UriHostNameType::Basic))
+        m_dnsCache.watch(_conn->Host(), _conn->Port());
+}
+
+unique_ptr<PoolClient> PoolManager::createClient(shared_ptr<URI> _conn)
+{
+    if (_conn->Family() == ProtocolFamily::GETWORK)
+    {
+        // Race every getwork node, starting with the one selected
+        vector<shared_ptr<URI>> nodes = {_conn};
+        if (m_Settings.getWorkRace)
+            for (auto& conn : m_Settings.connections)
+                if (conn != _conn && conn->Family() == ProtocolFamily::GETWORK &&
+                    conn->Host() != "exit")
+                    nodes.push_back(conn);
+        if (nodes.size() > 1)
+            return unique_ptr<PoolClient>(new EthGetworkRaceClient(
+                m_Settings.noWorkTimeout, m_Settings.getWorkPollInterval, nodes));
+        return unique_ptr<PoolClient>(
+            new EthGetworkClient(m_Settings.noWorkTimeout, m_Settings.getWorkPollInterval));
+    }
+    if (_conn->Family() == ProtocolFamily::STRATUM)
+        return unique_ptr<PoolClient>(
+            new EthStratumClient(
+                m_Settings.noWorkTimeout, m_Settings.noResponseTimeout, m_Settings.shareRate));
+    if (_conn->Family() == ProtocolFamily::SIMULATION)
+        return unique_ptr<PoolClient>(new SimulateClient(m_Settings.benchmarkBlock));
+    return nullptr;
 }
 
 void PoolManager::rotateConnect()
@@ -397,14 +965,7 @@ void PoolManager::rotateConnect()
         if (p_client)
             p_client = nullptr;
 
-        if (m_Settings.connections.at(m_activeConnectionIdx)->Family() == ProtocolFamily::GETWORK)
-            p_client = unique_ptr<PoolClient>(
-                new EthGetworkClient(m_Settings.noWorkTimeout, m_Settings.getWorkPollInterval));
-        if (m_Settings.connections.at(m_activeConnectionIdx)->Family() == ProtocolFamily::STRATUM)
-            p_client = unique_ptr<PoolClient>(
-                new EthStratumClient(m_Settings.noWorkTimeout, m_Settings.noResponseTimeout));
-        if (m_Settings.connections.at(m_activeConnectionIdx)->Family() == ProtocolFamily::SIMULATION)
-            p_client = unique_ptr<PoolClient>(new SimulateClient(m_Settings.benchmarkBlock));
+        p_client = createClient(m_Settings.connections.at(m_activeConnectionIdx));
 
         if (p_client)
             setClientHandlers();
@@ -498,6 +1059,31 @@ void PoolManager::submithrtimer_elapsed(const boost::system::error_code& ec)
     }
 }
 
+void PoolManager::standbytimer_elapsed(const boost::system::error_code& ec)
+{
+    if (!ec)
+        standbyCheck();
+}
+
+void PoolManager::ranktimer_elapsed(const boost::system::error_code& ec)
+{
+    if (ec || !m_running.load(memory_order_relaxed) || m_stopping.load(memory_order_relaxed))
+        return;
+
+    rankConnections();
+
+    // Older figures weigh less at each round, then take fresh ones
+    for (auto& conn : m_Settings.connections)
+    {
+        conn->decayStats();
+        probeConnection(conn);
+    }
+
+    m_ranktimer.expires_from_now(boost::posix_time::minutes(m_Settings.rankInterval));
+    m_ranktimer.async_wait(m_io_strand.wrap(boost::bind(
+        &PoolManager::ranktimer_elapsed, this, boost::asio::placeholders::error)));
+}
+
 void PoolManager::reconnecttimer_elapsed(const boost::system::error_code& ec)
 {
     if (ec)
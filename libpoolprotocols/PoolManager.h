@@ -1,5 +1,6 @@
 #pragma once
 
+#include <deque>
 #include <iostream>
 
 #include <json/json.h>
@@ -8,8 +9,10 @@
 #include <libethcore/Farm.h>
 #include <libethcore/Miner.h>
 
+#include "DnsCache.h"
 #include "PoolClient.h"
 #include "getwork/EthGetworkClient.h"
+#include "getwork/EthGetworkRaceClient.h"
 #include "stratum/EthStratumClient.h"
 #include "testing/SimulateClient.h"
 
@@ -33,6 +36,11 @@ struct PoolSettings
     unsigned connectionMaxRetries = 3;  // Max number of connection retries
     unsigned delayBeforeRetry = 0;      // Delay seconds before connect retry
     unsigned benchmarkBlock = 0;        // Block number used by SimulateClient to test performances
+    bool hotStandby = false;  // Keep next pool connected and authorized for immediate failover
+    unsigned rankInterval = 0;  // Re-rank connections by latency every this number of minutes
+    unsigned dnsTtl = 300;      // Seconds resolved pool addresses are used before resolving again
+    bool getWorkRace = false;   // Get work from all getwork nodes at once, mine the first one's
+    double shareRate = 0;       // Shares per minute to negotiate difficulty for (0 = pool's)
 };
 
 class PoolManager
@@ -56,14 +64,60 @@ public:
     unsigned getConnectionSwitches();
     unsigned getEpochChanges();
 
+    // Miners outside of farm (eg. rigs served in proxy mode) have
+    // indexes from here on
+    static constexpr unsigned ExternalMinerBase = 0x10000;
+
+    // Sends solution of an external miner to pool. False if not connected
+    bool submitSolution(Solution const& _solution);
+
+    using WorkReceived = std::function<void(WorkPackage const&)>;
+    using ExternalSolution = std::function<void(unsigned const&, bool)>;
+
+    // Gets notified of work dispatched to farm
+    void onWorkReceived(WorkReceived const& _handler) { m_onWorkReceived = _handler; }
+
+    // Gets pool's verdict on solutions of external miners
+    void onExternalSolution(ExternalSolution const& _handler) { m_onExternalSolution = _handler; }
+
+    // Narrows the nonces farm searches to those whose _digits hex digits
+    // following pool's extranonce are _slot, leaving the others to
+    // external miners. To be set before start
+    void reserveNonceSlot(unsigned _digits, unsigned _slot)
+    {
+        m_slotDigits = _digits;
+        m_slot = _slot;
+    }
+
 private:
     void rotateConnect();
+    std::unique_ptr<PoolClient> createClient(std::shared_ptr<URI> _conn);
+    void watchConnection(std::shared_ptr<URI> _conn);
     void setClientHandlers();
+    void clientConnected();
+    void clientDisconnected();
+    void clientWorkReceived(WorkPackage const& wp);
+    WorkPackage farmWork(WorkPackage const& _wp);
+    void queueSolution(Solution const& _solution);
+    void replaySolutions();
+    void discardSolutions(std::shared_ptr<URI> _keep);
+    void wasteSolution(Solution const& _solution, std::string const& _reason);
+    void failover();
+    std::shared_ptr<URI> standbyCandidate();
+    bool standbyReady();
+    void standbyCheck();
+    void standbyConnect(std::shared_ptr<URI> _conn);
+    void standbyDisconnected(PoolClient* _client);
+    bool promoteStandby();
+    void rankConnections();
+    void probeConnection(std::shared_ptr<URI> _conn);
     void showMiningAt();
     void setActiveConnectionCommon(unsigned int idx);
     void failovertimer_elapsed(const boost::system::error_code& ec);
     void submithrtimer_elapsed(const boost::system::error_code& ec);
     void reconnecttimer_elapsed(const boost::system::error_code& ec);
+    void standbytimer_elapsed(const boost::system::error_code& ec);
+    void ranktimer_elapsed(const boost::system::error_code& ec);
 
     PoolSettings m_Settings;
     std::atomic<bool> m_running = {false};
@@ -74,14 +128,40 @@ private:
     std::atomic<unsigned> m_connectionSwitches = {0};
     unsigned m_activeConnectionIdx = 0;
     WorkPackage m_currentWp;
+    std::shared_ptr<URI> m_workConn = nullptr;  // Connection current job comes from
+    unsigned m_slotDigits = 0;  // Extranonce digits added for farm (see reserveNonceSlot)
+    unsigned m_slot = 0;
+    std::chrono::steady_clock::time_point m_lastJobStamp;  // Last job received on active client
     boost::asio::io_service::strand m_io_strand;
     boost::asio::deadline_timer m_failovertimer;
     boost::asio::deadline_timer m_submithrtimer;
     boost::asio::deadline_timer m_reconnecttimer;
+    boost::asio::deadline_timer m_standbytimer;
+    boost::asio::deadline_timer m_ranktimer;
+    DnsCache m_dnsCache;  // Keeps pool host names resolved
     std::unique_ptr<PoolClient> p_client = nullptr;
+
+    // Hot standby client connected to the pool we'd fail over to
+    std::unique_ptr<PoolClient> p_standby = nullptr;
+    std::shared_ptr<URI> m_standbyConn = nullptr;
+    WorkPackage m_standbyWp;  // Latest job received on standby
+    std::chrono::steady_clock::time_point m_standbyJobStamp;
+    std::atomic<bool> m_standbyUp = {false};
     std::atomic<unsigned> m_epochChanges = {0};
     static PoolManager* m_this;
     int m_lastBlock;
+
+    // Solutions found while disconnected, along with the connection
+    // their job came from. Replayed there if job is still valid
+    struct PendingSolution
+    {
+        Solution solution;
+        std::shared_ptr<URI> conn;
+    };
+    std::deque<PendingSolution> m_pendingSolutions;
+
+    WorkReceived m_onWorkReceived;
+    ExternalSolution m_onExternalSolution;
 };
 
 }  // namespace eth
@@ -1,5 +1,6 @@
 
 #include <algorithm>
+#include <climits>
 #include <iostream>
 #include <map>
 #include <sstream>
@@ -33,6 +34,10 @@ static map<string, SchemeAttributes> s_schemes = {
     {"stratum3+ssl", {ProtocolFamily::STRATUM, SecureLevel::TLS, 3}},
     {"http", {ProtocolFamily::GETWORK, SecureLevel::NONE, 0}},
     {"getwork", {ProtocolFamily::GETWORK, SecureLevel::NONE, 0}},
+    {"ws", {ProtocolFamily::GETWORK, SecureLevel::NONE, 0}},
+    {"getwork+ws", {ProtocolFamily::GETWORK, SecureLevel::NONE, 0}},
+    {"ipc", {ProtocolFamily::GETWORK, SecureLevel::NONE, 0}},
+    {"getwork+ipc", {ProtocolFamily::GETWORK, SecureLevel::NONE, 0}},
 
     /*
     Any TCP scheme has, at the moment, only STRATUM protocol thus
@@ -119,6 +124,18 @@ URI::URI(string uri, bool _sim) : m_uri{move(uri)}
     if ((s_schemes.find(m_scheme) == s_schemes.end()))
         throw runtime_error("Invalid scheme");
 
+    // Unix domain sockets have no host. All of authority is the
+    // path of the socket (eg. getwork+ipc:///home/user/node.ipc)
+    if (m_scheme == "ipc" || m_scheme == "getwork+ipc")
+    {
+        if (!url_decode(m_authority, m_path) || m_path.empty())
+            throw runtime_error("Missing socket path");
+        m_urlinfo = m_pathinfo = m_authority;
+        m_host = m_path;
+        m_hostType = UriHostNameType::Local;
+        m_isLoopBack = true;
+        return;
+    }
 
     // Now let's see if authority part can be split into userinfo and "the rest"
     regex usr_url("^(.*)\\@(.*)$");
@@ -397,3 +414,78 @@ string URI::KnownSchemes(ProtocolFamily family)
     }
     return schemes;
 }
+
+void URI::addSolution(bool _accepted, bool _stale)
+{
+    if (!_accepted)
+        m_rejected++;
+    else if (_stale)
+        m_stale++;
+    m_accepted += _accepted ? 1 : 0;
+}
+
+void URI::recordEndpoint(string const& _endpoint, chrono::milliseconds const& _delay)
+{
+    lock_guard<mutex> l(m_endpointsMutex);
+    m_endpointLatency[_endpoint].record(_delay);
+}
+
+void URI::recordEndpointTimeout(string const& _endpoint)
+{
+    lock_guard<mutex> l(m_endpointsMutex);
+    m_endpointLatency[_endpoint].recordTimeout();
+}
+
+unsigned URI::EndpointScore(string const& _endpoint)
+{
+    // Never tried endpoints come after the ones known to work
+    // and before the ones known to fail only
+    lock_guard<mutex> l(m_endpointsMutex);
+    auto it = m_endpointLatency.find(_endpoint);
+    if (it == m_endpointLatency.end() || (!it->second.count() && !it->second.timeouts()))
+        return UINT_MAX - 1;
+    if (!it->second.count())
+        return UINT_MAX;
+
+    // Each failure weighs as a 1 second connect time
+    return it->second.mean() + 1000 * it->second.timeouts() /
+                                   (it->second.count() + it->second.timeouts());
+}
+
+map<string, LatencyHistogram> URI::EndpointLatencies()
+{
+    lock_guard<mutex> l(m_endpointsMutex);
+    return m_endpointLatency;
+}
+
+double URI::Score()
+{
+    if (!m_connectLatency.count())
+        return -1;
+
+    // Connect time stands for network distance. It gets inflated by
+    // failed connection attempts and by solutions pool did not
+    // (fully) account for
+    double failed = double(m_connectLatency.timeouts()) /
+                    (m_connectLatency.count() + m_connectLatency.timeouts());
+    double bad = (m_accepted + m_rejected) ?
+                     double(m_stale + m_rejected) / (m_accepted + m_rejected) :
+                     0.0;
+    return (m_connectLatency.mean() + 1) * (1.0 + 10.0 * (failed + bad));
+}
+
+void URI::decayStats()
+{
+    m_submitLatency.decay();
+    m_connectLatency.decay();
+    m_jobInterval.decay();
+    m_handshakeLatency.decay();
+    m_resumedHandshakes /= 2;
+    m_accepted /= 2;
+    m_stale /= 2;
+    m_rejected /= 2;
+
+    lock_guard<mutex> l(m_endpointsMutex);
+    for (auto& e : m_endpointLatency)
+        e.second.decay();
+}
@@ -1,5 +1,8 @@
 #pragma once
 
+#include <chrono>
+#include <map>
+#include <mutex>
 #include <regex>
 #include <string>
 
@@ -7,6 +10,8 @@
 #include <boost/asio.hpp>
 #include <boost/lexical_cast.hpp>
 
+#include "LatencyHistogram.h"
+
 // A simple URI parser specifically for mining pool endpoints
 namespace dev
 {
@@ -29,7 +34,8 @@ enum class UriHostNameType
     Basic = 1,    // The host is set, but the type cannot be determined
     Dns = 2,      // The host name is a domain name system(DNS) style host name
     IPV4 = 3,     // The host name is an Internet Protocol(IP) version 4 host address
-    IPV6 = 4      // The host name is an Internet Protocol(IP) version 6 host address.
+    IPV6 = 4,     // The host name is an Internet Protocol(IP) version 6 host address.
+    Local = 5     // There's no host but the path of a unix domain socket
 };
 
 class URI
@@ -69,6 +75,36 @@ public:
     void Responds(bool _value) { m_responds = _value; }
     void addDuration(unsigned long _minutes) { m_totalDuration += _minutes; }
     unsigned long getDuration() { return m_totalDuration; }
+    LatencyHistogram& SubmitLatency() { return m_submitLatency; }
+    LatencyHistogram& ConnectLatency() { return m_connectLatency; }
+    LatencyHistogram& JobInterval() { return m_jobInterval; }
+    LatencyHistogram& HandshakeLatency() { return m_handshakeLatency; }
+    void addResumedHandshake() { m_resumedHandshakes++; }
+    unsigned ResumedHandshakes() const { return m_resumedHandshakes; }
+
+    void addSolution(bool _accepted, bool _stale);
+    unsigned Accepted() const { return m_accepted; }
+    unsigned Stale() const { return m_stale; }
+    unsigned Rejected() const { return m_rejected; }
+
+    // Messages handled and heap allocations made handling them
+    void addMessages(unsigned _messages, uint64_t _allocations)
+    {
+        m_messages += _messages;
+        m_messageAllocations += _allocations;
+    }
+    unsigned Messages() const { return m_messages; }
+    uint64_t MessageAllocations() const { return m_messageAllocations; }
+
+    // Connect times of each address host resolves to
+    void recordEndpoint(std::string const& _endpoint, std::chrono::milliseconds const& _delay);
+    void recordEndpointTimeout(std::string const& _endpoint);
+    unsigned EndpointScore(std::string const& _endpoint);
+    std::map<std::string, LatencyHistogram> EndpointLatencies();
+
+    // Milliseconds to rank connections by, lower is better. Negative if unknown
+    double Score();
+    void decayStats();
 
 private:
     std::string m_scheme;
@@ -95,6 +131,18 @@ private:
     UriHostNameType m_hostType = UriHostNameType::Unknown;
     bool m_isLoopBack;
     unsigned long m_totalDuration; // Total duration on this connection in minutes
+    LatencyHistogram m_submitLatency;   // Round trip times of solution submissions
+    LatencyHistogram m_connectLatency;  // Time to establish a tcp connection
+    LatencyHistogram m_jobInterval;     // Time elapsed among job notifications
+    LatencyHistogram m_handshakeLatency;  // Time to complete TLS handshake
+    unsigned m_resumedHandshakes = 0;     // Handshakes which resumed a previous session
+    unsigned m_accepted = 0;
+    unsigned m_stale = 0;  // Accepted as stale
+    unsigned m_rejected = 0;
+    unsigned m_messages = 0;
+    uint64_t m_messageAllocations = 0;
+    std::mutex m_endpointsMutex;
+    std::map<std::string, LatencyHistogram> m_endpointLatency;
 
 };
 }  // namespace dev
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+namespace dev
+{
+// Steers pool difficulty towards a target number of shares per minute.
+// Shares are found at a rate of hashrate / (difficulty * 2^32) : when the
+// one expected at current difficulty is off target by more than a factor
+// of two a new difficulty is proposed. Proposals are rounded to powers of
+// two and spaced out so pool's vardiff has time to settle.
+class ShareRateController
+{
+public:
+    static constexpr double HashesPerDiff = 4294967296.0;
+    static constexpr std::chrono::minutes Holdoff = std::chrono::minutes(5);
+
+    explicit ShareRateController(double _target = 0) : m_target(_target) {}
+
+    bool enabled() const { return m_target > 0 && !m_refused; }
+    double target() const { return m_target; }
+
+    // Expected shares per minute
+    static double rate(double _hashrate, double _difficulty)
+    {
+        return _difficulty > 0 ? _hashrate * 60 / (_difficulty * HashesPerDiff) : 0;
+    }
+
+    // Whether difficulty should change. If so _proposed is set to the
+    // difficulty which hits target rate at given hashrate
+    bool check(double _hashrate, double _difficulty, std::chrono::steady_clock::time_point _now,
+        double& _proposed)
+    {
+        if (!enabled() || _hashrate <= 0 || _difficulty <= 0)
+            return false;
+        if (m_proposed && _now - m_proposedAt < Holdoff)
+            return false;
+
+        double ratio = rate(_hashrate, _difficulty) / m_target;
+        if (ratio < 2 && ratio > 0.5)
+            return false;
+
+        double ideal = _hashrate * 60 / (m_target * HashesPerDiff);
+        _proposed = std::max(std::exp2(std::round(std::log2(ideal))), 1.0 / 1024);
+        if (_proposed == m_proposed && _now - m_proposedAt < Holdoff * 6)
+            return false;
+
+        m_proposed = _proposed;
+        m_proposedAt = _now;
+        return true;
+    }
+
+    // Pool does not accept difficulty proposals
+    void refused() { m_refused = true; }
+
+    void reset()
+    {
+        m_proposed = 0;
+        m_refused = false;
+    }
+
+private:
+    double m_target;
+    double m_proposed = 0;  // Last difficulty proposed
+    std::chrono::steady_clock::time_point m_proposedAt;
+    bool m_refused = false;
+};
+
+}  // namespace dev
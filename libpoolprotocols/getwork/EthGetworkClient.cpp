@@ -1,22 +1,45 @@
 
 #include "EthGetworkClient.h"
 
+#include <algorithm>
 #include <chrono>
+#include <cstring>
+#include <sstream>
 
 #include <ethash/ethash.hpp>
 
+#include <libdevcore/Allocations.h>
+
 using namespace std;
 using namespace dev;
 using namespace eth;
 
 using boost::asio::ip::tcp;
 
+// Max number of requests sent before getting their responses
+static const size_t c_maxPipeline = 8;
+
+// Polling interval (ms) while node pushes new heads
+static const unsigned c_pushRecheckPeriod = 5000;
+
+// Guards against endless lines on ipc sockets
+static const size_t c_maxIpcMessage = 1024 * 1024;
+
+// Nonce of an eth_submitWork request
+static uint64_t submittedNonce(const Json::Value& jReq)
+{
+    string nonce = jReq["params"].get(Json::Value::ArrayIndex(0), "").asString();
+    return strtoull(nonce.c_str(), nullptr, 16);
+}
+
 EthGetworkClient::EthGetworkClient(int worktimeout, unsigned farmRecheckPeriod)
   : PoolClient(),
     m_farmRecheckPeriod(farmRecheckPeriod),
     m_io_strand(g_io_service),
     m_socket(g_io_service),
-    m_resolver(g_io_service),
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    m_ipcSocket(g_io_service),
+#endif
     m_endpoints(),
     m_getwork_timer(g_io_service),
     m_worktimeout(worktimeout)
@@ -46,24 +69,32 @@ void EthGetworkClient::connect()
 
     // Reset status flags
     m_getwork_timer.cancel();
-    
+    m_websocket = (m_conn->Scheme() == "ws" || m_conn->Scheme() == "getwork+ws");
+    m_ipc = (m_conn->HostNameType() == dev::UriHostNameType::Local);
+
     // Initialize a new queue of end points
     m_endpoints = queue<boost::asio::ip::basic_endpoint<boost::asio::ip::tcp>>();
     m_endpoint = boost::asio::ip::basic_endpoint<boost::asio::ip::tcp>();
 
-    if (m_conn->HostNameType() == dev::UriHostNameType::Dns ||
-        m_conn->HostNameType() == dev::UriHostNameType::Basic)
+    if (m_ipc)
     {
-        // Begin resolve all ips associated to hostname
-        // calling the resolver each time is useful as most
-        // load balancers will give Ips in different order
-        m_resolver = boost::asio::ip::tcp::resolver(g_io_service);
-        boost::asio::ip::tcp::resolver::query q(m_conn->Host(), toString(m_conn->Port()));
-
-        // Start resolving async
-        m_resolver.async_resolve(
-            q, m_io_strand.wrap(boost::bind(&EthGetworkClient::handle_resolve, this,
-                   boost::asio::placeholders::error, boost::asio::placeholders::iterator)));
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+        // Nothing to resolve. Path is the endpoint
+        send(m_jsonGetWork);
+#else
+        cwarn << "Unix domain sockets are not supported on this platform";
+        m_conn->MarkUnrecoverable();
+        disconnect();
+#endif
+    }
+    else if (m_conn->HostNameType() == dev::UriHostNameType::Dns ||
+             m_conn->HostNameType() == dev::UriHostNameType::Basic)
+    {
+        // Get all ips associated to hostname. Cache keeps them
+        // resolved in background so this does not wait on DNS
+        DnsCache::d().resolve(m_conn->Host(), m_conn->Port(),
+            m_io_strand.wrap(boost::bind(&EthGetworkClient::handle_resolve, this,
+                boost::placeholders::_1, boost::placeholders::_2)));
     }
     else
     {
@@ -85,24 +116,94 @@ void EthGetworkClient::disconnect()
     m_session = nullptr;
 
     m_connecting.store(false, memory_order_relaxed);
-    m_txPending.store(false, memory_order_relaxed);
     m_getwork_timer.cancel();
+    close_socket();
 
     m_txQueue.consume_all([](string* l) { delete l; });
-    m_request.consume(m_request.capacity());
-    m_response.consume(m_response.capacity());
+    m_inflight.clear();
+    m_request.consume(m_request.size());
 
     if (m_onDisconnected)
         m_onDisconnected();
 }
 
+// When _unprocessed node is known to have ignored whatever was written after
+// its last response (it announced it was closing) so all of it is sent again
+void EthGetworkClient::close_socket(bool _unprocessed)
+{
+    if (m_socket.is_open())
+    {
+        boost::system::error_code ec;
+        m_socket.close(ec);
+    }
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    if (m_ipcSocket.is_open())
+    {
+        boost::system::error_code ec;
+        m_ipcSocket.close(ec);
+    }
+#endif
+    m_sockConnected = false;
+    m_sockConnecting = false;
+    m_sockKeepAlive = false;
+    m_writing = false;
+    m_parser.reset();
+    m_response.consume(m_response.size());
+    m_wsOpen = false;
+    m_subscribed = false;
+    m_wsControl.clear();
+    m_framer.reset();
+
+    // Whatever has not been answered has to be sent again but a
+    // subscription only lives as long as its connection. Only idempotent
+    // requests are repeated : node may have processed a solution before
+    // closing, so one already written is reported lost instead of being
+    // submitted twice. Unless node said it would ignore it
+    vector<Json::Value> lost;
+    m_inflight.erase(remove_if(m_inflight.begin(), m_inflight.end(),
+                         [&lost, _unprocessed](const PendingRequest& r) {
+                             if (r.jReq.get("id", Json::Value::null) == Json::Value(2u))
+                                 return true;
+                             if (_unprocessed || !r.written ||
+                                 r.jReq.get("method", "") != "eth_submitWork")
+                                 return false;
+                             lost.push_back(r.jReq);
+                             return true;
+                         }),
+        m_inflight.end());
+    for (auto& r : m_inflight)
+        r.written = false;
+
+    for (auto& jReq : lost)
+    {
+        uint64_t nonce = submittedNonce(jReq);
+        if (m_conn)
+            m_conn->SubmitLatency().recordTimeout();
+        cwarn << "Solution 0x" << toHex(nonce) << " lost. Connection closed before response";
+        if (m_onSolutionLost)
+            m_onSolutionLost(jReq.get("id", 40u).asUInt() - 40, nonce);
+    }
+}
+
 void EthGetworkClient::begin_connect()
 {
+    close_socket();
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    if (m_ipc)
+    {
+        m_sockConnecting = true;
+        m_ipcSocket.async_connect(boost::asio::local::stream_protocol::endpoint(m_conn->Path()),
+            m_io_strand.wrap(boost::bind(
+                &EthGetworkClient::handle_connect, this, boost::asio::placeholders::error)));
+        return;
+    }
+#endif
     if (!m_endpoints.empty())
     {
         // Pick the first endpoint in list.
         // Eventually endpoints get discarded on connection errors
         m_endpoint = m_endpoints.front();
+        m_sockConnecting = true;
         m_socket.async_connect(
             m_endpoint, m_io_strand.wrap(boost::bind(&EthGetworkClient::handle_connect, this,
                             boost::asio::placeholders::error)));
@@ -116,8 +217,16 @@ void EthGetworkClient::begin_connect()
 
 void EthGetworkClient::handle_connect(const boost::system::error_code& ec)
 {
-    if (!ec && m_socket.is_open())
+    if (ec == boost::asio::error::operation_aborted)
+        return;
+    m_sockConnecting = false;
+
+    if (!ec)
     {
+        m_sockConnected = true;
+        m_sockResponses = 0;
+        if (!m_ipc)
+            m_socket.set_option(tcp::no_delay(true));
 
         // If in "connecting" phase raise the proper event
         if (m_connecting.load(memory_order_relaxed))
@@ -135,231 +244,459 @@ void EthGetworkClient::handle_connect(const boost::system::error_code& ec)
             m_current_tstamp = chrono::steady_clock::now();
         }
 
-        // Retrieve 1st line waiting in the queue and submit
-        // if other lines waiting they will be processed 
-        // at the end of the processed request
-        Json::Reader jRdr;
-        string* line;
-        ostream os(&m_request);
-        if (!m_txQueue.empty())
-        {
-            while (m_txQueue.pop(line))
-            {
-                if (line->size())
-                {
-
-                    jRdr.parse(*line, m_pendingJReq);
-                    m_pending_tstamp = chrono::steady_clock::now();
+        // Connection is kept open across requests
+        begin_read();
 
-                    // Make sure path begins with "/"
-                    string _path = (m_conn->Path().empty() ? "/" : m_conn->Path());
+        if (m_websocket)
+        {
+            // Upgrade connection before anything else is sent
+            ostream os(&m_request);
+            WebSocketFramer::handshake(
+                os, m_conn->Host(), m_conn->Port(), m_conn->Path(), m_wsKey);
+            write_request();
+            return;
+        }
 
-                    os << "POST " << _path << " HTTP/1.0\r\n";
-                    os << "Host: " << m_conn->Host() << "\r\n";
-                    os << "Content-Type: application/json"
-                       << "\r\n";
-                    os << "Content-Length: " << line->length() << "\r\n";
-                    os << "Connection: close\r\n\r\n";  // Double line feed to mark the
-                                                        // beginning of body
-                    // The payload
-                    os << *line;
+        // Ipc connections push notifications as well
+        if (m_ipc)
+            subscribe();
+        begin_write();
+    }
+    else if (m_ipc)
+    {
+        cwarn << "Error connecting to " << m_conn->Path() << " : " << ec.message();
+        disconnect();
+    }
+    else
+    {
+        // This endpoint does not respond
+        // Pop it and retry
+        cwarn << "Error connecting to " << m_conn->Host() << ":" << toString(m_conn->Port())
+              << " : " << ec.message();
+        m_endpoints.pop();
+        begin_connect();
+    }
+}
 
-                    // Out received message only for debug purpouses
-                    if (g_logOptions & LOG_JSON)
-                        cnote << " >> " << *line;
+void EthGetworkClient::begin_write()
+{
+    // Move queued requests in the pipeline
+    string* line;
+    while (m_inflight.size() < c_maxPipeline && m_txQueue.pop(line))
+    {
+        if (line->size())
+        {
+            PendingRequest r;
+            r.line = move(*line);
+            Json::Reader jRdr;
+            jRdr.parse(r.line, r.jReq);
+            m_inflight.push_back(move(r));
+        }
+        delete line;
+    }
 
-                    delete line;
+    if ((m_inflight.empty() && m_wsControl.empty()) || m_writing || m_sockConnecting)
+        return;
+    if (!m_sockConnected)
+    {
+        // Node closed the connection while idle
+        begin_connect();
+        return;
+    }
+    if (m_websocket && !m_wsOpen)
+        return;
 
-                    async_write(m_socket, m_request,
-                        m_io_strand.wrap(boost::bind(&EthGetworkClient::handle_write, this,
-                            boost::asio::placeholders::error)));
-                    break;
-                }
-                delete line;
-            }
+    // Requests are written one after the other without
+    // waiting for responses, which come back in the same order
+    unsigned unanswered = 0;
+    ostream os(&m_request);
+    string _path = (m_conn->Path().empty() ? "/" : m_conn->Path());
+    if (m_websocket)
+    {
+        os << m_wsControl;
+        m_wsControl.clear();
+    }
+    for (auto& r : m_inflight)
+    {
+        if (r.written)
+        {
+            unanswered++;
+            continue;
         }
-        else
+
+        if (m_websocket || m_ipc)
         {
-            m_txPending.store(false, memory_order_relaxed);
+            // Messages are framed, or delimited by new lines, and need no headers
+            if (m_websocket)
+                WebSocketFramer::encode(os, WebSocketFramer::Opcode::Text, r.line);
+            else
+                os << r.line << "\n";
+            if (g_logOptions & LOG_JSON)
+                cnote << " >> " << r.line;
+            r.written = true;
+            r.sent = chrono::steady_clock::now();
+            continue;
         }
 
+        // Over http pipeline only once node has shown it keeps the connection
+        // open, as whatever follows the response it closes with is ignored.
+        // And never queue a solution behind a request : if the connection
+        // drops meanwhile it can't tell whether node got it or not
+        if (unanswered &&
+            (!m_sockKeepAlive || r.jReq.get("method", "") == "eth_submitWork"))
+            break;
+        unanswered++;
+
+        os << "POST " << _path << " HTTP/1.1\r\n";
+        os << "Host: " << m_conn->Host() << "\r\n";
+        os << "Content-Type: application/json\r\n";
+        os << "Content-Length: " << r.line.length() << "\r\n";
+        os << "Connection: keep-alive\r\n\r\n";  // Double line feed to mark the
+                                                 // beginning of body
+        // The payload
+        os << r.line;
+
+        // Out received message only for debug purpouses
+        if (g_logOptions & LOG_JSON)
+            cnote << " >> " << r.line;
+
+        r.written = true;
+        r.sent = chrono::steady_clock::now();
     }
-    else
+
+    if (m_request.size())
+        write_request();
+}
+
+void EthGetworkClient::write_request()
+{
+    m_writing = true;
+    auto handler = m_io_strand.wrap(makeAllocHandler(m_writeMemory,
+        boost::bind(&EthGetworkClient::handle_write, this, boost::asio::placeholders::error)));
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    if (m_ipc)
     {
-        if (ec != boost::asio::error::operation_aborted)
-        {
-            // This endpoint does not respond
-            // Pop it and retry
-            cwarn << "Error connecting to " << m_conn->Host() << ":" << toString(m_conn->Port())
-                  << " : " << ec.message();
-            m_endpoints.pop();
-            begin_connect();
-        }
+        async_write(m_ipcSocket, m_request, handler);
+        return;
     }
+#endif
+    async_write(m_socket, m_request, handler);
 }
 
 void EthGetworkClient::handle_write(const boost::system::error_code& ec)
 {
+    if (ec == boost::asio::error::operation_aborted)
+        return;
+    m_writing = false;
+
     if (!ec)
     {
-        // Transmission succesfully sent.
-        // Read the response async. 
-        async_read(m_socket, m_response, boost::asio::transfer_all(),
-            m_io_strand.wrap(boost::bind(&EthGetworkClient::handle_read, this,
-                boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred)));
+        // Anything queued meanwhile
+        begin_write();
     }
     else
     {
-        if (ec != boost::asio::error::operation_aborted)
+        // Unless node closed a reused connection this endpoint is faulty
+        m_request.consume(m_request.size());
+        if (!m_sockResponses && !m_ipc)
         {
             cwarn << "Error writing to " << m_conn->Host() << ":" << toString(m_conn->Port())
                   << " : " << ec.message();
             m_endpoints.pop();
-            begin_connect();
         }
+        begin_connect();
     }
 }
 
-void EthGetworkClient::handle_read(const boost::system::error_code& ec, size_t bytes_transferred)
+void EthGetworkClient::begin_read()
 {
-    if (!ec || ec == boost::asio::error::eof)
+    auto handler = m_io_strand.wrap(makeAllocHandler(m_readMemory,
+        boost::bind(&EthGetworkClient::handle_read, this, boost::asio::placeholders::error,
+            boost::asio::placeholders::bytes_transferred)));
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    if (m_ipc)
     {
-        // Close socket
-        if (m_socket.is_open())
-            m_socket.close();
+        m_ipcSocket.async_read_some(m_response.prepare(4096), handler);
+        return;
+    }
+#endif
+    m_socket.async_read_some(m_response.prepare(4096), handler);
+}
 
-        // Get the whole message
-        string rx_message(
-            boost::asio::buffer_cast<const char*>(m_response.data()), bytes_transferred);
-        m_response.consume(bytes_transferred);
+void EthGetworkClient::handle_read(const boost::system::error_code& ec, size_t bytes_transferred)
+{
+    if (ec == boost::asio::error::operation_aborted)
+        return;
+    if (!ec)
+        m_response.commit(bytes_transferred);
 
-        // Empty response ?
-        if (!rx_message.size())
+    // Process all complete responses received
+    while (m_response.size())
+    {
+        const char* data = boost::asio::buffer_cast<const char*>(m_response.data());
+        if (m_ipc)
         {
-            cwarn << "Invalid response from " << m_conn->Host() << ":" << toString(m_conn->Port());
-            disconnect();
-            return;
+            // One json message per line
+            const char* end = static_cast<const char*>(memchr(data, '\n', m_response.size()));
+            if (!end)
+            {
+                if (m_response.size() <= c_maxIpcMessage)
+                    break;
+                cwarn << "Invalid response from " << m_conn->Path();
+                disconnect();
+                return;
+            }
+            string line(data, end);
+            m_response.consume(line.size() + 1);
+            if (line.find_first_not_of(" \t\r") != string::npos)
+                process_json(line);
+            continue;
         }
-
-        // Read message by lines.
-        // First line is http status
-        // Other lines are headers
-        // A double "\r\n" identifies begin of body
-        // The rest is body
-        string line;
-        string linedelimiter = "\r\n";
-        size_t delimiteroffset = rx_message.find(linedelimiter);
-
-        unsigned int linenum = 0;
-        bool isHeader = true;
-        while (rx_message.length() && delimiteroffset != string::npos)
+        if (m_wsOpen)
         {
-            linenum++;
-            line = rx_message.substr(0, delimiteroffset);
-            rx_message.erase(0, delimiteroffset + 2);
-            
-            // This identifies the beginning of body
-            if (line.empty())
+            m_response.consume(m_framer.parse(data, m_response.size()));
+            if (m_framer.failed())
             {
-                isHeader = false;
-                delimiteroffset = rx_message.find(linedelimiter);
-                if (delimiteroffset != string::npos)
-                    continue;
-                boost::replace_all(rx_message, "\n", "");
-                line = rx_message;
+                cwarn << "Invalid WebSocket frame from " << m_conn->Host() << ":"
+                      << toString(m_conn->Port());
+                disconnect();
+                return;
             }
+            if (!m_framer.complete())
+                break;
+            if (!process_ws_message())
+                return;
+            continue;
+        }
 
-            // Http status
-            if (isHeader && linenum == 1)
-            {
-                if (line.substr(0, 7) != "HTTP/1.")
-                {
-                    cwarn << "Invalid response from " << m_conn->Host() << ":"
-                          << toString(m_conn->Port());
-                    disconnect();
-                    return;
-                }
-                size_t spaceoffset = line.find(' ');
-                if (spaceoffset == string::npos)
-                {
-                    cwarn << "Invalid response from " << m_conn->Host() << ":"
-                          << toString(m_conn->Port());
-                    disconnect();
-                    return;
-                }
-                string status = line.substr(spaceoffset + 1);
-                if (status.substr(0, 3) != "200")
-                {
-                    cwarn << m_conn->Host() << ":" << toString(m_conn->Port())
-                          << " reported status " << status;
-                    disconnect();
-                    return;
-                }
-            }
+        size_t used = m_parser.parse(data, m_response.size());
+        m_response.consume(used);
+        if (m_parser.failed())
+        {
+            cwarn << "Invalid response from " << m_conn->Host() << ":"
+                  << toString(m_conn->Port());
+            disconnect();
+            return;
+        }
+        if (!m_parser.complete())
+            break;
+        if (!(m_websocket ? process_ws_handshake() : process_http_response()))
+            return;
+    }
 
-            // Body
-            if (!isHeader)
-            {
-                // Out received message only for debug purpouses
-                if (g_logOptions & LOG_JSON)
-                    cnote << " << " << line;
-
-                // Test validity of chunk and process
-                Json::Value jRes;
-                Json::Reader jRdr;
-                if (jRdr.parse(line, jRes))
-                {
-                    // Run in sync so no 2 different async reads may overlap
-                    processResponse(jRes);
-                }
-                else
-                {
-                    string what = jRdr.getFormattedErrorMessages();
-                    boost::replace_all(what, "\n", " ");
-                    cwarn << "Got invalid Json message : " << what;
-                }
+    if (!ec)
+    {
+        begin_read();
+        return;
+    }
 
-            }
+    // Body delimited by connection close
+    if (!m_ipc && !m_wsOpen && m_parser.eof() &&
+        !(m_websocket ? process_ws_handshake() : process_http_response()))
+        return;
 
-            delimiteroffset = rx_message.find(linedelimiter);
-        }
+    bool reused = (m_sockResponses != 0);
+    close_socket();
+    if (m_inflight.empty())
+        return;
 
-        // Is there anything else in the queue
-        if (!m_txQueue.empty())
-        {
-            begin_connect();
-        }
-        else
-        {
-            // Signal end of async send/receive operations
-            m_txPending.store(false, memory_order_relaxed);
-        }
+    // A node may close a reused connection any time. Send again
+    // what's left unanswered on a new one
+    if (reused && ec == boost::asio::error::eof)
+    {
+        begin_write();
+        return;
+    }
+
+    cwarn << "Error reading from :" << m_conn->Host() << ":" << toString(m_conn->Port())
+          << " : " << ec.message();
+    disconnect();
+}
+
+bool EthGetworkClient::process_http_response()
+{
+    m_sockResponses++;
+    unsigned status = m_parser.status();
+    string statusLine = m_parser.statusLine();
+    string body = m_parser.body();
+    bool keepAlive = m_parser.keepAlive();
+    m_parser.reset();
+
+    if (m_inflight.empty())
+    {
+        cwarn << "Unsolicited response from " << m_conn->Host() << ":"
+              << toString(m_conn->Port());
+        disconnect();
+        return false;
+    }
+    PendingRequest r = move(m_inflight.front());
+    m_inflight.pop_front();
+
+    if (status != 200)
+    {
+        cwarn << m_conn->Host() << ":" << toString(m_conn->Port()) << " reported status "
+              << statusLine;
+        disconnect();
+        return false;
+    }
+
+    // Out received message only for debug purpouses
+    if (g_logOptions & LOG_JSON)
+        cnote << " << " << body;
 
+    Json::Value jRes;
+    Json::Reader jRdr;
+    if (jRdr.parse(body, jRes))
+    {
+        m_pendingJReq = r.jReq;
+        m_pending_tstamp = r.sent;
+        processResponse(jRes);
     }
     else
     {
-        if (ec != boost::asio::error::operation_aborted)
-        {
-            cwarn << "Error reading from :" << m_conn->Host() << ":" << toString(m_conn->Port())
-                  << " : "
-                  << ec.message();
-            disconnect();
-        }
-       
+        string what = jRdr.getFormattedErrorMessages();
+        boost::replace_all(what, "\n", " ");
+        cwarn << "Got invalid Json message : " << what;
+    }
+
+    if (!keepAlive)
+    {
+        // Node won't process anything sent after this request
+        close_socket(true);
+        begin_write();
+        return false;
+    }
+    m_sockKeepAlive = true;
+
+    begin_write();
+    return true;
+}
+
+bool EthGetworkClient::process_ws_handshake()
+{
+    unsigned status = m_parser.status();
+    string statusLine = m_parser.statusLine();
+    bool accepted = (m_parser.acceptKey() == WebSocketFramer::acceptKey(m_wsKey));
+    m_parser.reset();
+
+    if (status != 101 || !accepted)
+    {
+        cwarn << m_conn->Host() << ":" << toString(m_conn->Port())
+              << " refused WebSocket upgrade : " << statusLine;
+        disconnect();
+        return false;
+    }
+
+    m_wsOpen = true;
+    m_framer.reset();
+    subscribe();
+    begin_write();
+    return true;
+}
+
+bool EthGetworkClient::process_ws_message()
+{
+    WebSocketFramer::Opcode opcode = m_framer.opcode();
+    string payload = m_framer.payload();
+    m_framer.next();
+
+    if (opcode == WebSocketFramer::Opcode::Ping)
+    {
+        ostringstream os;
+        WebSocketFramer::encode(os, WebSocketFramer::Opcode::Pong, payload);
+        m_wsControl.append(os.str());
+        begin_write();
+        return true;
+    }
+    if (opcode == WebSocketFramer::Opcode::Close)
+    {
+        // Node is going away. Whatever is pending goes on a new connection
+        close_socket();
+        begin_write();
+        return false;
+    }
+    if (opcode == WebSocketFramer::Opcode::Text)
+        process_json(payload);
+    return true;
+}
+
+void EthGetworkClient::process_json(const string& payload)
+{
+    uint64_t allocations = threadAllocations();
+    dispatch_json(payload);
+    if (m_conn)
+        m_conn->addMessages(1, threadAllocations() - allocations);
+}
+
+void EthGetworkClient::dispatch_json(const string& payload)
+{
+    m_sockResponses++;
+
+    // Out received message only for debug purpouses
+    if (g_logOptions & LOG_JSON)
+        cnote << " << " << payload;
+
+    Json::Value jRes;
+    Json::Reader jRdr;
+    if (!jRdr.parse(payload, jRes))
+    {
+        string what = jRdr.getFormattedErrorMessages();
+        boost::replace_all(what, "\n", " ");
+        cwarn << "Got invalid Json message : " << what;
+        return;
+    }
+
+    // Node notifies a new head. Get work right away
+    if (jRes.isObject() && jRes.get("method", "").asString() == "eth_subscription")
+    {
+        m_getwork_timer.cancel();
+        send(m_jsonGetWork);
+        return;
     }
+
+    // Responses are not bound to come back in order
+    // thus match them to requests by id
+    Json::Value id = jRes.get("id", Json::Value::null);
+    auto r = find_if(m_inflight.begin(), m_inflight.end(), [&id](const PendingRequest& p) {
+        return p.written && (id.isNull() || p.jReq.get("id", Json::Value::null) == id);
+    });
+    if (r == m_inflight.end())
+    {
+        cwarn << "Unsolicited response from " << m_conn->Host() << ":"
+              << toString(m_conn->Port());
+        return;
+    }
+    m_pendingJReq = r->jReq;
+    m_pending_tstamp = r->sent;
+    m_inflight.erase(r);
+    processResponse(jRes);
+
+    begin_write();
+}
+
+void EthGetworkClient::subscribe()
+{
+    // Get notified of new blocks so work is fetched as soon as it changes
+    Json::Value jReq;
+    jReq["id"] = unsigned(2);
+    jReq["jsonrpc"] = "2.0";
+    jReq["method"] = "eth_subscribe";
+    jReq["params"] = Json::Value(Json::arrayValue);
+    jReq["params"].append("newHeads");
+
+    PendingRequest r;
+    r.line = Json::writeString(m_jSwBuilder, jReq);
+    r.jReq = jReq;
+    m_inflight.push_front(move(r));
 }
 
 void EthGetworkClient::handle_resolve(
-    const boost::system::error_code& ec, tcp::resolver::iterator i)
+    const boost::system::error_code& ec, const vector<tcp::endpoint>& endpoints)
 {
     if (!ec)
     {
-        while (i != tcp::resolver::iterator())
-        {
-            m_endpoints.push(i->endpoint());
-            i++;
-        }
-        m_resolver.cancel();
+        for (auto& endpoint : endpoints)
+            m_endpoints.push(endpoint);
 
         // Resolver has finished so invoke connection asynchronously
         send(m_jsonGetWork);
@@ -392,6 +729,7 @@ void EthGetworkClient::processResponse(Json::Value& JRes)
 
     // We have only theese possible ids
     // 0 or 1 as job notification
+    // 2 as response for eth_subscribe
     // 9 as response for eth_submitHashrate
     // 40+ for responses to mining submissions
     if (_id == 0 || _id == 1)
@@ -406,10 +744,7 @@ void EthGetworkClient::processResponse(Json::Value& JRes)
         {
             cwarn << "Got " << _errReason << " from " << m_conn->Host() << ":"
                   << toString(m_conn->Port());
-            m_getwork_timer.expires_from_now(boost::posix_time::seconds(30));
-            m_getwork_timer.async_wait(
-                m_io_strand.wrap(boost::bind(&EthGetworkClient::getwork_timer_elapsed, this,
-                    boost::asio::placeholders::error)));
+            schedule_getwork(30000);
         }
         else
         {
@@ -435,14 +770,25 @@ void EthGetworkClient::processResponse(Json::Value& JRes)
                     if (m_onWorkReceived)
                         m_onWorkReceived(m_current);
                 }
-                m_getwork_timer.expires_from_now(boost::posix_time::milliseconds(m_farmRecheckPeriod));
-                m_getwork_timer.async_wait(
-                    m_io_strand.wrap(boost::bind(&EthGetworkClient::getwork_timer_elapsed, this,
-                        boost::asio::placeholders::error)));
+
+                // Polling is only a fallback when node pushes new heads
+                schedule_getwork(m_subscribed ? max(m_farmRecheckPeriod, c_pushRecheckPeriod) :
+                                                m_farmRecheckPeriod);
             }
         }
 
     }
+    else if (_id == 2)
+    {
+        // Response to eth_subscribe
+        m_subscribed = _isSuccess;
+        if (_isSuccess)
+            cnote << "Subscribed to new heads on " << m_conn->Host() << ":"
+                  << toString(m_conn->Port());
+        else
+            cwarn << "Got " << _errReason << " subscribing to new heads on " << m_conn->Host()
+                  << ":" << toString(m_conn->Port()) << ". Polling only";
+    }
     else if (_id == 9)
     {
         // Response to hashrate submission
@@ -457,6 +803,8 @@ void EthGetworkClient::processResponse(Json::Value& JRes)
             chrono::steady_clock::now() - m_pending_tstamp);
 
         const unsigned miner_index = _id - 40;
+        if (m_onSolutionResponse)
+            m_onSolutionResponse(_delay, miner_index, submittedNonce(m_pendingJReq), _isSuccess);
         if (_isSuccess)
         {
             if (m_onSolutionAccepted)
@@ -516,10 +864,7 @@ void EthGetworkClient::send(string const& sReq)
 {
     string* line = new string(sReq);
     m_txQueue.push(line);
-
-    bool ex = false;
-    if (m_txPending.compare_exchange_strong(ex, true, memory_order_relaxed))
-        begin_connect();
+    g_io_service.post(m_io_strand.wrap(boost::bind(&EthGetworkClient::begin_write, this)));
 }
 
 void EthGetworkClient::submitHashrate(uint64_t const& rate, string const& id)
@@ -561,6 +906,14 @@ void EthGetworkClient::submitSolution(const Solution& solution)
 
 }
 
+void EthGetworkClient::schedule_getwork(unsigned delay_ms)
+{
+    m_getwork_timer.expires_from_now(boost::posix_time::milliseconds(delay_ms));
+    m_getwork_timer.async_wait(m_io_strand.wrap(makeAllocHandler(m_timerMemory,
+        boost::bind(&EthGetworkClient::getwork_timer_elapsed, this,
+            boost::asio::placeholders::error))));
+}
+
 void EthGetworkClient::getwork_timer_elapsed(const boost::system::error_code& ec) 
 {
     // Triggers the resubmission of a getWork request
@@ -572,7 +925,8 @@ void EthGetworkClient::getwork_timer_elapsed(const boost::system::error_code& ec
         if (_delay.count() > m_worktimeout)
         {
             cwarn << "No new work received in " << m_worktimeout << " seconds.";
-            m_endpoints.pop();
+            if (!m_endpoints.empty())
+                m_endpoints.pop();
             disconnect();
         }
         else
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <deque>
 #include <iostream>
 #include <string>
 
@@ -11,7 +12,12 @@
 
 #include <json/json.h>
 
+#include <libdevcore/HandlerMemory.h>
+
+#include "../DnsCache.h"
 #include "../PoolClient.h"
+#include "HttpParser.h"
+#include "WebSocket.h"
 
 using namespace std;
 using namespace dev;
@@ -28,15 +34,35 @@ public:
     void submitHashrate(uint64_t const& rate, string const& id) override;
     void submitSolution(const Solution& solution) override;
 
+    // Outcome of each solution along with its nonce, so a client submitting
+    // to several nodes can tell submissions apart. Lost ones are those
+    // written on a connection which closed before responding
+    using SolutionResponse =
+        function<void(chrono::milliseconds const&, unsigned const&, uint64_t, bool)>;
+    using SolutionLost = function<void(unsigned const&, uint64_t)>;
+    void onSolutionResponse(SolutionResponse const& _handler) { m_onSolutionResponse = _handler; }
+    void onSolutionLost(SolutionLost const& _handler) { m_onSolutionLost = _handler; }
+
 private:
     unsigned m_farmRecheckPeriod = 500;  // In milliseconds
 
     void begin_connect();
-    void handle_resolve(
-        const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::iterator i);
+    void close_socket(bool _unprocessed = false);
+    void handle_resolve(const boost::system::error_code& ec,
+        const std::vector<boost::asio::ip::tcp::endpoint>& endpoints);
     void handle_connect(const boost::system::error_code& ec);
+    void begin_write();
+    void write_request();
     void handle_write(const boost::system::error_code& ec);
+    void begin_read();
     void handle_read(const boost::system::error_code& ec, std::size_t bytes_transferred);
+    bool process_http_response();
+    bool process_ws_handshake();
+    bool process_ws_message();
+    void process_json(const std::string& payload);
+    void dispatch_json(const std::string& payload);
+    void subscribe();
+    void schedule_getwork(unsigned delay_ms);
     std::string processError(Json::Value& JRes);
     void processResponse(Json::Value& JRes);
     void send(Json::Value const& jReq);
@@ -46,17 +72,48 @@ private:
     WorkPackage m_current;
 
     std::atomic<bool> m_connecting = {false};  // Whether or not socket is on first try connect
-    std::atomic<bool> m_txPending = {false};  // Whether or not an async socket operation is pending
     boost::lockfree::queue<std::string*> m_txQueue;
 
+    // A request sent, or about to be, and waiting for response
+    struct PendingRequest
+    {
+        std::string line;
+        Json::Value jReq;
+        std::chrono::steady_clock::time_point sent;
+        bool written = false;
+    };
+    std::deque<PendingRequest> m_inflight;  // In the order responses are expected
+
+    bool m_sockConnecting = false;
+    bool m_sockConnected = false;  // Connection is kept open across requests
+    bool m_writing = false;
+    bool m_sockKeepAlive = false;  // Node answered with keep-alive on current connection
+    unsigned m_sockResponses = 0;  // Responses received on current connection
+    HttpResponseParser m_parser;
+
+    bool m_ipc = false;         // Node is reached through a unix domain socket
+    bool m_websocket = false;   // Requests go through a WebSocket instead of HTTP posts
+    bool m_wsOpen = false;      // WebSocket handshake completed
+    bool m_subscribed = false;  // Node pushes notifications of new heads
+    std::string m_wsKey;
+    std::string m_wsControl;    // Control frames waiting to be written
+    WebSocketFramer m_framer;
+
     boost::asio::io_service::strand m_io_strand;
 
     boost::asio::ip::tcp::socket m_socket;
-    boost::asio::ip::tcp::resolver m_resolver;
+#if defined(BOOST_ASIO_HAS_LOCAL_SOCKETS)
+    boost::asio::local::stream_protocol::socket m_ipcSocket;
+#endif
     std::queue<boost::asio::ip::basic_endpoint<boost::asio::ip::tcp>> m_endpoints;
 
     boost::asio::streambuf m_request;
     boost::asio::streambuf m_response;
+
+    // Recycled storage of the pending operations
+    dev::HandlerMemory m_readMemory;
+    dev::HandlerMemory m_writeMemory;
+    dev::HandlerMemory m_timerMemory;
     Json::StreamWriterBuilder m_jSwBuilder;
     std::string m_jsonGetWork;
     Json::Value m_pendingJReq;
@@ -69,4 +126,7 @@ private:
     std::chrono::time_point<std::chrono::steady_clock> m_current_tstamp;
 
     unsigned m_solution_submitted_max_id;  // maximum json id we used to send a solution
+
+    SolutionResponse m_onSolutionResponse;
+    SolutionLost m_onSolutionLost;
 };
@@ -0,0 +1,325 @@
+
+#include "EthGetworkRaceClient.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+// Number of recent headers remembered
+static const size_t c_seenHeaders = 8;
+
+// Seconds before nodes which went down are connected again
+static const unsigned c_nodeRetryDelay = 10;
+
+EthGetworkRaceClient::EthGetworkRaceClient(
+    int worktimeout, unsigned farmRecheckPeriod, vector<shared_ptr<URI>> nodes)
+  : PoolClient(),
+    m_worktimeout(worktimeout),
+    m_farmRecheckPeriod(farmRecheckPeriod),
+    m_io_strand(g_io_service),
+    m_reconnect_timer(g_io_service)
+{
+    m_nodes.resize(nodes.size());
+    for (size_t i = 0; i < nodes.size(); i++)
+    {
+        Node& node = m_nodes[i];
+        node.conn = nodes[i];
+        node.client.reset(new EthGetworkClient(m_worktimeout, m_farmRecheckPeriod));
+        node.client->onConnected([this, i]() { node_connected(i); });
+        node.client->onDisconnected([this, i]() { node_disconnected(i); });
+        node.client->onWorkReceived([this, i](WorkPackage const& wp) { node_work(i, wp); });
+        node.client->onSolutionResponse([this, i](chrono::milliseconds const& _delay,
+                                            unsigned const&, uint64_t _nonce, bool _accepted) {
+            node_response(i, _delay, _nonce, _accepted);
+        });
+        node.client->onSolutionLost(
+            [this, i](unsigned const&, uint64_t _nonce) { node_lost(i, _nonce); });
+    }
+}
+
+EthGetworkRaceClient::~EthGetworkRaceClient()
+{
+    m_reconnect_timer.cancel();
+}
+
+void EthGetworkRaceClient::connect()
+{
+    {
+        lock_guard<mutex> l(m_mutex);
+        m_stopping = false;
+        m_seen.clear();
+        m_fanout.clear();
+        m_leader = 0;
+    }
+    for (size_t i = 0; i < m_nodes.size(); i++)
+        connect_node(i);
+}
+
+void EthGetworkRaceClient::connect_node(size_t i)
+{
+    {
+        lock_guard<mutex> l(m_mutex);
+        m_nodes[i].state = NodeState::Connecting;
+    }
+    m_nodes[i].client->setConnection(m_nodes[i].conn);
+    m_nodes[i].client->connect();
+}
+
+void EthGetworkRaceClient::disconnect()
+{
+    {
+        lock_guard<mutex> l(m_mutex);
+        if (m_stopping)
+            return;
+        m_stopping = true;
+    }
+    m_reconnect_timer.cancel();
+
+    vector<EthGetworkClient*> clients;
+    {
+        lock_guard<mutex> l(m_mutex);
+        for (auto& node : m_nodes)
+        {
+            if (node.state != NodeState::Down)
+                clients.push_back(node.client.get());
+            node.state = NodeState::Down;
+        }
+    }
+    for (auto client : clients)
+        client->disconnect();
+
+    m_connected.store(false, memory_order_relaxed);
+    if (m_session)
+        m_conn->addDuration(m_session->duration());
+    m_session = nullptr;
+
+    if (m_onDisconnected)
+        m_onDisconnected();
+}
+
+string EthGetworkRaceClient::ActiveEndPoint()
+{
+    lock_guard<mutex> l(m_mutex);
+    if (m_leader < m_nodes.size())
+        return m_nodes[m_leader].client->ActiveEndPoint();
+    return "";
+}
+
+void EthGetworkRaceClient::node_connected(size_t i)
+{
+    bool first;
+    {
+        lock_guard<mutex> l(m_mutex);
+        if (m_stopping)
+            return;
+        m_nodes[i].state = NodeState::Up;
+        first = !m_connected.load(memory_order_relaxed);
+        if (first)
+        {
+            m_connected.store(true, memory_order_relaxed);
+            m_session = unique_ptr<Session>(new Session);
+            m_session->subscribed.store(true, memory_order_relaxed);
+            m_session->authorized.store(true, memory_order_relaxed);
+        }
+    }
+
+    cnote << "Getwork node " << m_nodes[i].conn->Host() << ":"
+          << toString(m_nodes[i].conn->Port()) << " joined the race";
+    if (first && m_onConnected)
+        m_onConnected();
+}
+
+void EthGetworkRaceClient::node_disconnected(size_t i)
+{
+    bool anyLeft = false;
+    vector<Verdict> verdicts;
+    {
+        lock_guard<mutex> l(m_mutex);
+        if (m_stopping)
+            return;
+        m_nodes[i].state = NodeState::Down;
+        for (auto& node : m_nodes)
+            anyLeft |= (node.state != NodeState::Down);
+
+        // Responses this node still owed will never come
+        for (auto f = m_fanout.begin(); f != m_fanout.end();)
+        {
+            auto next = std::next(f);
+            if (f->second.owing.erase(i))
+                settle(f, verdicts);
+            f = next;
+        }
+    }
+    report(verdicts);
+
+    // Give up only when no node is left
+    if (!anyLeft)
+    {
+        disconnect();
+        return;
+    }
+
+    // Nodes which never got up are retried as well
+    g_io_service.post(
+        m_io_strand.wrap(boost::bind(&EthGetworkRaceClient::schedule_reconnect, this)));
+}
+
+void EthGetworkRaceClient::schedule_reconnect()
+{
+    m_reconnect_timer.expires_from_now(boost::posix_time::seconds(c_nodeRetryDelay));
+    m_reconnect_timer.async_wait(m_io_strand.wrap(boost::bind(
+        &EthGetworkRaceClient::reconnect_timer_elapsed, this, boost::asio::placeholders::error)));
+}
+
+void EthGetworkRaceClient::reconnect_timer_elapsed(const boost::system::error_code& ec)
+{
+    if (ec)
+        return;
+    vector<size_t> down;
+    {
+        lock_guard<mutex> l(m_mutex);
+        if (m_stopping)
+            return;
+        for (size_t i = 0; i < m_nodes.size(); i++)
+            if (m_nodes[i].state == NodeState::Down)
+                down.push_back(i);
+    }
+    for (size_t i : down)
+        connect_node(i);
+}
+
+void EthGetworkRaceClient::node_work(size_t i, WorkPackage const& wp)
+{
+    {
+        lock_guard<mutex> l(m_mutex);
+        if (m_stopping)
+            return;
+
+        // Same header from slower nodes, or an old one from a
+        // node lagging behind, must not switch work back
+        if (find(m_seen.begin(), m_seen.end(), wp.header) != m_seen.end())
+            return;
+        m_seen.push_back(wp.header);
+        if (m_seen.size() > c_seenHeaders)
+            m_seen.pop_front();
+
+        m_nodes[i].firsts++;
+        m_leader = i;
+    }
+
+#ifdef DEV_BUILD
+    if (g_logOptions & LOG_SWITCH)
+        cnote << "Getwork node " << m_nodes[i].conn->Host() << ":"
+              << toString(m_nodes[i].conn->Port()) << " first with header "
+              << wp.header.abridged() << " (" << m_nodes[i].firsts << " times)";
+#endif
+
+    if (m_onWorkReceived)
+        m_onWorkReceived(wp);
+}
+
+void EthGetworkRaceClient::node_response(
+    size_t i, chrono::milliseconds const& delay, uint64_t nonce, bool accepted)
+{
+    vector<Verdict> verdicts;
+    {
+        lock_guard<mutex> l(m_mutex);
+        auto f = m_fanout.find(nonce);
+        if (f == m_fanout.end() || !f->second.owing.erase(i))
+            return;
+        f->second.delay = delay;
+
+        // First acceptance counts
+        if (accepted && !f->second.reported)
+        {
+            f->second.reported = true;
+            verdicts.push_back({delay, f->second.midx, true});
+        }
+        f->second.rejected |= !accepted;
+        settle(f, verdicts);
+    }
+    report(verdicts);
+}
+
+void EthGetworkRaceClient::node_lost(size_t i, uint64_t nonce)
+{
+    vector<Verdict> verdicts;
+    {
+        lock_guard<mutex> l(m_mutex);
+        auto f = m_fanout.find(nonce);
+        if (f == m_fanout.end() || !f->second.owing.erase(i))
+            return;
+        settle(f, verdicts);
+    }
+    report(verdicts);
+}
+
+void EthGetworkRaceClient::settle(map<uint64_t, Fanout>::iterator f, vector<Verdict>& verdicts)
+{
+    // Lock must be held. Once no node owes a response a rejection is
+    // reported, if nothing was accepted and some node did reject.
+    // Solutions every node lost are left unreported, as with a single node
+    if (!f->second.owing.empty())
+        return;
+    if (!f->second.reported && f->second.rejected)
+        verdicts.push_back({f->second.delay, f->second.midx, false});
+    m_fanout.erase(f);
+}
+
+void EthGetworkRaceClient::report(vector<Verdict> const& verdicts)
+{
+    for (auto const& v : verdicts)
+    {
+        if (v.accepted)
+        {
+            if (m_onSolutionAccepted)
+                m_onSolutionAccepted(v.delay, v.midx, false);
+        }
+        else
+        {
+            if (m_onSolutionRejected)
+                m_onSolutionRejected(v.delay, v.midx);
+        }
+    }
+}
+
+vector<EthGetworkClient*> EthGetworkRaceClient::nodesUp()
+{
+    vector<EthGetworkClient*> clients;
+    for (auto& node : m_nodes)
+        if (node.state == NodeState::Up)
+            clients.push_back(node.client.get());
+    return clients;
+}
+
+void EthGetworkRaceClient::submitHashrate(uint64_t const& rate, string const& id)
+{
+    vector<EthGetworkClient*> clients;
+    {
+        lock_guard<mutex> l(m_mutex);
+        clients = nodesUp();
+    }
+    for (auto client : clients)
+        client->submitHashrate(rate, id);
+}
+
+void EthGetworkRaceClient::submitSolution(const Solution& solution)
+{
+    vector<EthGetworkClient*> clients;
+    {
+        lock_guard<mutex> l(m_mutex);
+        clients = nodesUp();
+        if (clients.empty())
+            return;
+        Fanout& f = m_fanout[solution.nonce];
+        f = Fanout();
+        f.midx = solution.midx;
+        for (size_t i = 0; i < m_nodes.size(); i++)
+            if (m_nodes[i].state == NodeState::Up)
+                f.owing.insert(i);
+    }
+
+    // All at once so the block propagates from every node
+    for (auto client : clients)
+        client->submitSolution(solution);
+}
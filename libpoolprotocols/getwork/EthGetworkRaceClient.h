@@ -0,0 +1,99 @@
+
+#pragma once
+
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <vector>
+
+#include <boost/asio.hpp>
+
+#include "../PoolClient.h"
+#include "EthGetworkClient.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+/**
+ * @brief Gets work from several nodes at once for solo mining.
+ * Every node is polled (or pushes new heads) on a connection of its own.
+ * Whichever reports a new header first sets the work to mine, and found
+ * solutions are submitted to all of them so the block propagates from
+ * several places. Client stays connected as long as any node is.
+ */
+class EthGetworkRaceClient : public PoolClient
+{
+public:
+    EthGetworkRaceClient(
+        int worktimeout, unsigned farmRecheckPeriod, std::vector<std::shared_ptr<URI>> nodes);
+    ~EthGetworkRaceClient();
+
+    void connect() override;
+    void disconnect() override;
+    string ActiveEndPoint() override;
+    void submitHashrate(uint64_t const& rate, string const& id) override;
+    void submitSolution(const Solution& solution) override;
+
+private:
+    enum class NodeState
+    {
+        Down,
+        Connecting,
+        Up
+    };
+
+    struct Node
+    {
+        std::shared_ptr<URI> conn;
+        std::unique_ptr<EthGetworkClient> client;
+        NodeState state = NodeState::Down;
+        unsigned firsts = 0;  // New headers this node reported before others
+    };
+
+    // A solution submitted to every node. Accepted if any node accepts it
+    struct Fanout
+    {
+        unsigned midx = 0;
+        std::set<size_t> owing;  // Nodes yet to respond
+        bool rejected = false;   // By some node
+        chrono::milliseconds delay = chrono::milliseconds(0);  // Of last response
+        bool reported = false;
+    };
+
+    // Outcome of a solution to report
+    struct Verdict
+    {
+        chrono::milliseconds delay;
+        unsigned midx;
+        bool accepted;
+    };
+
+    void connect_node(size_t i);
+    std::vector<EthGetworkClient*> nodesUp();  // Lock must be held
+    void node_connected(size_t i);
+    void node_disconnected(size_t i);
+    void node_work(size_t i, WorkPackage const& wp);
+    void node_response(
+        size_t i, chrono::milliseconds const& delay, uint64_t nonce, bool accepted);
+    void node_lost(size_t i, uint64_t nonce);
+    void settle(std::map<uint64_t, Fanout>::iterator f, std::vector<Verdict>& verdicts);
+    void report(std::vector<Verdict> const& verdicts);
+    void schedule_reconnect();
+    void reconnect_timer_elapsed(const boost::system::error_code& ec);
+
+    int m_worktimeout;
+    unsigned m_farmRecheckPeriod;
+    std::vector<Node> m_nodes;
+
+    std::mutex m_mutex;
+    bool m_stopping = false;
+    std::deque<h256> m_seen;  // Latest headers, to ignore nodes lagging behind
+    size_t m_leader = 0;      // Node which reported current work first
+    std::map<uint64_t, Fanout> m_fanout;  // By nonce
+
+    boost::asio::io_service::strand m_io_strand;
+    boost::asio::deadline_timer m_reconnect_timer;  // Retries nodes which went down
+};
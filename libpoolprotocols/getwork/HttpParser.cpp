@@ -0,0 +1,229 @@
+
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+
+#include "HttpParser.h"
+
+using namespace std;
+
+namespace dev
+{
+namespace eth
+{
+// Guards against endless headers or bodies
+static const size_t c_maxLine = 8192;
+static const size_t c_maxBody = 1024 * 1024;
+
+void HttpResponseParser::reset()
+{
+    m_state = State::StatusLine;
+    m_line.clear();
+    m_statusLine.clear();
+    m_body.clear();
+    m_accept.clear();
+    m_status = 0;
+    m_remaining = 0;
+    m_hasLength = false;
+    m_chunked = false;
+    m_keepAlive = false;
+}
+
+size_t HttpResponseParser::parse(const char* _data, size_t _size)
+{
+    size_t i = 0;
+    while (i < _size && m_state != State::Complete && m_state != State::Failed)
+    {
+        switch (m_state)
+        {
+        case State::Body:
+        case State::ChunkData:
+        {
+            size_t n = min(m_remaining, _size - i);
+            m_body.append(_data + i, n);
+            m_remaining -= n;
+            i += n;
+            if (!m_remaining)
+                m_state = (m_state == State::Body ? State::Complete : State::ChunkEnd);
+            break;
+        }
+
+        case State::UntilClose:
+            if (m_body.size() + _size - i > c_maxBody)
+            {
+                m_state = State::Failed;
+                break;
+            }
+            m_body.append(_data + i, _size - i);
+            i = _size;
+            break;
+
+        default:
+        {
+            // Line oriented states
+            const char* end = static_cast<const char*>(memchr(_data + i, '\n', _size - i));
+            size_t n = (end ? end - (_data + i) : _size - i);
+            m_line.append(_data + i, n);
+            i += n;
+            if (m_line.size() > c_maxLine)
+            {
+                m_state = State::Failed;
+                break;
+            }
+            if (end)
+            {
+                i++;
+                if (!m_line.empty() && m_line.back() == '\r')
+                    m_line.pop_back();
+                onLine();
+                m_line.clear();
+            }
+            break;
+        }
+        }
+    }
+    return i;
+}
+
+bool HttpResponseParser::eof()
+{
+    if (m_state == State::UntilClose)
+        m_state = State::Complete;
+    return m_state == State::Complete;
+}
+
+void HttpResponseParser::onLine()
+{
+    switch (m_state)
+    {
+    case State::StatusLine:
+    {
+        // Tolerate empty lines before status
+        if (m_line.empty())
+            return;
+        size_t sp = m_line.find(' ');
+        if (m_line.compare(0, 7, "HTTP/1.") || sp == string::npos || m_line.size() < sp + 4)
+        {
+            m_state = State::Failed;
+            return;
+        }
+        m_statusLine = m_line.substr(sp + 1);
+        m_status = unsigned(strtoul(m_statusLine.c_str(), nullptr, 10));
+        m_keepAlive = (m_line[7] != '0');
+        m_state = State::Header;
+        break;
+    }
+
+    case State::Header:
+        if (m_line.empty())
+            onHeadersEnd();
+        else
+            onHeader();
+        break;
+
+    case State::ChunkSize:
+    {
+        char* end;
+        m_remaining = size_t(strtoul(m_line.c_str(), &end, 16));
+        if (end == m_line.c_str() || m_body.size() + m_remaining > c_maxBody)
+            m_state = State::Failed;
+        else
+            m_state = (m_remaining ? State::ChunkData : State::Trailer);
+        break;
+    }
+
+    case State::ChunkEnd:
+        m_state = (m_line.empty() ? State::ChunkSize : State::Failed);
+        break;
+
+    case State::Trailer:
+        if (m_line.empty())
+            m_state = State::Complete;
+        break;
+
+    default:
+        break;
+    }
+}
+
+void HttpResponseParser::onHeader()
+{
+    size_t colon = m_line.find(':');
+    if (colon == string::npos)
+        return;
+
+    string name = m_line.substr(0, colon);
+    string value = m_line.substr(colon + 1);
+    transform(name.begin(), name.end(), name.begin(), ::tolower);
+    value.erase(0, value.find_first_not_of(" \t"));
+    value.erase(value.find_last_not_of(" \t") + 1);
+
+    // Base64, thus case sensitive
+    if (name == "sec-websocket-accept")
+    {
+        m_accept = value;
+        return;
+    }
+    transform(value.begin(), value.end(), value.begin(), ::tolower);
+
+    if (name == "content-length")
+    {
+        m_remaining = size_t(strtoul(value.c_str(), nullptr, 10));
+        m_hasLength = true;
+    }
+    else if (name == "transfer-encoding")
+    {
+        m_chunked = (value.find("chunked") != string::npos);
+    }
+    else if (name == "connection")
+    {
+        if (value.find("close") != string::npos)
+            m_keepAlive = false;
+        else if (value.find("keep-alive") != string::npos)
+            m_keepAlive = true;
+    }
+}
+
+void HttpResponseParser::onHeadersEnd()
+{
+    // Connection is no longer HTTP past a protocol switch
+    if (m_status == 101)
+    {
+        m_state = State::Complete;
+        return;
+    }
+
+    // Interim responses (eg. 100 Continue) are followed by the actual one
+    if (m_status >= 100 && m_status < 200)
+    {
+        bool keepAlive = m_keepAlive;
+        reset();
+        m_keepAlive = keepAlive;
+        return;
+    }
+
+    if (m_chunked)
+    {
+        m_state = State::ChunkSize;
+    }
+    else if (m_hasLength)
+    {
+        if (m_remaining > c_maxBody)
+            m_state = State::Failed;
+        else
+            m_state = (m_remaining ? State::Body : State::Complete);
+    }
+    else if (m_status == 204 || m_status == 304)
+    {
+        m_state = State::Complete;
+    }
+    else
+    {
+        m_state = State::UntilClose;
+        m_keepAlive = false;
+    }
+}
+
+}  // namespace eth
+}  // namespace dev
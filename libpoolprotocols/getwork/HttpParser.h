@@ -0,0 +1,78 @@
+
+#pragma once
+
+#include <string>
+
+namespace dev
+{
+namespace eth
+{
+/**
+ * @brief Incremental parser of HTTP/1.x responses.
+ * Data is fed as it's received from socket. Body is delimited by
+ * Content-Length, chunked transfer encoding or connection close.
+ * Parsing stops at the end of a response so data following it
+ * (pipelined responses) is left to the next one. A 101 response
+ * completes as soon as its headers end.
+ */
+class HttpResponseParser
+{
+public:
+    HttpResponseParser() { reset(); }
+
+    // Gets ready for next response
+    void reset();
+
+    // Consumes data up to the end of current response. Returns
+    // the number of bytes used
+    size_t parse(const char* _data, size_t _size);
+
+    // Connection closed by server. True if this completes the response
+    bool eof();
+
+    bool complete() const { return m_state == State::Complete; }
+    bool failed() const { return m_state == State::Failed; }
+
+    unsigned status() const { return m_status; }
+    const std::string& statusLine() const { return m_statusLine; }
+    const std::string& body() const { return m_body; }
+
+    // Sec-WebSocket-Accept value of a 101 Switching Protocols response
+    const std::string& acceptKey() const { return m_accept; }
+
+    // Whether server keeps connection open after this response
+    bool keepAlive() const { return m_keepAlive; }
+
+private:
+    enum class State
+    {
+        StatusLine,
+        Header,
+        Body,        // Content-Length bytes
+        ChunkSize,
+        ChunkData,
+        ChunkEnd,    // Line break following chunk data
+        Trailer,
+        UntilClose,  // No length given, body ends with connection
+        Complete,
+        Failed
+    };
+
+    void onLine();
+    void onHeader();
+    void onHeadersEnd();
+
+    State m_state;
+    std::string m_line;
+    std::string m_statusLine;
+    std::string m_body;
+    std::string m_accept;
+    unsigned m_status;
+    size_t m_remaining;  // Bytes left in body or chunk
+    bool m_hasLength;
+    bool m_chunked;
+    bool m_keepAlive;
+};
+
+}  // namespace eth
+}  // namespace dev
@@ -0,0 +1,230 @@
+
+#include <cstring>
+#include <random>
+
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+
+#include "WebSocket.h"
+
+using namespace std;
+
+namespace dev
+{
+namespace eth
+{
+// Guards against endless messages
+static const uint64_t c_maxMessage = 1024 * 1024;
+
+namespace
+{
+string base64(const unsigned char* _data, size_t _size)
+{
+    string out(4 * ((_size + 2) / 3) + 1, '\0');
+    int n = EVP_EncodeBlock(reinterpret_cast<unsigned char*>(&out[0]), _data, int(_size));
+    out.resize(size_t(n));
+    return out;
+}
+
+uint32_t randomMask()
+{
+    static random_device rd;
+    static mt19937 gen(rd());
+    return uint32_t(gen());
+}
+
+}  // namespace
+
+void WebSocketFramer::handshake(ostream& _out, const string& _host, unsigned short _port,
+    const string& _path, string& _key)
+{
+    unsigned char nonce[16];
+    for (size_t i = 0; i < sizeof(nonce); i += 4)
+    {
+        uint32_t r = randomMask();
+        memcpy(nonce + i, &r, 4);
+    }
+    _key = base64(nonce, sizeof(nonce));
+
+    _out << "GET " << (_path.empty() ? "/" : _path) << " HTTP/1.1\r\n";
+    _out << "Host: " << _host << ":" << _port << "\r\n";
+    _out << "Upgrade: websocket\r\n";
+    _out << "Connection: Upgrade\r\n";
+    _out << "Sec-WebSocket-Key: " << _key << "\r\n";
+    _out << "Sec-WebSocket-Version: 13\r\n\r\n";
+}
+
+string WebSocketFramer::acceptKey(const string& _key)
+{
+    string s = _key + "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    SHA1(reinterpret_cast<const unsigned char*>(s.data()), s.size(), digest);
+    return base64(digest, sizeof(digest));
+}
+
+void WebSocketFramer::encode(ostream& _out, Opcode _opcode, const string& _payload)
+{
+    // Client frames are always final and masked
+    char header[14];
+    size_t n = 0;
+    header[n++] = char(0x80 | uint8_t(_opcode));
+    uint64_t size = _payload.size();
+    if (size < 126)
+    {
+        header[n++] = char(0x80 | size);
+    }
+    else if (size <= 0xffff)
+    {
+        header[n++] = char(0x80 | 126);
+        header[n++] = char(size >> 8);
+        header[n++] = char(size);
+    }
+    else
+    {
+        header[n++] = char(0x80 | 127);
+        for (int i = 7; i >= 0; i--)
+            header[n++] = char(size >> (i * 8));
+    }
+
+    uint32_t mask = randomMask();
+    char key[4];
+    memcpy(key, &mask, 4);
+    memcpy(header + n, key, 4);
+    n += 4;
+    _out.write(header, n);
+
+    string masked(_payload);
+    for (size_t i = 0; i < masked.size(); i++)
+        masked[i] ^= key[i & 3];
+    _out << masked;
+}
+
+void WebSocketFramer::reset()
+{
+    m_message.clear();
+    m_messageOpcode = Opcode::Text;
+    next();
+}
+
+void WebSocketFramer::next()
+{
+    m_state = State::Header;
+    m_headerSize = 0;
+    m_headerNeeded = 2;
+    m_remaining = 0;
+    m_frame.clear();
+    m_payload.clear();
+}
+
+size_t WebSocketFramer::parse(const char* _data, size_t _size)
+{
+    size_t i = 0;
+    while (i < _size && m_state != State::Complete && m_state != State::Failed)
+    {
+        if (m_state == State::Header)
+        {
+            size_t n = min(m_headerNeeded - m_headerSize, _size - i);
+            memcpy(m_header + m_headerSize, _data + i, n);
+            m_headerSize += n;
+            i += n;
+            if (m_headerSize == m_headerNeeded && onHeader())
+            {
+                m_state = State::Payload;
+                if (!m_remaining)
+                    onFrame();
+            }
+            continue;
+        }
+
+        size_t n = size_t(min<uint64_t>(m_remaining, _size - i));
+        m_frame.append(_data + i, n);
+        m_remaining -= n;
+        i += n;
+        if (!m_remaining)
+            onFrame();
+    }
+    return i;
+}
+
+bool WebSocketFramer::onHeader()
+{
+    // Header length is only known after its first two bytes
+    if (m_headerNeeded == 2)
+    {
+        uint8_t len = m_header[1] & 0x7f;
+        m_masked = (m_header[1] & 0x80) != 0;
+        m_headerNeeded += (len == 126 ? 2 : (len == 127 ? 8 : 0)) + (m_masked ? 4 : 0);
+        if (m_headerNeeded > 2)
+            return false;
+    }
+
+    m_fin = (m_header[0] & 0x80) != 0;
+    m_frameOpcode = Opcode(m_header[0] & 0x0f);
+    uint8_t len = m_header[1] & 0x7f;
+    size_t p = 2;
+    if (len == 126)
+    {
+        m_remaining = (uint64_t(m_header[2]) << 8) | m_header[3];
+        p = 4;
+    }
+    else if (len == 127)
+    {
+        m_remaining = 0;
+        for (p = 2; p < 10; p++)
+            m_remaining = (m_remaining << 8) | m_header[p];
+    }
+    else
+    {
+        m_remaining = len;
+    }
+
+    if (m_remaining + m_message.size() > c_maxMessage)
+    {
+        m_state = State::Failed;
+        return false;
+    }
+    m_frame.reserve(size_t(m_remaining));
+    return true;
+}
+
+void WebSocketFramer::onFrame()
+{
+    // Servers should not mask but be tolerant
+    if (m_masked)
+    {
+        const uint8_t* key = m_header + m_headerNeeded - 4;
+        for (size_t i = 0; i < m_frame.size(); i++)
+            m_frame[i] ^= key[i & 3];
+    }
+
+    // Control frames may come in between fragments of a message
+    if (uint8_t(m_frameOpcode) >= uint8_t(Opcode::Close))
+    {
+        m_opcode = m_frameOpcode;
+        m_payload.swap(m_frame);
+        m_state = State::Complete;
+        return;
+    }
+
+    if (m_frameOpcode != Opcode::Continuation)
+        m_messageOpcode = m_frameOpcode;
+    m_message.append(m_frame);
+
+    if (!m_fin)
+    {
+        // Wait for next fragment
+        m_state = State::Header;
+        m_headerSize = 0;
+        m_headerNeeded = 2;
+        m_frame.clear();
+        return;
+    }
+
+    m_opcode = m_messageOpcode;
+    m_payload.swap(m_message);
+    m_message.clear();
+    m_state = State::Complete;
+}
+
+}  // namespace eth
+}  // namespace dev
@@ -0,0 +1,84 @@
+
+#pragma once
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace dev
+{
+namespace eth
+{
+/**
+ * @brief Client side framing of the WebSocket protocol (RFC 6455).
+ * Builds the opening handshake, writes masked frames and decodes
+ * incrementally the frames sent by server, reassembling fragmented
+ * messages. Control frames are returned as soon as they're complete.
+ */
+class WebSocketFramer
+{
+public:
+    enum class Opcode : uint8_t
+    {
+        Continuation = 0,
+        Text = 1,
+        Binary = 2,
+        Close = 8,
+        Ping = 9,
+        Pong = 10
+    };
+
+    // Writes the opening handshake request. _key receives the key sent
+    static void handshake(std::ostream& _out, const std::string& _host, unsigned short _port,
+        const std::string& _path, std::string& _key);
+
+    // Value server is expected to reply in Sec-WebSocket-Accept
+    static std::string acceptKey(const std::string& _key);
+
+    // Writes a single, masked, frame
+    static void encode(std::ostream& _out, Opcode _opcode, const std::string& _payload);
+
+    WebSocketFramer() { reset(); }
+    void reset();
+
+    // Consumes data up to the end of current message. Returns
+    // the number of bytes used
+    size_t parse(const char* _data, size_t _size);
+
+    bool complete() const { return m_state == State::Complete; }
+    bool failed() const { return m_state == State::Failed; }
+    Opcode opcode() const { return m_opcode; }
+    const std::string& payload() const { return m_payload; }
+
+    // Gets ready for next message
+    void next();
+
+private:
+    enum class State
+    {
+        Header,
+        Payload,
+        Complete,
+        Failed
+    };
+
+    bool onHeader();
+    void onFrame();
+
+    State m_state;
+    uint8_t m_header[14];
+    size_t m_headerSize;    // Bytes of header received
+    size_t m_headerNeeded;  // Bytes header is made of
+    uint64_t m_remaining;   // Payload bytes left in frame
+    bool m_fin;
+    bool m_masked;
+    Opcode m_frameOpcode;
+    std::string m_frame;    // Current frame payload
+    Opcode m_messageOpcode;
+    std::string m_message;  // Fragments received so far
+    Opcode m_opcode;
+    std::string m_payload;  // Completed message
+};
+
+}  // namespace eth
+}  // namespace dev
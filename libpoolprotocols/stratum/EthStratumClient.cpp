@@ -1,18 +1,23 @@
 
+#include <libdevcore/Allocations.h>
 #include <libdevcore/Log.h>
 #include <nsfminer/buildinfo.h>
 #include <ethash/ethash.hpp>
 
 #include "EthStratumClient.h"
-
-#ifdef _WIN32
-// Needed for certificates validation on TLS connections
-#include <wincrypt.h>
-#endif
+#include "TlsContext.h"
 
 using boost::asio::ip::tcp;
 
-EthStratumClient::EthStratumClient(int worktimeout, int responsetimeout)
+// Max number of queued lines gathered in a single write
+static const size_t c_maxTxBatch = 32;
+static const char c_lineDelimiter = '\n';
+
+// Head start (milliseconds) given to a connection attempt before
+// the next endpoint is raced against it
+static const int c_connectAttemptDelay = 250;
+
+EthStratumClient::EthStratumClient(int worktimeout, int responsetimeout, double sharerate)
   : PoolClient(),
     m_worktimeout(worktimeout),
     m_responsetimeout(responsetimeout),
@@ -20,12 +25,16 @@ EthStratumClient::EthStratumClient(int worktimeout, int responsetimeout)
     m_io_strand(g_io_service),
     m_socket(nullptr),
     m_workloop_timer(g_io_service),
+    m_connectrace_timer(g_io_service),
     m_response_plea_times(64),
     m_txQueue(64),
-    m_resolver(g_io_service),
-    m_endpoints()
+    m_txSpare(64),
+    m_endpoints(),
+    m_shareRate(sharerate)
 {
     m_jSwBuilder.settings_["indentation"] = "";
+    m_txInflight.reserve(c_maxTxBatch);
+    m_txBuffers.reserve(c_maxTxBatch * 2);
 
     // Initialize workloop_timer to infinite wait
     m_workloop_timer.expires_at(boost::posix_time::pos_infin);
@@ -34,63 +43,27 @@ EthStratumClient::EthStratumClient(int worktimeout, int responsetimeout)
     clear_response_pleas();
 }
 
+EthStratumClient::~EthStratumClient()
+{
+    for (string* line : m_txInflight)
+        delete line;
+    m_txQueue.consume_all([](string* l) { delete l; });
+    m_txSpare.consume_all([](string* l) { delete l; });
+}
+
 void EthStratumClient::init_socket()
 {
     // Prepare Socket
     if (m_conn->SecLevel() != SecureLevel::NONE)
     {
-        boost::asio::ssl::context::method method = boost::asio::ssl::context::tls_client;
-        if (m_conn->SecLevel() == SecureLevel::TLS)
-            method = boost::asio::ssl::context::tlsv12;
-
-        boost::asio::ssl::context ctx(method);
-        m_securesocket =
-            make_shared<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>>(m_io_service, ctx);
+        // Context (and trusted certificates) are shared among connections
+        m_securesocket = make_shared<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>>(
+            m_io_service, TlsContext::get().context());
         m_socket = &m_securesocket->next_layer();
 
         m_securesocket->set_verify_mode(boost::asio::ssl::verify_peer);
         m_securesocket->set_verify_callback(
             make_verbose_verification(boost::asio::ssl::rfc2818_verification(m_conn->Host())));
-
-#ifdef _WIN32
-        HCERTSTORE hStore = CertOpenSystemStore(0, "ROOT");
-        if (hStore == nullptr)
-        {
-            return;
-        }
-
-        X509_STORE* store = X509_STORE_new();
-        PCCERT_CONTEXT pContext = nullptr;
-        while ((pContext = CertEnumCertificatesInStore(hStore, pContext)) != nullptr)
-        {
-            X509* x509 = d2i_X509(
-                nullptr, (const unsigned char**)&pContext->pbCertEncoded, pContext->cbCertEncoded);
-            if (x509 != nullptr)
-            {
-                X509_STORE_add_cert(store, x509);
-                X509_free(x509);
-            }
-        }
-
-        CertFreeCertificateContext(pContext);
-        CertCloseStore(hStore, 0);
-
-        SSL_CTX_set_cert_store(ctx.native_handle(), store);
-#else
-        char* certPath = getenv("SSL_CERT_FILE");
-        try
-        {
-            ctx.load_verify_file(certPath ? certPath : "/etc/ssl/certs/ca-certificates.crt");
-        }
-        catch (...)
-        {
-            cwarn << "Failed to load ca certificates. Either the file "
-                     "'/etc/ssl/certs/ca-certificates.crt' does not exist";
-            cwarn << "or the environment variable SSL_CERT_FILE is set to an invalid or "
-                     "inaccessible file.";
-            cwarn << "It is possible that certificate verification can fail.";
-        }
-#endif
     }
     else
     {
@@ -140,16 +113,10 @@ void EthStratumClient::connect()
     if (m_conn->HostNameType() == dev::UriHostNameType::Dns ||
         m_conn->HostNameType() == dev::UriHostNameType::Basic)
     {
-        // Begin resolve all ips associated to hostname
-        // calling the resolver each time is useful as most
-        // load balancer will give Ips in different order
-        m_resolver = tcp::resolver(m_io_service);
-        tcp::resolver::query q(m_conn->Host(), toString(m_conn->Port()));
-
-        // Start resolving async
-        m_resolver.async_resolve(
-            q, m_io_strand.wrap(boost::bind(&EthStratumClient::resolve_handler, this,
-                   boost::asio::placeholders::error, boost::asio::placeholders::iterator)));
+        // Get all ips associated to hostname. Cache keeps them
+        // resolved in background so this does not wait on DNS
+        DnsCache::d().resolve(m_conn->Host(), m_conn->Port(),
+            m_io_strand.wrap(boost::bind(&EthStratumClient::resolve_handler, this, _1, _2)));
     }
     else
     {
@@ -170,6 +137,11 @@ void EthStratumClient::disconnect()
     m_connected.store(false, memory_order_relaxed);
 
     // Cancel any outstanding async operation
+    if (m_connecting.load(memory_order_relaxed))
+    {
+        cancel_connect_attempts();
+        m_connecting.store(false, memory_order_relaxed);
+    }
     if (m_socket)
         m_socket->cancel();
 
@@ -262,7 +234,6 @@ void EthStratumClient::disconnect_finalize()
 
     // Clear plea queue and stop timing
     clear_response_pleas();
-    m_solution_submitted_max_id = 0;
 
     // Put the actor back to sleep
     m_workloop_timer.expires_at(boost::posix_time::pos_infin);
@@ -275,16 +246,27 @@ void EthStratumClient::disconnect_finalize()
 }
 
 void EthStratumClient::resolve_handler(
-    const boost::system::error_code& ec, tcp::resolver::iterator i)
+    const boost::system::error_code& ec, const vector<tcp::endpoint>& endpoints)
 {
     if (!ec)
     {
-        while (i != tcp::resolver::iterator())
+        // Alternate address families so both get raced early on,
+        // starting with the family resolver put first
+        vector<tcp::endpoint> first, second;
+        for (auto& endpoint : endpoints)
         {
-            m_endpoints.push(i->endpoint());
-            i++;
+            if (first.empty() || first.front().protocol() == endpoint.protocol())
+                first.push_back(endpoint);
+            else
+                second.push_back(endpoint);
+        }
+        for (size_t j = 0; j < max(first.size(), second.size()); j++)
+        {
+            if (j < first.size())
+                m_endpoints.push(first[j]);
+            if (j < second.size())
+                m_endpoints.push(second[j]);
         }
-        m_resolver.cancel();
 
         // Resolver has finished so invoke connection asynchronously
         m_io_service.post(m_io_strand.wrap(boost::bind(&EthStratumClient::start_connect, this)));
@@ -309,35 +291,30 @@ void EthStratumClient::start_connect()
 
     if (!m_endpoints.empty())
     {
-        // Pick the first endpoint in list.
-        // Eventually endpoints get discarded on connection errors
-        m_endpoint = m_endpoints.front();
-
         // Re-init socket if we need to
         if (m_socket == nullptr)
             init_socket();
 
-#ifdef DEV_BUILD
-        if (g_logOptions & LOG_CONNECT)
-            cnote << ("Trying " + toString(m_endpoint) + " ...");
-#endif
-
         clear_response_pleas();
         m_connecting.store(true, memory_order::memory_order_relaxed);
         enqueue_response_plea();
-        m_solution_submitted_max_id = 0;
 
-        // Start connecting async
-        if (m_conn->SecLevel() != SecureLevel::NONE)
-        {
-            m_securesocket->lowest_layer().async_connect(m_endpoint,
-                m_io_strand.wrap(boost::bind(&EthStratumClient::connect_handler, this, _1)));
-        }
-        else
-        {
-            m_socket->async_connect(m_endpoint,
-                m_io_strand.wrap(boost::bind(&EthStratumClient::connect_handler, this, _1)));
-        }
+        // Race all endpoints : a new attempt is started whenever the
+        // previous ones do not complete within c_connectAttemptDelay
+        // or fail. First socket to connect wins and the others are dropped.
+        // Endpoints failing to connect get discarded.
+        // Endpoints which connected faster in the past go first.
+        vector<tcp::endpoint> endpoints;
+        for (; !m_endpoints.empty(); m_endpoints.pop())
+            endpoints.push_back(m_endpoints.front());
+        stable_sort(endpoints.begin(), endpoints.end(),
+            [this](const tcp::endpoint& a, const tcp::endpoint& b) {
+                return m_conn->EndpointScore(toString(a)) < m_conn->EndpointScore(toString(b));
+            });
+        m_connectPending = queue<boost::asio::ip::basic_endpoint<boost::asio::ip::tcp>>();
+        for (auto& endpoint : endpoints)
+            m_connectPending.push(endpoint);
+        start_connect_attempt();
     }
     else
     {
@@ -349,6 +326,117 @@ void EthStratumClient::start_connect()
     }
 }
 
+void EthStratumClient::start_connect_attempt()
+{
+    if (m_connectPending.empty())
+        return;
+
+    ConnectAttempt attempt;
+    attempt.endpoint = m_connectPending.front();
+    attempt.socket = make_shared<tcp::socket>(m_io_service);
+    attempt.started = chrono::steady_clock::now();
+    m_connectPending.pop();
+
+#ifdef DEV_BUILD
+    if (g_logOptions & LOG_CONNECT)
+        cnote << ("Trying " + toString(attempt.endpoint) + " ...");
+#endif
+
+    attempt.socket->async_connect(attempt.endpoint,
+        m_io_strand.wrap(boost::bind(
+            &EthStratumClient::connect_attempt_handler, this, _1, attempt.socket)));
+    m_connectAttempts.push_back(attempt);
+
+    // Give this attempt a head start before racing the next endpoint
+    if (!m_connectPending.empty())
+    {
+        m_connectrace_timer.expires_from_now(
+            boost::posix_time::milliseconds(c_connectAttemptDelay));
+        m_connectrace_timer.async_wait(m_io_strand.wrap(boost::bind(
+            &EthStratumClient::connectrace_timer_elapsed, this, boost::asio::placeholders::error)));
+    }
+}
+
+void EthStratumClient::connectrace_timer_elapsed(const boost::system::error_code& ec)
+{
+    if (ec == boost::asio::error::operation_aborted || !m_connecting.load(memory_order_relaxed))
+        return;
+    start_connect_attempt();
+}
+
+void EthStratumClient::connect_attempt_handler(
+    const boost::system::error_code& ec, shared_ptr<tcp::socket> socket)
+{
+    auto attempt = find_if(m_connectAttempts.begin(), m_connectAttempts.end(),
+        [&socket](const ConnectAttempt& a) { return a.socket == socket; });
+
+    // Race has already been settled
+    if (attempt == m_connectAttempts.end())
+        return;
+
+    if (ec || !socket->is_open())
+    {
+        cwarn << ("Error  " + toString(attempt->endpoint) + " [ " +
+                  (ec ? ec.message() : "Timeout") + " ]");
+
+        m_conn->recordEndpointTimeout(toString(attempt->endpoint));
+
+        // In case of error boost does not close the socket
+        boost::system::error_code cec;
+        socket->close(cec);
+        m_connectAttempts.erase(attempt);
+
+        // No point in waiting for the delay to expire
+        if (!m_connectPending.empty())
+        {
+            m_connectrace_timer.cancel();
+            start_connect_attempt();
+        }
+        else if (m_connectAttempts.empty())
+        {
+            connect_handler(ec ? ec : boost::asio::error::timed_out);
+        }
+        return;
+    }
+
+    // We have a winner. Keep the endpoints not known to have failed for
+    // later reconnections, the winning one in front.
+    m_connectrace_timer.cancel();
+    m_endpoint = attempt->endpoint;
+    auto delay =
+        chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - attempt->started);
+    m_conn->ConnectLatency().record(delay);
+    m_conn->recordEndpoint(toString(m_endpoint), delay);
+    m_endpoints.push(m_endpoint);
+    for (auto& other : m_connectAttempts)
+    {
+        if (other.socket == socket)
+            continue;
+        boost::system::error_code cec;
+        other.socket->close(cec);
+        m_endpoints.push(other.endpoint);
+    }
+    for (; !m_connectPending.empty(); m_connectPending.pop())
+        m_endpoints.push(m_connectPending.front());
+    m_connectAttempts.clear();
+
+    // Connected socket takes the place of the one the stream was built on
+    *m_socket = std::move(*socket);
+    connect_handler(ec);
+}
+
+void EthStratumClient::cancel_connect_attempts()
+{
+    m_connectrace_timer.cancel();
+    m_connectPending = queue<boost::asio::ip::basic_endpoint<boost::asio::ip::tcp>>();
+    for (auto& attempt : m_connectAttempts)
+    {
+        boost::system::error_code ec;
+        attempt.socket->close(ec);
+    }
+    m_connectAttempts.clear();
+}
+
 void EthStratumClient::workloop_timer_elapsed(const boost::system::error_code& ec)
 {
     using namespace chrono;
@@ -386,13 +474,24 @@ void EthStratumClient::workloop_timer_elapsed(const boost::system::error_code& e
             response_delay_ms =
                 duration_cast<milliseconds>(steady_clock::now() - response_plea_time);
 
-            if ((m_responsetimeout * 1000) >= response_delay_ms.count())
+            if (response_delay_ms.count() >= (m_responsetimeout * 1000))
             {
                 if (m_connecting.load(memory_order_relaxed))
                 {
-                    // The socket is closed so that any outstanding
+                    // Pool did not complete TLS handshake in time
+                    if (m_connectAttempts.empty() && m_socket && m_socket->is_open())
+                    {
+                        m_socket->close();
+                        return;
+                    }
+
+                    // None of the endpoints being raced connected in time.
+                    // Sockets are closed so that any outstanding
                     // asynchronous connection operations are cancelled.
-                    m_socket->close();
+                    for (auto& attempt : m_connectAttempts)
+                        m_conn->recordEndpointTimeout(toString(attempt.endpoint));
+                    cancel_connect_attempts();
+                    connect_handler(boost::asio::error::timed_out);
                     return;
                 }
 
@@ -432,7 +531,7 @@ void EthStratumClient::workloop_timer_elapsed(const boost::system::error_code& e
                 }
                 else
                 {
-                    // Waiting for a response to solution submission
+                    // Waiting for a response to a request
                     cwarn << "No response received in " << m_responsetimeout << " seconds.";
                     m_endpoints.pop();
                     clear_response_pleas();
@@ -454,6 +553,9 @@ void EthStratumClient::workloop_timer_elapsed(const boost::system::error_code& e
         }
     }
 
+    if (isConnected() && m_submits.size())
+        checkSubmitTimeouts();
+
     // Resubmit timing operations
     m_workloop_timer.expires_from_now(boost::posix_time::milliseconds(m_workloop_interval));
     m_workloop_timer.async_wait(m_io_strand.wrap(boost::bind(
@@ -466,23 +568,17 @@ void EthStratumClient::connect_handler(const boost::system::error_code& ec)
     m_connecting.store(false, memory_order_relaxed);
 
 
-    // Timeout has run before or we got error
+    // Timeout has run before or all endpoints failed
     if (ec || !m_socket->is_open())
     {
-        cwarn << ("Error  " + toString(m_endpoint) + " [ " + (ec ? ec.message() : "Timeout") +
-                  " ]");
+        m_conn->ConnectLatency().recordTimeout();
+        if (ec == boost::asio::error::timed_out)
+            cwarn << "No endpoint of " << m_conn->Host() << " connected in "
+                  << m_responsetimeout << " seconds.";
 
-        // We need to close the socket used in the previous connection attempt
-        // before starting a new one.
-        // In case of error, in fact, boost does not close the socket
-        // If socket is not opened it means we got timed out
-        if (m_socket->is_open())
-            m_socket->close();
-
-        // Discard this endpoint and try the next available.
+        // Failed endpoints have been discarded already.
         // Eventually is start_connect which will check for an
         // empty list.
-        m_endpoints.pop();
         m_io_service.post(m_io_strand.wrap(boost::bind(&EthStratumClient::start_connect, this)));
 
         return;
@@ -492,10 +588,10 @@ void EthStratumClient::connect_handler(const boost::system::error_code& ec)
     m_conn->Responds(true);
     m_connected.store(true, memory_order_relaxed);
 
-    m_message.clear();
+    m_framer.clear();
 
     // Clear txqueue
-    m_txQueue.consume_all([](string* l) { delete l; });
+    m_txQueue.consume_all([this](string* l) { recycle(l); });
 
 #ifdef DEV_BUILD
     if (g_logOptions & LOG_CONNECT)
@@ -504,56 +600,89 @@ void EthStratumClient::connect_handler(const boost::system::error_code& ec)
 
     if (m_conn->SecLevel() != SecureLevel::NONE)
     {
-        boost::system::error_code hec;
         m_securesocket->lowest_layer().set_option(boost::asio::socket_base::keep_alive(true));
         m_securesocket->lowest_layer().set_option(tcp::no_delay(true));
 
-        m_securesocket->handshake(boost::asio::ssl::stream_base::client, hec);
+        // Offer the session previously negotiated with pool, if any.
+        // Connection stays pending until handshake completes.
+        TlsContext::get().prepare(m_securesocket->native_handle(), m_conn->Host(), m_conn->Port());
+        m_connecting.store(true, memory_order_relaxed);
+        clear_response_pleas();
+        enqueue_response_plea();
+        m_handshake_started = chrono::steady_clock::now();
+        m_securesocket->async_handshake(boost::asio::ssl::stream_base::client,
+            m_io_strand.wrap(boost::bind(
+                &EthStratumClient::handshake_handler, this, boost::asio::placeholders::error)));
+        return;
+    }
 
-        if (hec)
-        {
-            cwarn << "SSL/TLS Handshake failed: " << hec.message();
-            if (hec.value() == 337047686)
-            {  // certificate verification failed
-                cwarn << "This can have multiple reasons:";
-                cwarn << "* Root certs are either not installed or not found";
-                cwarn << "* Pool uses a self-signed certificate";
-                cwarn << "* Pool hostname you're connecting to does not match the CN registered "
-                         "for the certificate.";
-                cwarn << "Possible fixes:";
-#ifndef _WIN32
-                cwarn << "* Make sure the file '/etc/ssl/certs/ca-certificates.crt' exists and "
-                         "is accessible";
-                cwarn << "* Export the correct path via 'export "
-                         "SSL_CERT_FILE=/etc/ssl/certs/ca-certificates.crt' to the correct "
-                         "file";
-                cwarn << "  On most systems you can install the 'ca-certificates' package";
-                cwarn << "  You can also get the latest file here: "
-                         "https://curl.haxx.se/docs/caextract.html";
-#endif
-                cwarn << "* Double check hostname in the -P argument.";
-                cwarn << "* Disable certificate verification all-together via environment "
-                         "variable. See nsfminer --help for info about environment variables";
-                cwarn << "If you do the latter please be advised you might expose yourself to the "
-                         "risk of seeing your shares stolen";
-            }
+    m_nonsecuresocket->set_option(boost::asio::socket_base::keep_alive(true));
+    m_nonsecuresocket->set_option(tcp::no_delay(true));
+    start_login();
+}
 
-            // This is a fatal error
-            // No need to try other IPs as the certificate is based on host-name
-            // not ip address. Trying other IPs would end up with the very same error.
-            m_conn->MarkUnrecoverable();
-            m_io_service.post(m_io_strand.wrap(boost::bind(&EthStratumClient::disconnect, this)));
-            return;
-        }
+void EthStratumClient::handshake_handler(const boost::system::error_code& ec)
+{
+    m_connecting.store(false, memory_order_relaxed);
+
+    // Disconnection requested while handshaking
+    if (m_disconnecting.load(memory_order_relaxed))
+        return;
+
+    if (ec == boost::asio::error::operation_aborted)
+    {
+        cwarn << "SSL/TLS Handshake timed out";
+        m_io_service.post(m_io_strand.wrap(boost::bind(&EthStratumClient::disconnect, this)));
+        return;
     }
-    else
+
+    if (ec)
     {
-        m_nonsecuresocket->set_option(boost::asio::socket_base::keep_alive(true));
-        m_nonsecuresocket->set_option(tcp::no_delay(true));
+        cwarn << "SSL/TLS Handshake failed: " << ec.message();
+        if (ec.value() == 337047686)
+        {  // certificate verification failed
+            cwarn << "This can have multiple reasons:";
+            cwarn << "* Root certs are either not installed or not found";
+            cwarn << "* Pool uses a self-signed certificate";
+            cwarn << "* Pool hostname you're connecting to does not match the CN registered "
+                     "for the certificate.";
+            cwarn << "Possible fixes:";
+#ifndef _WIN32
+            cwarn << "* Make sure the file '/etc/ssl/certs/ca-certificates.crt' exists and "
+                     "is accessible";
+            cwarn << "* Export the correct path via 'export "
+                     "SSL_CERT_FILE=/etc/ssl/certs/ca-certificates.crt' to the correct "
+                     "file";
+            cwarn << "  On most systems you can install the 'ca-certificates' package";
+            cwarn << "  You can also get the latest file here: "
+                     "https://curl.haxx.se/docs/caextract.html";
+#endif
+            cwarn << "* Double check hostname in the -P argument.";
+            cwarn << "* Disable certificate verification all-together via environment "
+                     "variable. See nsfminer --help for info about environment variables";
+            cwarn << "If you do the latter please be advised you might expose yourself to the "
+                     "risk of seeing your shares stolen";
+        }
+
+        // This is a fatal error
+        // No need to try other IPs as the certificate is based on host-name
+        // not ip address. Trying other IPs would end up with the very same error.
+        TlsContext::get().forget(m_conn->Host(), m_conn->Port());
+        m_conn->MarkUnrecoverable();
+        m_io_service.post(m_io_strand.wrap(boost::bind(&EthStratumClient::disconnect, this)));
+        return;
     }
 
-    // Clean buffer from any previous stale data
-    m_sendBuffer.consume(4096);
+    m_conn->HandshakeLatency().record(chrono::duration_cast<chrono::milliseconds>(
+        chrono::steady_clock::now() - m_handshake_started));
+    if (SSL_session_reused(m_securesocket->native_handle()))
+        m_conn->addResumedHandshake();
+
+    start_login();
+}
+
+void EthStratumClient::start_login()
+{
     clear_response_pleas();
 
     /*
@@ -647,6 +776,8 @@ void EthStratumClient::startSession()
 {
     // Start a new session of data
     m_session = unique_ptr<Session>(new Session());
+    m_submitTemplate.clear();
+    m_shareRate.reset();
     m_current_timestamp = chrono::steady_clock::now();
 
     // Invoke higher level handlers
@@ -916,6 +1047,7 @@ void EthStratumClient::processResponse(Json::Value& responseObject)
 
                     m_session->subscribed.store(true, memory_order_relaxed);
                     m_session->authorized.store(true, memory_order_relaxed);
+                    buildSubmitTemplate();
 
                     // Request initial work
                     jReq["id"] = unsigned(5);
@@ -1068,6 +1200,7 @@ void EthStratumClient::processResponse(Json::Value& responseObject)
             else
             {
                 cnote << "Authorized worker " << m_conn->UserDotWorker();
+                buildSubmitTemplate();
             }
         }
 
@@ -1089,15 +1222,13 @@ void EthStratumClient::processResponse(Json::Value& responseObject)
             m_session->authorized.store(true, memory_order_relaxed);
             m_session->workerId = jResult.asString();
             cnote << "Authorized worker " << m_conn->UserDotWorker();
+            buildSubmitTemplate();
 
             // Nothing else to here. Wait for notifications from pool
         }
 
-        else if ((_id >= 40 && _id <= m_solution_submitted_max_id) &&
-                 m_conn->StratumMode() != ETHEREUMSTRATUM2)
+        else if (_id >= SubmitTracker::FirstId && m_conn->StratumMode() != ETHEREUMSTRATUM2)
         {
-            response_delay_ms = dequeue_response_plea();
-
             // Response to solution submission mining.submit
             // (https://en.bitcoin.it/wiki/Stratum_mining_protocol#mining.submit) Result should be
             // boolean, some pools also throw an error, so _isSuccess can be false Due to this
@@ -1106,28 +1237,11 @@ void EthStratumClient::processResponse(Json::Value& responseObject)
             if (_isSuccess && jResult.isBool())
                 _isSuccess = jResult.asBool();
 
-            const unsigned miner_index = _id - 40;
-            if (_isSuccess)
-            {
-                if (m_onSolutionAccepted)
-                    m_onSolutionAccepted(response_delay_ms, miner_index, false);
-            }
-            else
-            {
-                if (m_onSolutionRejected)
-                {
-                    cwarn << "Reject reason : "
-                          << (_errReason.empty() ? "Unspecified" : _errReason);
-                    m_onSolutionRejected(response_delay_ms, miner_index);
-                }
-            }
+            processSolutionResponse(_id, _isSuccess, false, _errReason);
         }
 
-        else if ((_id >= 40 && _id <= m_solution_submitted_max_id) &&
-                 m_conn->StratumMode() == ETHEREUMSTRATUM2)
+        else if (_id >= SubmitTracker::FirstId && m_conn->StratumMode() == ETHEREUMSTRATUM2)
         {
-            response_delay_ms = dequeue_response_plea();
-
             // In EthereumStratum/2.0.0 we can evaluate the severity of the
             // error. An 2xx error means the solution have been accepted but is
             // likely stale
@@ -1139,23 +1253,7 @@ void EthStratumClient::processResponse(Json::Value& responseObject)
                     _isSuccess = isStale = true;
             }
 
-
-            const unsigned miner_index = _id - 40;
-            if (_isSuccess)
-            {
-                if (m_onSolutionAccepted)
-                    m_onSolutionAccepted(response_delay_ms, miner_index, isStale);
-            }
-            else
-            {
-                
-                if (m_onSolutionRejected)
-                {
-                    cwarn << "Reject reason : "
-                          << (_errReason.empty() ? "Unspecified" : _errReason);
-                    m_onSolutionRejected(response_delay_ms, miner_index);
-                }
-            }
+            processSolutionResponse(_id, _isSuccess, isStale, _errReason);
         }
 
         else if (_id == 5)
@@ -1183,6 +1281,17 @@ void EthStratumClient::processResponse(Json::Value& responseObject)
             }
         }
 
+        else if (_id == 10)
+        {
+            // Response to mining.suggest_difficulty which is not part of
+            // EthereumStratum/1.0.0 spec. Stop proposing if pool doesn't get it
+            if (!_isSuccess || (jResult.isBool() && !jResult.asBool()))
+            {
+                cnote << "Pool does not accept difficulty suggestions";
+                m_shareRate.refused();
+            }
+        }
+
         else if (_id == 999)
         {
             // This unfortunate case should not happen as none of the outgoing requests is marked
@@ -1526,6 +1635,272 @@ void EthStratumClient::processResponse(Json::Value& responseObject)
     }
 }
 
+void EthStratumClient::processSolutionResponse(
+    unsigned _id, bool _isSuccess, bool _isStale, const string& _errReason)
+{
+    // Pool may answer late (after timeout) or with ids we never sent
+    if (!m_submits.remove(_id, m_submitReply))
+    {
+        cnote << "Got response for unknown solution id [" << _id << "] Discarding...";
+        return;
+    }
+
+    auto response_delay_ms = chrono::duration_cast<chrono::milliseconds>(
+        chrono::steady_clock::now() - m_submitReply.sent);
+    m_conn->SubmitLatency().record(response_delay_ms);
+
+    const unsigned miner_index = m_submitReply.midx;
+    if (_isSuccess)
+    {
+        if (m_onSolutionAccepted)
+            m_onSolutionAccepted(response_delay_ms, miner_index, _isStale);
+    }
+    else
+    {
+        if (m_onSolutionRejected)
+        {
+            cwarn << "Reject reason : " << (_errReason.empty() ? "Unspecified" : _errReason);
+            m_onSolutionRejected(response_delay_ms, miner_index);
+        }
+    }
+}
+
+void EthStratumClient::checkSubmitTimeouts()
+{
+    // Solutions left unanswered for too long
+    auto deadline = chrono::steady_clock::now() - chrono::seconds(m_responsetimeout);
+    bool expired = false;
+    while (m_submits.expire(deadline, m_submitReply))
+    {
+        m_conn->SubmitLatency().recordTimeout();
+        cwarn << "No response received in " << m_responsetimeout << " seconds for solution 0x"
+              << toHex(m_submitReply.nonce) << " (job " << m_submitReply.job << ")";
+        expired = true;
+    }
+
+    if (expired)
+    {
+        m_endpoints.pop();
+        clear_response_pleas();
+        m_io_service.post(m_io_strand.wrap(boost::bind(&EthStratumClient::disconnect, this)));
+    }
+}
+
+bool EthStratumClient::processFastMessage(string_view line)
+{
+    /*
+    Handles the messages which make up the bulk of the traffic once
+    the session is established : new jobs, target changes and replies
+    to submitted solutions. Values are decoded straight from the received
+    line into the work package. Whatever is not recognized here (or does
+    not look exactly as expected) is left to processResponse.
+    Nothing is changed unless the whole message could be decoded.
+    */
+
+    if (!m_conn->StratumModeConfirmed() || !m_session)
+        return false;
+
+    StratumMessage msg;
+    if (!StratumParser::parse(line, msg))
+        return false;
+
+    // Let processResponse complain about invalid jsonrpc
+    if (!msg.jsonrpc.isAbsent() && (!msg.jsonrpc.isString() || msg.jsonrpc.text != "2.0"))
+        return false;
+
+    unsigned long id = 0;
+    if (!msg.id.isAbsent() && !msg.id.isNull() &&
+        (msg.id.type != StratumValueType::Number || !StratumParser::toUnsigned(msg.id.text, id)))
+        return false;
+
+    auto mode = m_conn->StratumMode();
+
+    // Replies to submitted solutions. Only plain accepts or rejects : error
+    // details are left to processResponse
+    if (msg.method.isAbsent() && id >= SubmitTracker::FirstId)
+    {
+        if (!msg.error.isAbsent() && !msg.error.isNull())
+            return false;
+        if (!msg.result.isBool() && !msg.result.isNull())
+            return false;
+        processSolutionResponse(id, !msg.result.isBool() || msg.result.asBool(), false, "");
+        return true;
+    }
+
+    // Eth-Proxy jobs come in as replies to eth_getWork (or as unsolicited ones)
+    bool isNotify = (msg.method.isString() && msg.method.text == "mining.notify");
+    if (!isNotify && mode == ETHPROXY && msg.method.isAbsent() && (id == 0 || id == 5) &&
+        msg.result.isArray())
+        isNotify = true;
+
+    if (isNotify && mode != ETHEREUMSTRATUM2)
+    {
+        if (!isSubscribed() || m_newjobprocessed)
+            return true;
+
+        // See Nanopool workaround in processResponse
+        bool inResult = (mode == ETHPROXY && !msg.result.isAbsent());
+        const StratumValue& prm = inResult ? msg.result : msg.params;
+        unsigned prmIdx = inResult ? 0 : 1;
+        if (!prm.isArray() || !msg.at(prm, 0).isString())
+            return false;
+
+        h256 seed, header, boundary = m_session->nextWorkBoundary;
+        int block = -1;
+        if (mode == ETHEREUMSTRATUM)
+        {
+            const StratumValue& sSeedHash = msg.at(prm, 1);
+            const StratumValue& sHeaderHash = msg.at(prm, 2);
+            if (!sSeedHash.isString() || !sHeaderHash.isString() ||
+                !StratumParser::toHash(sSeedHash.text, seed, false) ||
+                !StratumParser::toHash(sHeaderHash.text, header, false))
+                return false;
+        }
+        else
+        {
+            const StratumValue& sHeaderHash = msg.at(prm, prmIdx);
+            const StratumValue& sSeedHash = msg.at(prm, prmIdx + 1);
+            const StratumValue& sShareTarget = msg.at(prm, prmIdx + 2);
+            if (!sHeaderHash.isString() || !sSeedHash.isString() || !sShareTarget.isString() ||
+                !StratumParser::toHash(sHeaderHash.text, header, false) ||
+                !StratumParser::toHash(sSeedHash.text, seed, false) ||
+                !StratumParser::toHash(sShareTarget.text, boundary, true))
+                return false;
+
+            // Optional block number (see processResponse)
+            const StratumValue& sBlock = msg.at(prm, prmIdx + 3);
+            unsigned long number;
+            if (mode == ETHPROXY && sBlock.isString() && sBlock.text.substr(0, 2) == "0x" &&
+                StratumParser::toUnsigned(sBlock.text, number, 16) && number <= 0x9660180)
+                block = int(number);
+        }
+
+        m_current.job.assign(msg.at(prm, 0).text);
+        m_current.seed = seed;
+        m_current.header = header;
+        m_current.boundary = boundary;
+        m_current.block = block;
+        if (mode == ETHEREUMSTRATUM)
+        {
+            m_current.startNonce = m_session->extraNonce;
+            m_current.exSizeBytes = m_session->extraNonceSizeBytes;
+        }
+        m_current_timestamp = chrono::steady_clock::now();
+        m_newjobprocessed = true;
+        return true;
+    }
+
+    if (isNotify && mode == ETHEREUMSTRATUM2)
+    {
+        if (!m_session->firstMiningSet || !msg.params.isArray() || msg.params.count != 4)
+            return false;
+
+        const StratumValue& sJob = msg.at(msg.params, 0);
+        const StratumValue& sBlock = msg.at(msg.params, 1);
+        const StratumValue& sHeader = msg.at(msg.params, 2);
+        unsigned long block;
+        h256 header;
+        if (!sJob.isString() || !sBlock.isString() || !sHeader.isString() ||
+            !StratumParser::toUnsigned(sBlock.text, block, 16) ||
+            !StratumParser::toHash(sHeader.text, header, true))
+            return false;
+
+        m_current.job.assign(sJob.text);
+        m_current.block = int(block);
+        m_current.header = header;
+        m_current.boundary = m_session->nextWorkBoundary;
+        m_current.epoch = m_session->epoch;
+        m_current.algo = m_session->algo;
+        m_current.startNonce = m_session->extraNonce;
+        m_current.exSizeBytes = m_session->extraNonceSizeBytes;
+        m_current_timestamp = chrono::steady_clock::now();
+        m_newjobprocessed = true;
+        return true;
+    }
+
+    if (!msg.method.isString())
+        return false;
+
+    if (msg.method.text == "mining.set_difficulty" && mode == ETHEREUMSTRATUM)
+    {
+        const StratumValue& diff = msg.at(msg.params, 0);
+        double nextWorkDifficulty;
+        if (diff.type != StratumValueType::Number ||
+            !StratumParser::toDouble(diff.text, nextWorkDifficulty))
+            return false;
+
+        nextWorkDifficulty = max(nextWorkDifficulty, 0.0001);
+        m_session->nextWorkBoundary = h256(dev::getTargetFromDiff(nextWorkDifficulty));
+        return true;
+    }
+
+    if (msg.method.text == "mining.set" && mode == ETHEREUMSTRATUM2)
+    {
+        if (!msg.params.isObject() || !msg.params.count)
+            return false;
+
+        const StratumValue& sTimeout = msg.get(msg.params, "timeout");
+        const StratumValue& sEpoch = msg.get(msg.params, "epoch");
+        const StratumValue& sTarget = msg.get(msg.params, "target");
+        const StratumValue& sAlgo = msg.get(msg.params, "algo");
+        const StratumValue& sEnonce = msg.get(msg.params, "extranonce");
+
+        // All members are optional. Empty ones are ignored
+        auto isHex = [](const StratumValue& _v, unsigned long& _value) {
+            return _v.isAbsent() ||
+                   (_v.isString() &&
+                       (_v.text.empty() || StratumParser::toUnsigned(_v.text, _value, 16)));
+        };
+        unsigned long timeout = m_session->timeout, epoch = m_session->epoch, enonce = 0;
+        h256 target = m_session->nextWorkBoundary;
+        if (!isHex(sTimeout, timeout) || !isHex(sEpoch, epoch) || !isHex(sEnonce, enonce) ||
+            sEnonce.text.size() > 16 || (!sAlgo.isAbsent() && !sAlgo.isString()) ||
+            (!sTarget.isAbsent() && !(sTarget.isString() && (sTarget.text.empty() ||
+                                         StratumParser::toHash(sTarget.text, target, true)))))
+            return false;
+
+        m_session->firstMiningSet = true;
+        m_session->timeout = unsigned(timeout);
+        m_session->epoch = unsigned(epoch);
+        m_session->nextWorkBoundary = target;
+        m_session->algo.assign(sAlgo.isAbsent() ? string_view("ethash") : sAlgo.text);
+        if (!sEnonce.isAbsent() && !sEnonce.text.empty())
+        {
+            string enonce(sEnonce.text);
+            processExtranonce(enonce);
+        }
+        return true;
+    }
+
+    return false;
+}
+
+void EthStratumClient::checkShareRate()
+{
+    // Only EthereumStratum/1.0.0 lets miner have a say on difficulty
+    if (!m_shareRate.enabled() || m_conn->StratumMode() != ETHEREUMSTRATUM || !isAuthorized())
+        return;
+
+    double hashrate = Farm::f().HashRate();
+    double difficulty = getHashesToTarget(m_current.boundary.hex(HexPrefix::Add)) /
+                        ShareRateController::HashesPerDiff;
+    double proposed;
+    if (!m_shareRate.check(hashrate, difficulty, chrono::steady_clock::now(), proposed))
+        return;
+
+    cnote << "Expecting " << fixed << setprecision(2)
+          << ShareRateController::rate(hashrate, difficulty)
+          << " shares/min. Suggesting difficulty " << defaultfloat << setprecision(6)
+          << proposed << " to pool";
+
+    Json::Value jReq;
+    jReq["id"] = unsigned(10);
+    jReq["method"] = "mining.suggest_difficulty";
+    jReq["params"] = Json::Value(Json::arrayValue);
+    jReq["params"].append(proposed);
+    send(jReq);
+}
+
 void EthStratumClient::submitHashrate(uint64_t const& rate, string const& id)
 {
     if (!isConnected())
@@ -1570,19 +1945,14 @@ void EthStratumClient::submitHashrate(uint64_t const& rate, string const& id)
     send(jReq);
 }
 
-void EthStratumClient::submitSolution(const Solution& solution)
+void EthStratumClient::buildSubmitTemplate()
 {
-    if (!isAuthorized())
-    {
-        cwarn << "Solution not submitted. Not authorized.";
-        return;
-    }
-
+    // Solution submissions differ only by a few fields : serialize the
+    // request once per session with placeholders in their place
+    auto field = [](SubmitTemplate::Field f) { return SubmitTemplate::placeholder(f); };
     Json::Value jReq;
 
-    unsigned id = 40 + solution.midx;
-    jReq["id"] = id;
-    m_solution_submitted_max_id = max(m_solution_submitted_max_id, id);
+    jReq["id"] = field(SubmitTemplate::Field::Id);
     jReq["method"] = "mining.submit";
     jReq["params"] = Json::Value(Json::arrayValue);
 
@@ -1592,10 +1962,10 @@ void EthStratumClient::submitSolution(const Solution& solution)
 
         jReq["jsonrpc"] = "2.0";
         jReq["params"].append(m_conn->User());
-        jReq["params"].append(solution.work.job);
-        jReq["params"].append(toHex(solution.nonce, HexPrefix::Add));
-        jReq["params"].append(solution.work.header.hex(HexPrefix::Add));
-        jReq["params"].append(solution.mixHash.hex(HexPrefix::Add));
+        jReq["params"].append(field(SubmitTemplate::Field::Job));
+        jReq["params"].append(field(SubmitTemplate::Field::Nonce));
+        jReq["params"].append(field(SubmitTemplate::Field::Header));
+        jReq["params"].append(field(SubmitTemplate::Field::MixHash));
         if (!m_conn->Workername().empty())
             jReq["worker"] = m_conn->Workername();
 
@@ -1604,9 +1974,9 @@ void EthStratumClient::submitSolution(const Solution& solution)
     case EthStratumClient::ETHPROXY:
 
         jReq["method"] = "eth_submitWork";
-        jReq["params"].append(toHex(solution.nonce, HexPrefix::Add));
-        jReq["params"].append(solution.work.header.hex(HexPrefix::Add));
-        jReq["params"].append(solution.mixHash.hex(HexPrefix::Add));
+        jReq["params"].append(field(SubmitTemplate::Field::Nonce));
+        jReq["params"].append(field(SubmitTemplate::Field::Header));
+        jReq["params"].append(field(SubmitTemplate::Field::MixHash));
         if (!m_conn->Workername().empty())
             jReq["worker"] = m_conn->Workername();
 
@@ -1615,37 +1985,58 @@ void EthStratumClient::submitSolution(const Solution& solution)
     case EthStratumClient::ETHEREUMSTRATUM:
 
         jReq["params"].append(m_conn->UserDotWorker());
-        jReq["params"].append(solution.work.job);
-        jReq["params"].append(
-            toHex(solution.nonce, HexPrefix::DontAdd).substr(solution.work.exSizeBytes));
+        jReq["params"].append(field(SubmitTemplate::Field::Job));
+        jReq["params"].append(field(SubmitTemplate::Field::NonceTail));
         break;
-        
+
     case EthStratumClient::ETHEREUMSTRATUM2:
 
-        jReq["params"].append(solution.work.job);
-        jReq["params"].append(
-            toHex(solution.nonce, HexPrefix::DontAdd).substr(solution.work.exSizeBytes));
+        jReq["params"].append(field(SubmitTemplate::Field::Job));
+        jReq["params"].append(field(SubmitTemplate::Field::NonceTail));
         jReq["params"].append(m_session->workerId);
-        break;        
+        break;
     }
 
-    enqueue_response_plea();
-    send(jReq);
+    m_submitTemplate.build(Json::writeString(m_jSwBuilder, jReq));
+}
+
+void EthStratumClient::submitSolution(const Solution& solution)
+{
+    if (!isAuthorized())
+    {
+        cwarn << "Solution not submitted. Not authorized.";
+        return;
+    }
+
+    if (m_submitTemplate.empty())
+        buildSubmitTemplate();
+
+    unsigned id = m_submits.add(solution.midx, solution.work.job, solution.nonce);
+
+    string* line = txLine();
+    m_submitTemplate.render(*line, id, solution, m_session->extraNonceSizeBytes);
+
+    send(line);
+    flush();
 }
 
 void EthStratumClient::recvSocketData()
 {
     if (m_conn->SecLevel() != SecureLevel::NONE)
     {
-        async_read(*m_securesocket, m_recvBuffer, boost::asio::transfer_at_least(1),
-            m_io_strand.wrap(boost::bind(&EthStratumClient::onRecvSocketDataCompleted, this,
-                boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred)));
+        async_read(*m_securesocket, m_framer.prepare(), boost::asio::transfer_at_least(1),
+            m_io_strand.wrap(makeAllocHandler(m_recvMemory,
+                boost::bind(&EthStratumClient::onRecvSocketDataCompleted, this,
+                    boost::asio::placeholders::error,
+                    boost::asio::placeholders::bytes_transferred))));
     }
     else
     {
-        async_read(*m_nonsecuresocket, m_recvBuffer, boost::asio::transfer_at_least(1),
-            m_io_strand.wrap(boost::bind(&EthStratumClient::onRecvSocketDataCompleted, this,
-                boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred)));
+        async_read(*m_nonsecuresocket, m_framer.prepare(), boost::asio::transfer_at_least(1),
+            m_io_strand.wrap(makeAllocHandler(m_recvMemory,
+                boost::bind(&EthStratumClient::onRecvSocketDataCompleted, this,
+                    boost::asio::placeholders::error,
+                    boost::asio::placeholders::bytes_transferred))));
     }
 }
 
@@ -1659,85 +2050,74 @@ void EthStratumClient::onRecvSocketDataCompleted(
 
     if (!ec)
     {
-        // DO NOT DO THIS !!!!!
-        // istream is(&m_recvBuffer);
-        // string message;
-        // getline(is, message)
-        /*
-        There are three reasons :
-        1 - Previous async_read_until calls this handler (aside from error codes)
-            with the number of bytes in the buffer's get area up to and including
-            the delimiter. So we know where to split the line
-        2 - Boost's documentation clearly states that after a succesfull
-            async_read_until operation the stream buffer MAY contain additional
-            data which HAVE to be left in the buffer for subsequent read operations.
-            If another delimiter exists in the buffer then it will get caught
-            by the next async_read_until()
-        3 - istream is(&m_recvBuffer) will CONSUME ALL data in the buffer
-            thus invalidating the previous point 2
-        */
+        uint64_t allocations = threadAllocations();
+        unsigned messages = 0;
 
-        // Extract received message and free the buffer
-        string rx_message(
-            boost::asio::buffer_cast<const char*>(m_recvBuffer.data()), bytes_transferred);
-        m_recvBuffer.consume(bytes_transferred);
-        m_message.append(rx_message);
+        // Received data lands directly in the framer's storage
+        m_framer.commit(bytes_transferred);
+        if (m_framer.overflows() != m_framerOverflows)
+        {
+            m_framerOverflows = m_framer.overflows();
+            cwarn << "Stratum got an oversized message : discarded";
+        }
 
         // Process each line in the transmission
         // NOTE : as multiple jobs may come in with
         // a single transmission only the last will be dispatched
         m_newjobprocessed = false;
-        string line;
-        size_t offset = m_message.find("\n");
-        while (offset != string::npos)
+        string_view line;
+        while (m_framer.next(line))
         {
-            if (offset > 0)
+            if (line.empty())
+                continue;
+            messages++;
+
+            // Out received message only for debug purpouses
+            if (g_logOptions & LOG_JSON)
+                cnote << " << " << line;
+
+            // Hot messages are decoded in place, all others
+            // go through the full json parser
+            if (processFastMessage(line))
+                continue;
+
+            // Test validity of chunk and process
+            Json::Value jMsg;
+            Json::Reader jRdr;
+            if (jRdr.parse(line.data(), line.data() + line.size(), jMsg))
             {
-                line = m_message.substr(0, offset);
-                boost::trim(line);
-
-                if (!line.empty())
+                try
                 {
-                    // Out received message only for debug purpouses
-                    if (g_logOptions & LOG_JSON)
-                        cnote << " << " << line;
-
-                    // Test validity of chunk and process
-                    Json::Value jMsg;
-                    Json::Reader jRdr;
-                    if (jRdr.parse(line, jMsg))
-                    {
-                        try
-                        {
-                            // Run in sync so no 2 different async reads may overlap
-                            processResponse(jMsg);
-                        }
-                        catch (const exception& _ex)
-                        {
-                            cwarn << "Stratum got invalid Json message : " << _ex.what();
-                        }
-                    }
-                    else
-                    {
-                        string what = jRdr.getFormattedErrorMessages();
-                        boost::replace_all(what, "\n", " ");
-                        cwarn << "Stratum got invalid Json message : " << what;
-                    }
+                    // Run in sync so no 2 different async reads may overlap
+                    processResponse(jMsg);
+                }
+                catch (const exception& _ex)
+                {
+                    cwarn << "Stratum got invalid Json message : " << _ex.what();
                 }
             }
-
-            m_message.erase(0, offset + 1);
-            offset = m_message.find("\n");
+            else
+            {
+                string what = jRdr.getFormattedErrorMessages();
+                boost::replace_all(what, "\n", " ");
+                cwarn << "Stratum got invalid Json message : " << what;
+            }
         }
 
         // There is a new job - dispatch it
         if (m_newjobprocessed)
+        {
             if (m_onWorkReceived)
                 m_onWorkReceived(m_current);
+            checkShareRate();
+        }
 
         // Eventually keep reading from socket
         if (isConnected())
             recvSocketData();
+
+        if (m_conn)
+            m_conn->addMessages(messages, threadAllocations() - allocations);
     }
     else
     {
@@ -1768,11 +2148,41 @@ void EthStratumClient::onRecvSocketDataCompleted(
     }
 }
 
+string* EthStratumClient::txLine()
+{
+    // Reuse a previously sent line so its storage is already there
+    string* line;
+    if (m_txSpare.pop(line))
+        return line;
+    return new string();
+}
+
+void EthStratumClient::recycle(string* line)
+{
+    if (!m_txSpare.bounded_push(line))
+        delete line;
+}
+
 void EthStratumClient::send(Json::Value const& jReq)
 {
-    string* line = new string(Json::writeString(m_jSwBuilder, jReq));
+    string* line = txLine();
+    *line = Json::writeString(m_jSwBuilder, jReq);
+    send(line);
+    flush();
+}
+
+void EthStratumClient::send(string* line)
+{
+    // Delimiter goes in the line itself so each line is written
+    // from a single buffer. Only queued : transmission starts on flush()
+    line->push_back(c_lineDelimiter);
     m_txQueue.push(line);
+}
 
+void EthStratumClient::flush()
+{
+    // If a write is already in progress queued lines
+    // will be picked up as soon as it completes
     bool ex = false;
     if (m_txPending.compare_exchange_strong(ex, true, memory_order_relaxed))
         sendSocketData();
@@ -1782,44 +2192,61 @@ void EthStratumClient::sendSocketData()
 {
     if (!isConnected() || m_txQueue.empty())
     {
-        m_sendBuffer.consume(m_sendBuffer.capacity());
-        m_txQueue.consume_all([](string* l) { delete l; });
+        m_txQueue.consume_all([this](string* l) { recycle(l); });
         m_txPending.store(false, memory_order_relaxed);
         return;
     }
 
+    // Gather as many queued lines as possible in a single write.
+    // Lines are written straight from their own storage
     string* line;
-    ostream os(&m_sendBuffer);
-    while (m_txQueue.pop(line))
+    m_txBuffers.clear();
+    while (m_txInflight.size() < c_maxTxBatch && m_txQueue.pop(line))
     {
-        os << *line << endl;
         // Out received message only for debug purpouses
         if (g_logOptions & LOG_JSON)
-            cnote << " >> " << *line;
+            cnote << " >> " << string_view(*line).substr(0, line->size() - 1);
 
-        delete line;
+        m_txInflight.push_back(line);
+        m_txBuffers.push_back(boost::asio::buffer(*line));
     }
 
     if (m_conn->SecLevel() != SecureLevel::NONE)
     {
-        async_write(*m_securesocket, m_sendBuffer,
-            m_io_strand.wrap(boost::bind(&EthStratumClient::onSendSocketDataCompleted, this,
-                boost::asio::placeholders::error)));
+        // A TLS stream seals each buffer in a record of its own :
+        // merge batched lines so they go out in a single one
+        if (m_txBuffers.size() > 1)
+        {
+            m_txCoalesced.clear();
+            for (string* l : m_txInflight)
+                m_txCoalesced.append(*l);
+            m_txBuffers.assign(1, boost::asio::buffer(m_txCoalesced));
+        }
+        async_write(*m_securesocket, m_txBuffers,
+            m_io_strand.wrap(makeAllocHandler(m_sendMemory,
+                boost::bind(&EthStratumClient::onSendSocketDataCompleted, this,
+                    boost::asio::placeholders::error))));
     }
     else
     {
-        async_write(*m_nonsecuresocket, m_sendBuffer,
-            m_io_strand.wrap(boost::bind(&EthStratumClient::onSendSocketDataCompleted, this,
-                boost::asio::placeholders::error)));
+        async_write(*m_nonsecuresocket, m_txBuffers,
+            m_io_strand.wrap(makeAllocHandler(m_sendMemory,
+                boost::bind(&EthStratumClient::onSendSocketDataCompleted, this,
+                    boost::asio::placeholders::error))));
     }
 }
 
 void EthStratumClient::onSendSocketDataCompleted(const boost::system::error_code& ec)
 {
+    // Written lines go back to the pool
+    for (string* line : m_txInflight)
+        recycle(line);
+    m_txInflight.clear();
+    m_txBuffers.clear();
+
     if (ec)
     {
-        m_sendBuffer.consume(m_sendBuffer.capacity());
-        m_txQueue.consume_all([](string* l) { delete l; });
+        m_txQueue.consume_all([this](string* l) { recycle(l); });
         m_txPending.store(false, memory_order_relaxed);
 
         if ((ec.category() == boost::asio::error::get_ssl_category()) &&
@@ -1895,6 +2322,7 @@ void EthStratumClient::clear_response_pleas()
     using namespace chrono;
     steady_clock::time_point response_plea_time;
     m_response_pleas_count.store(0, memory_order_relaxed);
+    m_submits.clear();
     while (m_response_plea_times.pop(response_plea_time))
     {
     };
@@ -11,12 +11,19 @@
 #include <json/json.h>
 
 #include <libdevcore/FixedHash.h>
+#include <libdevcore/HandlerMemory.h>
+#include <libdevcore/LineFramer.h>
 #include <libdevcore/Log.h>
 #include <libethcore/EthashAux.h>
 #include <libethcore/Farm.h>
 #include <libethcore/Miner.h>
 
+#include "../DnsCache.h"
 #include "../PoolClient.h"
+#include "../ShareRate.h"
+#include "StratumParser.h"
+#include "SubmitTemplate.h"
+#include "SubmitTracker.h"
 
 using namespace std;
 using namespace dev;
@@ -60,7 +67,8 @@ public:
         ETHEREUMSTRATUM2
     };
 
-    EthStratumClient(int worktimeout, int responsetimeout);
+    EthStratumClient(int worktimeout, int responsetimeout, double sharerate = 0);
+    ~EthStratumClient();
 
     void init_socket();
     void connect() override;
@@ -90,18 +98,35 @@ private:
     void enqueue_response_plea();
     std::chrono::milliseconds dequeue_response_plea();
     void clear_response_pleas();
-    void resolve_handler(
-        const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::iterator i);
+    void resolve_handler(const boost::system::error_code& ec,
+        const std::vector<boost::asio::ip::tcp::endpoint>& endpoints);
     void start_connect();
+    void start_connect_attempt();
+    void connectrace_timer_elapsed(const boost::system::error_code& ec);
+    void connect_attempt_handler(const boost::system::error_code& ec,
+        std::shared_ptr<boost::asio::ip::tcp::socket> socket);
+    void cancel_connect_attempts();
     void connect_handler(const boost::system::error_code& ec);
+    void handshake_handler(const boost::system::error_code& ec);
+    void start_login();
     void workloop_timer_elapsed(const boost::system::error_code& ec);
     void processResponse(Json::Value& responseObject);
+    bool processFastMessage(std::string_view line);
+    void processSolutionResponse(
+        unsigned _id, bool _isSuccess, bool _isStale, const std::string& _errReason);
+    void checkSubmitTimeouts();
+    void checkShareRate();
     std::string processError(Json::Value& erroresponseObject);
     void processExtranonce(std::string& enonce);
     void recvSocketData();
     void onRecvSocketDataCompleted(
         const boost::system::error_code& ec, std::size_t bytes_transferred);
+    void buildSubmitTemplate();
+    std::string* txLine();
+    void recycle(std::string* line);
     void send(Json::Value const& jReq);
+    void send(std::string* line);
+    void flush();
     void sendSocketData();
     void onSendSocketDataCompleted(const boost::system::error_code& ec);
     void onSSLShutdownCompleted(const boost::system::error_code& ec);
@@ -125,20 +150,28 @@ private:
     boost::asio::io_service& m_io_service;  // The IO service reference passed in the constructor
     boost::asio::io_service::strand m_io_strand;
     boost::asio::ip::tcp::socket* m_socket;
-    std::string m_message;  // The internal message string buffer
+    LineFramer m_framer;    // Splits received data in lines
+    unsigned m_framerOverflows = 0;
     bool m_newjobprocessed = false;
 
+    // Recycled storage of the pending read and write operations
+    dev::HandlerMemory m_recvMemory;
+    dev::HandlerMemory m_sendMemory;
+
     // Use shared ptrs to avoid crashes due to async_writes
     // see
     // https://stackoverflow.com/questions/41526553/can-async-write-cause-segmentation-fault-when-this-is-deleted
     std::shared_ptr<boost::asio::ssl::stream<boost::asio::ip::tcp::socket>> m_securesocket;
     std::shared_ptr<boost::asio::ip::tcp::socket> m_nonsecuresocket;
 
-    boost::asio::streambuf m_sendBuffer;
-    boost::asio::streambuf m_recvBuffer;
+    std::vector<std::string*> m_txInflight;                // Lines being written
+    std::vector<boost::asio::const_buffer> m_txBuffers;  // Gather list for the write
+    std::string m_txCoalesced;  // Batched lines merged for a TLS write
     Json::StreamWriterBuilder m_jSwBuilder;
 
     boost::asio::deadline_timer m_workloop_timer;
+    boost::asio::deadline_timer m_connectrace_timer;
+    std::chrono::steady_clock::time_point m_handshake_started;
 
     std::atomic<int> m_response_pleas_count = {0};
     std::atomic<std::chrono::steady_clock::duration> m_response_plea_older;
@@ -146,11 +179,26 @@ private:
 
     std::atomic<bool> m_txPending = {false};
     boost::lockfree::queue<std::string*> m_txQueue;
+    boost::lockfree::queue<std::string*> m_txSpare;  // Sent lines kept for reuse
+
+    SubmitTemplate m_submitTemplate;  // Solution submission for current session
 
-    boost::asio::ip::tcp::resolver m_resolver;
     std::queue<boost::asio::ip::basic_endpoint<boost::asio::ip::tcp>> m_endpoints;
 
-    unsigned m_solution_submitted_max_id;  // maximum json id we used to send a solution
+    // An endpoint being raced during connection
+    struct ConnectAttempt
+    {
+        boost::asio::ip::tcp::endpoint endpoint;
+        std::shared_ptr<boost::asio::ip::tcp::socket> socket;
+        std::chrono::steady_clock::time_point started;
+    };
+    std::vector<ConnectAttempt> m_connectAttempts;  // Attempts in flight
+    std::queue<boost::asio::ip::basic_endpoint<boost::asio::ip::tcp>> m_connectPending;
+
+    SubmitTracker m_submits;        // Solutions awaiting response
+    InflightSubmit m_submitReply;  // Last submission removed from tracker
+
+    ShareRateController m_shareRate;  // Negotiates difficulty with pool
 
     ///@brief Auxiliary function to make verbose_verification objects.
     template <typename Verifier>
@@ -0,0 +1,255 @@
+
+#include <cctype>
+#include <charconv>
+#include <cstdlib>
+#include <cstring>
+
+#include <libdevcore/CommonData.h>
+
+#include "StratumParser.h"
+
+using namespace std;
+
+namespace dev
+{
+namespace eth
+{
+namespace
+{
+const StratumValue c_absent;
+
+class Cursor
+{
+public:
+    Cursor(string_view _s, StratumMessage& _msg)
+      : m_p(_s.data()), m_end(_s.data() + _s.size()), m_msg(_msg)
+    {}
+
+    void skipWs()
+    {
+        while (m_p < m_end && (*m_p == ' ' || *m_p == '\t' || *m_p == '\r' || *m_p == '\n'))
+            m_p++;
+    }
+
+    bool consume(char _c)
+    {
+        skipWs();
+        if (m_p < m_end && *m_p == _c)
+        {
+            m_p++;
+            return true;
+        }
+        return false;
+    }
+
+    bool atEnd()
+    {
+        skipWs();
+        return m_p == m_end;
+    }
+
+    bool quoted(string_view& _s)
+    {
+        if (!consume('"'))
+            return false;
+        const char* begin = m_p;
+        while (m_p < m_end && *m_p != '"')
+        {
+            // Escapes would need a copy : leave them to the full parser
+            if (*m_p == '\\' || static_cast<unsigned char>(*m_p) < 0x20)
+                return false;
+            m_p++;
+        }
+        if (m_p == m_end)
+            return false;
+        _s = string_view(begin, m_p - begin);
+        m_p++;
+        return true;
+    }
+
+    bool value(StratumValue& _v, bool _nested)
+    {
+        skipWs();
+        if (m_p == m_end)
+            return false;
+
+        switch (*m_p)
+        {
+        case '"':
+            _v.type = StratumValueType::String;
+            return quoted(_v.text);
+        case 't':
+            _v.type = StratumValueType::Bool;
+            return literal("true", _v.text);
+        case 'f':
+            _v.type = StratumValueType::Bool;
+            return literal("false", _v.text);
+        case 'n':
+            _v.type = StratumValueType::Null;
+            return literal("null", _v.text);
+        case '[':
+        case '{':
+            if (_nested)
+                return false;
+            return container(_v);
+        default:
+            return number(_v);
+        }
+    }
+
+private:
+    bool literal(const char* _lit, string_view& _text)
+    {
+        size_t len = strlen(_lit);
+        if (size_t(m_end - m_p) < len || memcmp(m_p, _lit, len) != 0)
+            return false;
+        _text = string_view(m_p, len);
+        m_p += len;
+        return true;
+    }
+
+    bool number(StratumValue& _v)
+    {
+        const char* begin = m_p;
+        while (m_p < m_end && (isdigit(static_cast<unsigned char>(*m_p)) || *m_p == '-' ||
+                                  *m_p == '+' || *m_p == '.' || *m_p == 'e' || *m_p == 'E'))
+            m_p++;
+        if (m_p == begin)
+            return false;
+        _v.type = StratumValueType::Number;
+        _v.text = string_view(begin, m_p - begin);
+        return true;
+    }
+
+    bool container(StratumValue& _v)
+    {
+        bool isObject = (*m_p == '{');
+        char close = isObject ? '}' : ']';
+        m_p++;
+
+        _v.type = isObject ? StratumValueType::Object : StratumValueType::Array;
+        _v.first = m_msg.itemsCount;
+        _v.count = 0;
+        if (consume(close))
+            return true;
+
+        do
+        {
+            if (m_msg.itemsCount == StratumMessage::MaxItems)
+                return false;
+            unsigned idx = m_msg.itemsCount++;
+            m_msg.keys[idx] = string_view();
+            m_msg.items[idx] = StratumValue();
+            if (isObject && (!quoted(m_msg.keys[idx]) || !consume(':')))
+                return false;
+            if (!value(m_msg.items[idx], true))
+                return false;
+            _v.count++;
+        } while (consume(','));
+
+        return consume(close);
+    }
+
+    const char* m_p;
+    const char* m_end;
+    StratumMessage& m_msg;
+};
+
+}  // namespace
+
+const StratumValue& StratumMessage::at(const StratumValue& _c, unsigned _idx) const
+{
+    if ((!_c.isArray() && !_c.isObject()) || _idx >= _c.count)
+        return c_absent;
+    return items[_c.first + _idx];
+}
+
+const StratumValue& StratumMessage::get(const StratumValue& _c, string_view _key) const
+{
+    if (_c.isObject())
+        for (unsigned i = _c.first; i < _c.first + _c.count; i++)
+            if (keys[i] == _key)
+                return items[i];
+    return c_absent;
+}
+
+bool StratumParser::parse(string_view _line, StratumMessage& _msg)
+{
+    _msg = StratumMessage();
+    Cursor cur(_line, _msg);
+
+    if (!cur.consume('{'))
+        return false;
+    if (cur.consume('}'))
+        return cur.atEnd();
+
+    do
+    {
+        string_view key;
+        StratumValue value;
+        if (!cur.quoted(key) || !cur.consume(':') || !cur.value(value, false))
+            return false;
+
+        if (key == "id")
+            _msg.id = value;
+        else if (key == "method")
+            _msg.method = value;
+        else if (key == "params")
+            _msg.params = value;
+        else if (key == "result")
+            _msg.result = value;
+        else if (key == "error")
+            _msg.error = value;
+        else if (key == "jsonrpc")
+            _msg.jsonrpc = value;
+    } while (cur.consume(','));
+
+    return cur.consume('}') && cur.atEnd();
+}
+
+bool StratumParser::toHash(string_view _hex, h256& _hash, bool _pad)
+{
+    if (_hex.size() >= 2 && _hex[0] == '0' && (_hex[1] == 'x' || _hex[1] == 'X'))
+        _hex.remove_prefix(2);
+    if (_hex.empty() || _hex.size() > 64 || (!_pad && _hex.size() != 64))
+        return false;
+
+    // Digits are right aligned
+    h256 hash;
+    ::byte* out = hash.data();
+    size_t pos = 64 - _hex.size();
+    for (char c : _hex)
+    {
+        int v = fromHex(c, WhenError::DontThrow);
+        if (v < 0)
+            return false;
+        out[pos / 2] |= (pos % 2) ? v : (v << 4);
+        pos++;
+    }
+    _hash = hash;
+    return true;
+}
+
+bool StratumParser::toUnsigned(string_view _text, unsigned long& _value, int _base)
+{
+    if (_base == 16 && _text.size() >= 2 && _text[0] == '0' &&
+        (_text[1] == 'x' || _text[1] == 'X'))
+        _text.remove_prefix(2);
+    auto r = from_chars(_text.data(), _text.data() + _text.size(), _value, _base);
+    return (r.ec == errc() && r.ptr == _text.data() + _text.size() && !_text.empty());
+}
+
+bool StratumParser::toDouble(string_view _text, double& _value)
+{
+    char buf[64];
+    if (_text.empty() || _text.size() >= sizeof(buf))
+        return false;
+    memcpy(buf, _text.data(), _text.size());
+    buf[_text.size()] = 0;
+    char* end;
+    _value = strtod(buf, &end);
+    return (end == buf + _text.size());
+}
+
+}  // namespace eth
+}  // namespace dev
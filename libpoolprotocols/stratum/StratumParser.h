@@ -0,0 +1,90 @@
+
+#pragma once
+
+#include <string_view>
+
+#include <libdevcore/FixedHash.h>
+
+namespace dev
+{
+namespace eth
+{
+enum class StratumValueType
+{
+    Absent,
+    Null,
+    Bool,
+    Number,
+    String,
+    Array,
+    Object
+};
+
+// A json value as seen by StratumParser. Scalars keep a view of their
+// literal text (strings without the quotes), containers refer to a
+// range of items in the owning StratumMessage.
+struct StratumValue
+{
+    StratumValueType type = StratumValueType::Absent;
+    std::string_view text;
+    unsigned first = 0;
+    unsigned count = 0;
+
+    bool isString() const { return type == StratumValueType::String; }
+    bool isBool() const { return type == StratumValueType::Bool; }
+    bool isNull() const { return type == StratumValueType::Null; }
+    bool isArray() const { return type == StratumValueType::Array; }
+    bool isObject() const { return type == StratumValueType::Object; }
+    bool isAbsent() const { return type == StratumValueType::Absent; }
+    bool asBool() const { return text == "true"; }
+};
+
+// Members of a stratum line relevant to hot path messages.
+// All views point into the parsed line and are valid as long as it is.
+struct StratumMessage
+{
+    static constexpr unsigned MaxItems = 16;
+
+    StratumValue id;
+    StratumValue jsonrpc;
+    StratumValue method;
+    StratumValue result;
+    StratumValue error;
+    StratumValue params;
+
+    // Storage for elements of arrays and members of objects
+    StratumValue items[MaxItems];
+    std::string_view keys[MaxItems];
+    unsigned itemsCount = 0;
+
+    // Element _idx of container _c (Absent if out of range)
+    const StratumValue& at(const StratumValue& _c, unsigned _idx) const;
+
+    // Member _key of object _c (Absent if missing)
+    const StratumValue& get(const StratumValue& _c, std::string_view _key) const;
+};
+
+/**
+ * @brief Decodes stratum lines in a single pass without building a
+ * document tree and without allocations.
+ * It only handles what pools send on hot paths : a flat object
+ * whose members are scalars or arrays/objects of scalars, and
+ * strings without escape sequences. Anything else is refused and
+ * the caller is expected to fall back to a full json parser.
+ */
+class StratumParser
+{
+public:
+    static bool parse(std::string_view _line, StratumMessage& _msg);
+
+    // Hex string (optionally 0x prefixed) to hash. When _pad shorter
+    // strings are left padded with zeroes otherwise 64 digits are required
+    static bool toHash(std::string_view _hex, h256& _hash, bool _pad);
+
+    static bool toUnsigned(std::string_view _text, unsigned long& _value, int _base = 10);
+
+    static bool toDouble(std::string_view _text, double& _value);
+};
+
+}  // namespace eth
+}  // namespace dev
@@ -0,0 +1,179 @@
+
+#include <cstring>
+
+#include "SubmitTemplate.h"
+
+using namespace std;
+
+namespace dev
+{
+namespace eth
+{
+namespace
+{
+const char c_hexDigits[] = "0123456789abcdef";
+
+const SubmitTemplate::Field c_fields[] = {SubmitTemplate::Field::Id, SubmitTemplate::Field::Job,
+    SubmitTemplate::Field::Nonce, SubmitTemplate::Field::NonceTail,
+    SubmitTemplate::Field::Header, SubmitTemplate::Field::MixHash};
+
+void appendHex(string& _out, const ::byte* _data, size_t _size)
+{
+    for (size_t i = 0; i < _size; i++)
+    {
+        _out.push_back(c_hexDigits[_data[i] >> 4]);
+        _out.push_back(c_hexDigits[_data[i] & 0x0f]);
+    }
+}
+
+void appendNonce(string& _out, uint64_t _nonce, unsigned _skipDigits)
+{
+    for (unsigned i = _skipDigits; i < 16; i++)
+        _out.push_back(c_hexDigits[(_nonce >> ((15 - i) * 4)) & 0x0f]);
+}
+
+// Job ids are echoed back as json strings
+void appendEscaped(string& _out, const string& _s)
+{
+    for (char c : _s)
+    {
+        if (c == '"' || c == '\\')
+        {
+            _out.push_back('\\');
+            _out.push_back(c);
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            _out.append("\\u00");
+            _out.push_back(c_hexDigits[(c >> 4) & 0x0f]);
+            _out.push_back(c_hexDigits[c & 0x0f]);
+        }
+        else
+            _out.push_back(c);
+    }
+}
+
+}  // namespace
+
+const char* SubmitTemplate::placeholder(Field _field)
+{
+    switch (_field)
+    {
+    case Field::Id:
+        return "@@id@@";
+    case Field::Job:
+        return "@@job@@";
+    case Field::Nonce:
+        return "@@nonce@@";
+    case Field::NonceTail:
+        return "@@noncetail@@";
+    case Field::Header:
+        return "@@header@@";
+    case Field::MixHash:
+        return "@@mixhash@@";
+    }
+    return "";
+}
+
+void SubmitTemplate::build(const string& _request)
+{
+    clear();
+    m_text.reserve(_request.size());
+
+    size_t pos = 0;
+    while (pos < _request.size())
+    {
+        // Locate the nearest placeholder
+        size_t found = string::npos;
+        Field field = Field::Id;
+        for (Field f : c_fields)
+        {
+            size_t p = _request.find(placeholder(f), pos);
+            if (p < found)
+            {
+                found = p;
+                field = f;
+            }
+        }
+
+        Segment seg = {m_text.size(), 0, false, field};
+        if (found == string::npos)
+        {
+            m_text.append(_request, pos, string::npos);
+            seg.length = m_text.size() - seg.offset;
+            m_segments.push_back(seg);
+            break;
+        }
+
+        // Id is a number thus drop the quotes placeholder was serialized with
+        size_t end = found + strlen(placeholder(field));
+        if (field == Field::Id && found > pos && _request[found - 1] == '"')
+        {
+            found--;
+            end++;
+        }
+
+        m_text.append(_request, pos, found - pos);
+        seg.length = m_text.size() - seg.offset;
+        seg.isField = true;
+        m_segments.push_back(seg);
+        pos = end;
+    }
+}
+
+void SubmitTemplate::clear()
+{
+    m_text.clear();
+    m_segments.clear();
+}
+
+void SubmitTemplate::render(
+    string& _out, unsigned _id, const Solution& _solution, unsigned _exSizeBytes) const
+{
+    _out.clear();
+    _out.reserve(m_text.size() + _solution.work.job.size() + 256);
+
+    for (const Segment& seg : m_segments)
+    {
+        _out.append(m_text, seg.offset, seg.length);
+        if (!seg.isField)
+            continue;
+
+        switch (seg.field)
+        {
+        case Field::Id:
+        {
+            char buf[16];
+            char* p = buf + sizeof(buf);
+            do
+            {
+                *--p = char('0' + _id % 10);
+                _id /= 10;
+            } while (_id);
+            _out.append(p, buf + sizeof(buf) - p);
+            break;
+        }
+        case Field::Job:
+            appendEscaped(_out, _solution.work.job);
+            break;
+        case Field::Nonce:
+            _out.append("0x");
+            appendNonce(_out, _solution.nonce, 0);
+            break;
+        case Field::NonceTail:
+            appendNonce(_out, _solution.nonce, min(_exSizeBytes, 16u));
+            break;
+        case Field::Header:
+            _out.append("0x");
+            appendHex(_out, _solution.work.header.data(), h256::size);
+            break;
+        case Field::MixHash:
+            _out.append("0x");
+            appendHex(_out, _solution.mixHash.data(), h256::size);
+            break;
+        }
+    }
+}
+
+}  // namespace eth
+}  // namespace dev
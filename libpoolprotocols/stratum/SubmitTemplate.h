@@ -0,0 +1,62 @@
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include <libethcore/EthashAux.h>
+
+namespace dev
+{
+namespace eth
+{
+/**
+ * @brief A solution submission request serialized once per session.
+ * Everything which does not change among submissions (method, user,
+ * worker, protocol specific members) is kept as literal text and only
+ * the variable fields are written in place when rendering.
+ */
+class SubmitTemplate
+{
+public:
+    enum class Field : uint8_t
+    {
+        Id,         // Request id (json number)
+        Job,        // Job identifier
+        Nonce,      // Full nonce, 0x prefixed
+        NonceTail,  // Nonce without the extranonce digits set by pool
+        Header,     // Header hash, 0x prefixed
+        MixHash     // Mix hash, 0x prefixed
+    };
+
+    // Placeholder to be put in the request in lieu of the field
+    static const char* placeholder(Field _field);
+
+    // Builds template from a serialized request holding placeholders
+    void build(const std::string& _request);
+
+    void clear();
+    bool empty() const { return m_segments.empty(); }
+
+    // Writes the request for a solution into _out reusing its capacity.
+    // _exSizeBytes is the length (hex digits) of the extranonce set by
+    // pool, left out of NonceTail. Solution's work may tell a longer one
+    // when its nonce range was narrowed further (eg. proxy slots)
+    void render(std::string& _out, unsigned _id, const Solution& _solution,
+        unsigned _exSizeBytes) const;
+
+private:
+    struct Segment
+    {
+        size_t offset;  // Offset of literal text in m_text
+        size_t length;  // Length of literal text
+        bool isField;   // Whether the literal is followed by a field
+        Field field;
+    };
+
+    std::string m_text;
+    std::vector<Segment> m_segments;
+};
+
+}  // namespace eth
+}  // namespace dev
@@ -0,0 +1,77 @@
+
+#include "SubmitTracker.h"
+
+using namespace std;
+
+namespace dev
+{
+namespace eth
+{
+SubmitTracker::SubmitTracker() : m_slots(64) {}
+
+unsigned SubmitTracker::add(unsigned _midx, const string& _job, uint64_t _nonce)
+{
+    // Keep ids within the range of a positive json integer
+    unsigned id = m_nextId++;
+    if (m_nextId > 0x7fffffff)
+        m_nextId = FirstId;
+
+    auto slot = m_slots.begin();
+    while (slot != m_slots.end() && slot->used)
+        slot++;
+    if (slot == m_slots.end())
+    {
+        m_slots.emplace_back();
+        slot = m_slots.end() - 1;
+    }
+
+    slot->id = id;
+    slot->sent = chrono::steady_clock::now();
+    slot->midx = _midx;
+    slot->job.assign(_job);
+    slot->nonce = _nonce;
+    slot->used = true;
+    m_count++;
+    return id;
+}
+
+bool SubmitTracker::remove(unsigned _id, InflightSubmit& _submit)
+{
+    if (!m_count)
+        return false;
+    for (auto& slot : m_slots)
+    {
+        if (slot.used && slot.id == _id)
+        {
+            _submit = slot;
+            slot.used = false;
+            m_count--;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool SubmitTracker::expire(chrono::steady_clock::time_point _deadline, InflightSubmit& _submit)
+{
+    InflightSubmit* oldest = nullptr;
+    for (auto& slot : m_slots)
+        if (slot.used && slot.sent < _deadline && (!oldest || slot.sent < oldest->sent))
+            oldest = &slot;
+    if (!oldest)
+        return false;
+    _submit = *oldest;
+    oldest->used = false;
+    m_count--;
+    return true;
+}
+
+void SubmitTracker::clear()
+{
+    for (auto& slot : m_slots)
+        slot.used = false;
+    m_count = 0;
+}
+
+}  // namespace eth
+}  // namespace dev
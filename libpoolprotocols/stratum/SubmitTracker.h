@@ -0,0 +1,57 @@
+
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace dev
+{
+namespace eth
+{
+// A solution sent to pool and not yet answered
+struct InflightSubmit
+{
+    unsigned id = 0;
+    std::chrono::steady_clock::time_point sent;
+    unsigned midx = 0;
+    std::string job;
+    uint64_t nonce = 0;
+    bool used = false;
+};
+
+/**
+ * @brief Keeps track of solutions awaiting a response from pool.
+ * Each submission gets a json-rpc id of its own so responses can be
+ * matched regardless of the order they come in. Slots are reused
+ * so tracking a submission does not allocate.
+ */
+class SubmitTracker
+{
+public:
+    // Ids below this are reserved to other requests
+    static constexpr unsigned FirstId = 1000;
+
+    SubmitTracker();
+
+    // Records a submission and returns the id to send it with
+    unsigned add(unsigned _midx, const std::string& _job, uint64_t _nonce);
+
+    // Removes the submission with given id. False if not (or no longer) tracked
+    bool remove(unsigned _id, InflightSubmit& _submit);
+
+    // Removes the oldest submission sent before _deadline if any
+    bool expire(std::chrono::steady_clock::time_point _deadline, InflightSubmit& _submit);
+
+    void clear();
+    unsigned size() const { return m_count; }
+
+private:
+    std::vector<InflightSubmit> m_slots;
+    unsigned m_count = 0;
+    unsigned m_nextId = FirstId;
+};
+
+}  // namespace eth
+}  // namespace dev
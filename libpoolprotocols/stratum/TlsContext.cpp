@@ -0,0 +1,143 @@
+
+#include <boost/asio/ip/address.hpp>
+
+#include <libdevcore/Log.h>
+
+#include "TlsContext.h"
+
+#ifdef _WIN32
+// Needed for certificates validation on TLS connections
+#include <wincrypt.h>
+#endif
+
+using namespace std;
+
+namespace dev
+{
+namespace eth
+{
+namespace
+{
+// Where connections keep the key of the session cache entry they belong to
+int sessionKeyIndex()
+{
+    static int index = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+    return index;
+}
+
+}  // namespace
+
+TlsContext& TlsContext::get()
+{
+    static TlsContext instance;
+    return instance;
+}
+
+TlsContext::TlsContext() : m_context(boost::asio::ssl::context::tlsv12)
+{
+    loadCertificates();
+
+    // Sessions are handed to us once established, OpenSSL's own
+    // cache is server side only
+    SSL_CTX_set_session_cache_mode(
+        m_context.native_handle(), SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_sess_set_new_cb(m_context.native_handle(), &TlsContext::onNewSession);
+}
+
+TlsContext::~TlsContext()
+{
+    for (auto& s : m_sessions)
+        if (s.second)
+            SSL_SESSION_free(s.second);
+}
+
+void TlsContext::loadCertificates()
+{
+#ifdef _WIN32
+    HCERTSTORE hStore = CertOpenSystemStore(0, "ROOT");
+    if (hStore == nullptr)
+    {
+        return;
+    }
+
+    X509_STORE* store = X509_STORE_new();
+    PCCERT_CONTEXT pContext = nullptr;
+    while ((pContext = CertEnumCertificatesInStore(hStore, pContext)) != nullptr)
+    {
+        X509* x509 = d2i_X509(
+            nullptr, (const unsigned char**)&pContext->pbCertEncoded, pContext->cbCertEncoded);
+        if (x509 != nullptr)
+        {
+            X509_STORE_add_cert(store, x509);
+            X509_free(x509);
+        }
+    }
+
+    CertFreeCertificateContext(pContext);
+    CertCloseStore(hStore, 0);
+
+    SSL_CTX_set_cert_store(m_context.native_handle(), store);
+#else
+    char* certPath = getenv("SSL_CERT_FILE");
+    try
+    {
+        m_context.load_verify_file(certPath ? certPath : "/etc/ssl/certs/ca-certificates.crt");
+    }
+    catch (...)
+    {
+        cwarn << "Failed to load ca certificates. Either the file "
+                 "'/etc/ssl/certs/ca-certificates.crt' does not exist";
+        cwarn << "or the environment variable SSL_CERT_FILE is set to an invalid or "
+                 "inaccessible file.";
+        cwarn << "It is possible that certificate verification can fail.";
+    }
+#endif
+}
+
+void TlsContext::prepare(SSL* _ssl, const string& _host, unsigned short _port)
+{
+    // Server name indication is for host names only
+    boost::system::error_code ec;
+    boost::asio::ip::address::from_string(_host, ec);
+    if (ec)
+        SSL_set_tlsext_host_name(_ssl, _host.c_str());
+
+    lock_guard<mutex> l(m_mutex);
+    auto entry = m_sessions.emplace(_host + ":" + to_string(_port), nullptr).first;
+    SSL_set_ex_data(_ssl, sessionKeyIndex(), const_cast<string*>(&entry->first));
+    if (entry->second)
+        SSL_set_session(_ssl, entry->second);
+}
+
+void TlsContext::forget(const string& _host, unsigned short _port)
+{
+    lock_guard<mutex> l(m_mutex);
+    auto entry = m_sessions.find(_host + ":" + to_string(_port));
+    if (entry != m_sessions.end() && entry->second)
+    {
+        SSL_SESSION_free(entry->second);
+        entry->second = nullptr;
+    }
+}
+
+int TlsContext::onNewSession(SSL* _ssl, SSL_SESSION* _session)
+{
+    auto key = static_cast<string*>(SSL_get_ex_data(_ssl, sessionKeyIndex()));
+    if (!key)
+        return 0;
+
+    // Entries are never erased thus the key is still valid. Latest
+    // session (or ticket) replaces the previous one.
+    TlsContext& tls = get();
+    lock_guard<mutex> l(tls.m_mutex);
+    SSL_SESSION*& cached = tls.m_sessions[*key];
+    if (cached)
+        SSL_SESSION_free(cached);
+    cached = _session;
+
+    // We keep the reference OpenSSL passed over
+    return 1;
+}
+
+}  // namespace eth
+}  // namespace dev
@@ -0,0 +1,47 @@
+
+#pragma once
+
+#include <map>
+#include <mutex>
+#include <string>
+
+#include <boost/asio/ssl.hpp>
+
+namespace dev
+{
+namespace eth
+{
+/**
+ * @brief TLS client context shared by all stratum connections.
+ * Trusted certificates are loaded once per process and the session
+ * negotiated with each pool is kept so that reconnections resume it
+ * with an abbreviated handshake.
+ */
+class TlsContext
+{
+public:
+    static TlsContext& get();
+
+    boost::asio::ssl::context& context() { return m_context; }
+
+    // Sets server name and offers the session cached for host (if any)
+    // to a connection about to handshake
+    void prepare(SSL* _ssl, const std::string& _host, unsigned short _port);
+
+    // Drops the session cached for host
+    void forget(const std::string& _host, unsigned short _port);
+
+private:
+    TlsContext();
+    ~TlsContext();
+
+    void loadCertificates();
+    static int onNewSession(SSL* _ssl, SSL_SESSION* _session);
+
+    boost::asio::ssl::context m_context;
+    std::mutex m_mutex;
+    std::map<std::string, SSL_SESSION*> m_sessions;  // Keyed by host:port
+};
+
+}  // namespace eth
+}  // namespace dev
@@ -16,6 +16,7 @@
 #define ENABLE_VIRTUAL_TERMINAL_PROCESSING 0x0004
 #endif
 
+#include <libdevcore/ThreadPolicy.h>
 #include <libethcore/Farm.h>
 #if ETH_ETHASHCL
 #include <libethash-cl/CLMiner.h>
@@ -30,6 +31,7 @@
 
 #if API_CORE
 #include <libapicore/ApiServer.h>
+#include <libapicore/StratumServer.h>
 #include <regex>
 #endif
 
@@ -164,6 +166,20 @@ static void on_hwmon(unsigned u)
     throw boost::program_options::error("The --HWMON value must be 0, 1 or 2");
 }
 
+static void on_hwmon_interval(unsigned u)
+{
+    if (u >= 50 && u <= 5000)
+        return;
+    throw boost::program_options::error("The --HWMON-interval value must be between 50 and 5000");
+}
+
+static void on_duty_min(unsigned u)
+{
+    if (u >= 5 && u <= 100)
+        return;
+    throw boost::program_options::error("The --duty-min value must be between 5 and 100");
+}
+
 #if API_CORE
 static void on_api_port(int i)
 {
@@ -449,6 +465,18 @@ public:
 
                 "Delay in seconds before reconnection retry")
 
+            ("getwork-race",
+
+                "Get work from all getwork nodes given with -P at once. "
+                "Whichever reports a new block first sets the work, and "
+                "solutions are submitted to all of them")
+
+            ("dns-ttl", value<unsigned>()->default_value(300),
+
+                "Seconds pool addresses are used before resolving "
+                "host names again. Resolution happens in background "
+                "and last known addresses are used if it fails")
+
             ("work-timeout", value<unsigned>()->default_value(180),
 
                 "If no new work received from pool after this "
@@ -481,6 +509,12 @@ public:
 #endif
                 )
 
+            ("HWMON-interval", value<unsigned>()->default_value(500)->notifier(on_hwmon_interval),
+
+                "Hardware monitoring sampling interval in milliseconds. "
+                "Readings are summarized (min/max/mean/p95) every "
+                "collection period")
+
             ("exit",
 
                 "Stop miner whenever an error is encountered")
@@ -491,6 +525,42 @@ public:
                 "connected to a fail-over pool before trying to "
                 "reconnect to the primary (the first) connection.")
 
+            ("standby",
+
+                "Keep the pool miner would fail over to (or return to "
+                "after --failover-timeout) connected and authorized, "
+                "so switching pools does not wait for a new connection. "
+                "Applies to stratum connections only.")
+
+            ("pool-rank", value<unsigned>()->default_value(0),
+
+                "Every this number of minutes rank pools by connect "
+                "time and by share of stale and rejected solutions, "
+                "and make the best one primary. Shortly after start "
+                "as well. 0 keeps pools in given order.")
+
+            ("share-rate", value<double>()->default_value(0),
+
+                "Ask pool for the difficulty which yields this number "
+                "of shares per minute at current hashrate. Applies to "
+                "EthereumStratum/1.0.0 connections only. 0 leaves "
+                "difficulty to pool.")
+
+            ("thread-policy", value<vector<string>>()->multitoken(),
+
+                "Set scheduling of threads by role, in the form "
+                "role:key=value[:key=value...]. Roles are io (pool "
+                "and farm), gpu (GPU feeders), cpu (CPU miners) and "
+                "telemetry (hardware monitoring and API). Keys are fifo "
+                "(SCHED_FIFO priority 1-99), nice (-20..19) and cpus "
+                "(list of cores like 0,2-3). Eg. --thread-policy "
+                "io:fifo=10:cpus=0 cpu:nice=10")
+
+            ("reserve-cores", value<string>()->default_value(""),
+
+                "List of cores (like 0,2-3) only roles naming them "
+                "in --thread-policy may run on")
+
             ("nocolor",
 
                 "Monochrome display log lines")
@@ -523,6 +593,29 @@ public:
                 "Resume mining on previously overheated GPU when "
                 "temp drops below this threshold. Implies --HWMON 1. "
                 "Must be lower than --tstart")
+
+            ("ttarget", value<unsigned>()->default_value(0),
+
+                "Hold GPU temperature at this setpoint by modulating "
+                "the duty cycle of the miner instead of suspending it. "
+                "Implies --HWMON 1. Must be lower than --tstop if set. "
+                "If not set or zero no duty cycle control is performed")
+
+            ("ptarget", value<unsigned>()->default_value(0),
+
+                "Hold GPU power drain (in watts) at this setpoint by "
+                "modulating the duty cycle of the miner. Implies --HWMON 2. "
+                "If not set or zero no duty cycle control is performed")
+
+            ("duty-min", value<unsigned>()->default_value(20)->notifier(on_duty_min),
+
+                "Lowest duty cycle (percent) that --ttarget and "
+                "--ptarget may apply to a miner")
+
+            ("sysfs-root", value<string>()->default_value("/sys"),
+
+                "Root of the sysfs tree read by hardware monitors "
+                "(Linux only)")
             ("multi,m",
 		"Use multi-line status display");
 #if API_CORE
@@ -544,7 +637,19 @@ public:
 
                 "Set the password to protect interaction with API "
                 "server. If not set, any connection is granted access. "
-                "Be advised passwords are sent unencrypted");
+                "Be advised passwords are sent unencrypted")
+
+            ("api-threads", value<unsigned>()->default_value(1),
+
+                "Set the number of threads serving API connections. "
+                "They run apart from the thread serving pool and "
+                "farm so API load does not delay jobs")
+
+            ("proxy-bind", value<string>()->default_value(""),
+
+                "Set the address:port other rigs can connect to, "
+                "using EthereumStratum/1.0.0, to share the pool "
+                "connection of this miner");
 #endif
 #if ETH_ETHASHCUDA
         cu.add_options()
@@ -645,6 +750,10 @@ public:
                     << "    scheme://[user[.workername][:password]@]hostname:port[/...].\n\n"
                     << "    where 'scheme' can be any of :\n\n"
                     << "    getwork    for http getWork mode\n"
+                    << "    getwork+ws for getWork mode over a WebSocket, work is fetched as\n"
+                    << "               soon as node notifies a new head\n"
+                    << "    getwork+ipc for getWork mode over the unix domain socket of a local\n"
+                    << "               node (eg. getwork+ipc:///home/user/.ethereum/geth.ipc)\n"
                     << "    stratum    for tcp stratum mode\n"
                     << "    stratums   for tcp encrypted stratum mode\n"
                     << "    Example 1: -P getwork://127.0.0.1:8545\n"
@@ -750,10 +859,29 @@ public:
         m_PoolSettings.getWorkPollInterval = vm["farm-recheck"].as<unsigned>();
         m_PoolSettings.connectionMaxRetries = vm["farm-retries"].as<unsigned>();
         m_PoolSettings.delayBeforeRetry = vm["retry-delay"].as<unsigned>();
+        m_PoolSettings.dnsTtl = vm["dns-ttl"].as<unsigned>();
+        m_PoolSettings.getWorkRace = vm.count("getwork-race");
         m_PoolSettings.noWorkTimeout = vm["work-timeout"].as<unsigned>();
         m_PoolSettings.noResponseTimeout = vm["response-timeout"].as<unsigned>();
         m_PoolSettings.reportHashrate = vm.count("report-hashrate");
         m_PoolSettings.poolFailoverTimeout = vm["failover-timeout"].as<unsigned>();
+        m_PoolSettings.hotStandby = vm.count("standby");
+        m_PoolSettings.rankInterval = vm["pool-rank"].as<unsigned>();
+        m_PoolSettings.shareRate = vm["share-rate"].as<double>();
+
+        try
+        {
+            if (vm.count("thread-policy"))
+                for (auto& spec : vm["thread-policy"].as<vector<string>>())
+                    ThreadPolicy::parse(spec);
+            if (!vm["reserve-cores"].as<string>().empty())
+                ThreadPolicy::reserve(ThreadPolicy::parseCpus(vm["reserve-cores"].as<string>()));
+        }
+        catch (const exception& _ex)
+        {
+            cout << "Error: " << _ex.what() << "\n\n";
+            return false;
+        }
         if (vm.count("simulation"))
             m_PoolSettings.benchmarkBlock = vm["simulate"].as<unsigned>();
         if (vm.count("benchmark"))
@@ -764,6 +892,7 @@ public:
         m_multi = vm.count("multi");
 
         m_FarmSettings.hwMon = vm["HWMON"].as<unsigned>();
+        m_FarmSettings.hwMonInterval = vm["HWMON-interval"].as<unsigned>();
         m_FarmSettings.eval = vm.count("eval");
 
 #if ETH_ETHASHCUDA
@@ -778,6 +907,10 @@ public:
 
         m_FarmSettings.tempStop = vm["tstop"].as<unsigned>();
         m_FarmSettings.tempStart = vm["tstart"].as<unsigned>();
+        m_FarmSettings.tempTarget = vm["ttarget"].as<unsigned>();
+        m_FarmSettings.powerTarget = vm["ptarget"].as<unsigned>();
+        m_FarmSettings.dutyMin = vm["duty-min"].as<unsigned>();
+        m_FarmSettings.sysfsRoot = vm["sysfs-root"].as<string>();
 
         cl_miner = vm.count("opencl");
         cuda_miner = vm.count("cuda");
@@ -790,6 +923,7 @@ public:
         m_api_bind = vm["api-bind"].as<string>();
         m_api_port = vm["api-port"].as<int>();
         m_api_password = vm["api-password"].as<string>();
+        m_api_threads = vm["api-threads"].as<unsigned>();
         if (m_api_bind != "")
         {
             try
@@ -802,6 +936,19 @@ public:
                 return false;
             }
         }
+        m_proxy_bind = vm["proxy-bind"].as<string>();
+        if (m_proxy_bind != "")
+        {
+            try
+            {
+                ParseBind(m_proxy_bind, m_proxy_address, m_proxy_port, false);
+            }
+            catch (const exception&)
+            {
+                cout << "Error: --proxy-bind address invalid\n\n";
+                return false;
+            }
+        }
 #endif
 
         if (cl_miner)
@@ -870,6 +1017,19 @@ public:
             }
         }
 
+        if (m_FarmSettings.tempTarget)
+        {
+            m_FarmSettings.hwMon = max((unsigned int)m_FarmSettings.hwMon, 1U);
+            if (m_FarmSettings.tempStop && m_FarmSettings.tempStop <= m_FarmSettings.tempTarget)
+            {
+                string what = "-tstop must be greater than -ttarget";
+                throw invalid_argument(what);
+            }
+        }
+
+        if (m_FarmSettings.powerTarget)
+            m_FarmSettings.hwMon = 2;
+
         // Output warnings if any
         while (warnings.size())
         {
@@ -1059,6 +1219,8 @@ public:
 private:
     void doMiner()
     {
+        g_io_service.post([]() { ThreadPolicy::apply(ThreadRole::Io); });
+
         new PoolManager(m_PoolSettings);
         if (m_mode != OperationMode::Simulation)
             for (auto conn : m_PoolSettings.connections)
@@ -1066,9 +1228,13 @@ private:
 
 #if API_CORE
 
-        ApiServer api(m_api_address, m_api_port, m_api_password);
+        ApiServer api(m_api_address, m_api_port, m_api_password, m_api_threads);
         if (m_api_port)
             api.start();
+
+        StratumServer proxy(m_proxy_address, m_proxy_port);
+        if (m_proxy_port)
+            proxy.start();
 #endif
 
         // Start PoolManager
@@ -1090,6 +1256,10 @@ private:
         if (api.isRunning())
             api.stop();
 
+        // Stop stratum proxy
+        if (proxy.isRunning())
+            proxy.stop();
+
 #endif
         if (PoolManager::p().isRunning())
             PoolManager::p().stop();
@@ -1124,10 +1294,14 @@ private:
 
 #if API_CORE
     // -- API and Http interfaces related params
-    string m_api_bind;                 // API interface binding address in form <address>:<port>
-    string m_api_address = "0.0.0.0";  // API interface binding address (Default any)
-    int m_api_port = 0;                // API interface binding port
-    string m_api_password;             // API interface write protection password
+    string m_api_bind;                   // API interface binding address in form <address>:<port>
+    string m_api_address = "0.0.0.0";    // API interface binding address (Default any)
+    int m_api_port = 0;                  // API interface binding port
+    string m_api_password;               // API interface write protection password
+    unsigned m_api_threads = 1;          // Threads serving API connections
+    string m_proxy_bind;                 // Stratum proxy binding address in form <address>:<port>
+    string m_proxy_address = "0.0.0.0";  // Stratum proxy binding address (Default any)
+    int m_proxy_port = 0;                // Stratum proxy binding port
 #endif
 
 #if ETH_DBUS